@@ -0,0 +1,554 @@
+/*
+ * bench_compare.c — Regression gate: baseline vs variant with statistics.
+ *
+ * Runs ./bench_<baseline> and ./bench_<variant> (built by the Makefile)
+ * with --tsv for several rounds, alternating which goes first, and
+ * collects the MiB/s of every (table, type, size) cell from each round.
+ * Per cell it reports the median of each side, the change between them
+ * with a bootstrap 95% confidence interval, and the two-sided p-value of
+ * a Mann-Whitney U test over the rounds (exact for up to MW_MAX_EXACT
+ * rounds without ties, the normal approximation otherwise).
+ *
+ * A cell regresses when the variant's median is more than --threshold
+ * percent slower and p < --alpha, and the exit status is 1 if any cell
+ * does.  Both are needed: the threshold keeps a significant 0.5% wobble
+ * from failing the gate, and the test keeps one noisy round from doing
+ * so.  With 5 rounds the smallest possible p is 0.008; with 3 it is 0.1,
+ * so fewer than 4 rounds cannot fail anything at alpha 0.05.
+ *
+ * Usage:
+ *   taskset -c 0 ./bench_compare [--rounds=N] [--threshold=PCT]
+ *       [--alpha=P] [--modes=compress,decompress] [--json=FILE]
+ *       baseline step24_stats [-- bench_pglz arguments, e.g. --min-ms=100]
+ *
+ * Cells where either side failed to compress (compressed size -1, e.g.
+ * random input, which decompress mode does not time at all) have no
+ * change to test and are reported as "n/a".
+ *
+ * --json writes every sample and result for trend tracking, with null
+ * for the statistics of "n/a" cells.  Exit status is 0 without
+ * regressions, 1 with, and 2 on usage or run errors.
+ *
+ * Or use the Makefile: make gate-<variant>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+
+#define MAX_ROUNDS      100
+#define MAX_CELLS       256
+#define MAX_CMD         4096
+#define MW_MAX_EXACT    20          /* rounds per side for the exact test */
+#define BOOTSTRAP_ITERS 2000
+
+#define Min(x, y)       ((x) < (y) ? (x) : (y))
+
+typedef struct
+{
+    char        table[32];          /* compress, decompress, ... */
+    char        type[32];
+    int         size;
+    const char *mode;               /* the --mode= that prints the cell */
+    int         clen[2];            /* [0] baseline, [1] variant */
+    int         last_round[2];      /* last round that filed a sample */
+    double      mib[2][MAX_ROUNDS];
+
+    /* Results */
+    double      median[2];
+    double      delta_pct;          /* variant vs baseline median */
+    double      ci_low_pct;
+    double      ci_high_pct;
+    double      p_value;
+    const char *verdict;
+} Cell;
+
+static Cell cells[MAX_CELLS];
+static int ncells;
+
+/* ----------
+ * Statistics
+ * ----------
+ */
+static int
+cmp_double(const void *a, const void *b)
+{
+    double va = *(const double *)a;
+    double vb = *(const double *)b;
+    return (va > vb) - (va < vb);
+}
+
+static double
+median(const double *v, int n)
+{
+    double s[MAX_ROUNDS];
+
+    memcpy(s, v, n * sizeof(double));
+    qsort(s, n, sizeof(double), cmp_double);
+    return (n % 2) ? s[n / 2] : (s[n / 2 - 1] + s[n / 2]) / 2.0;
+}
+
+/*
+ * Two-sided Mann-Whitney U p-value for samples a[0..m) and b[0..n).
+ *
+ * Without ties, and with at most MW_MAX_EXACT per side, this is exact:
+ * f[i][j][k] counts the orderings of i a's and j b's in which k (a, b)
+ * pairs have b above a.  The largest value is either a b, above all i
+ * a's, or an a, above nothing, so f[i][j][k] = f[i][j-1][k-i] +
+ * f[i-1][j][k].  Otherwise U is taken as normal, with the variance
+ * corrected for ties and a continuity correction.
+ */
+static double
+mann_whitney_p(const double *a, int m, const double *b, int n)
+{
+    double all[2 * MAX_ROUNDS];
+    double u = 0;
+    double tie_term = 0;
+    int N = m + n;
+
+    for (int i = 0; i < m; i++)
+        for (int j = 0; j < n; j++)
+            u += (b[j] > a[i]) ? 1.0 : (b[j] == a[i]) ? 0.5 : 0.0;
+
+    memcpy(all, a, m * sizeof(double));
+    memcpy(all + m, b, n * sizeof(double));
+    qsort(all, N, sizeof(double), cmp_double);
+    for (int i = 0; i < N;)
+    {
+        int t = 1;
+
+        while (i + t < N && all[i + t] == all[i])
+            t++;
+        tie_term += (double) t * t * t - t;
+        i += t;
+    }
+
+    if (tie_term == 0 && m <= MW_MAX_EXACT && n <= MW_MAX_EXACT)
+    {
+        static double f[MW_MAX_EXACT + 1][MW_MAX_EXACT + 1]
+                       [MW_MAX_EXACT * MW_MAX_EXACT + 1];
+        double total = 0, lo = 0, hi = 0;
+
+        memset(f, 0, sizeof(f));
+        for (int i = 0; i <= m; i++)
+            for (int j = 0; j <= n; j++)
+            {
+                if (i == 0 || j == 0)
+                {
+                    f[i][j][0] = 1;
+                    continue;
+                }
+                for (int k = 0; k <= i * j; k++)
+                    f[i][j][k] = f[i - 1][j][k] +
+                                 (k >= i ? f[i][j - 1][k - i] : 0);
+            }
+
+        for (int k = 0; k <= m * n; k++)
+        {
+            total += f[m][n][k];
+            if (k <= u)
+                lo += f[m][n][k];
+            if (k >= u)
+                hi += f[m][n][k];
+        }
+        return Min(1.0, 2.0 * Min(lo, hi) / total);
+    }
+
+    double mu = m * n / 2.0;
+    double var = m * n / 12.0 * ((N + 1) - tie_term / ((double) N * (N - 1)));
+
+    if (var <= 0)
+        return 1.0;
+
+    double z = (fabs(u - mu) - 0.5) / sqrt(var);
+
+    return z <= 0 ? 1.0 : Min(1.0, erfc(z / sqrt(2.0)));
+}
+
+/* Fixed-seed generator, so the same samples give the same interval */
+static uint64_t boot_state;
+
+static uint64_t
+boot_next(void)
+{
+    boot_state ^= boot_state << 13;
+    boot_state ^= boot_state >> 7;
+    boot_state ^= boot_state << 17;
+    return boot_state;
+}
+
+/*
+ * Percentile bootstrap 95% interval of the change of the median, in
+ * percent: resample both sides with replacement BOOTSTRAP_ITERS times.
+ */
+static void
+bootstrap_ci(const double *a, int m, const double *b, int n,
+             double *low, double *high)
+{
+    static double deltas[BOOTSTRAP_ITERS];
+    double ra[MAX_ROUNDS], rb[MAX_ROUNDS];
+
+    boot_state = 0x9E3779B97F4A7C15ULL;
+    for (int it = 0; it < BOOTSTRAP_ITERS; it++)
+    {
+        for (int i = 0; i < m; i++)
+            ra[i] = a[boot_next() % m];
+        for (int j = 0; j < n; j++)
+            rb[j] = b[boot_next() % n];
+        deltas[it] = (median(rb, n) / median(ra, m) - 1.0) * 100.0;
+    }
+    qsort(deltas, BOOTSTRAP_ITERS, sizeof(double), cmp_double);
+    *low = deltas[(int) (BOOTSTRAP_ITERS * 0.025)];
+    *high = deltas[(int) (BOOTSTRAP_ITERS * 0.975) - 1];
+}
+
+/* ----------
+ * Running the benchmarks
+ * ----------
+ */
+static Cell *
+find_cell(const char *mode, const char *table, const char *type, int size,
+          bool create)
+{
+    for (int i = 0; i < ncells; i++)
+        if (cells[i].size == size && strcmp(cells[i].table, table) == 0 &&
+            strcmp(cells[i].type, type) == 0)
+            return &cells[i];
+    if (!create || ncells >= MAX_CELLS)
+        return NULL;
+
+    Cell *c = &cells[ncells++];
+
+    snprintf(c->table, sizeof(c->table), "%s", table);
+    snprintf(c->type, sizeof(c->type), "%s", type);
+    c->size = size;
+    c->mode = mode;
+    c->last_round[0] = c->last_round[1] = -1;
+    return c;
+}
+
+/*
+ * Run one bench_pglz binary in one mode and file its cells under side
+ * for this round.  The first run of a mode (create) defines its cells;
+ * every later run, of either side, must print exactly those once each,
+ * or a missing cell would leave a 0 sample in the statistics.
+ */
+static bool
+run_side(const char *name, const char *mode, const char *bench_args,
+         int side, int round, bool create)
+{
+    char cmd[MAX_CMD];
+    char line[512];
+    int seen = 0;
+    int expected = 0;
+    FILE *p;
+
+    snprintf(cmd, sizeof(cmd), "./bench_%s %s --tsv --mode=%s%s", name,
+             name, mode, bench_args);
+    p = popen(cmd, "r");
+    if (p == NULL)
+    {
+        fprintf(stderr, "cannot run \"%s\"\n", cmd);
+        return false;
+    }
+    while (fgets(line, sizeof(line), p))
+    {
+        char table[32], type[32];
+        int size, clen, iters;
+        double mib, med, p99;
+        Cell *c;
+
+        if (sscanf(line, "%31[^\t]\t%31[^\t]\t%d\t%d\t%d\t%lf\t%lf\t%lf",
+                   table, type, &size, &clen, &iters, &mib, &med, &p99) != 8)
+            continue;
+        c = find_cell(mode, table, type, size, create);
+        if (c == NULL || strcmp(c->mode, mode) != 0)
+        {
+            fprintf(stderr, "%s: unexpected or too many cells (%s %s %d)\n",
+                    name, table, type, size);
+            pclose(p);
+            return false;
+        }
+        if (c->last_round[side] == round)
+        {
+            fprintf(stderr, "%s: cell printed twice (%s %s %d)\n",
+                    name, table, type, size);
+            pclose(p);
+            return false;
+        }
+        c->last_round[side] = round;
+        c->clen[side] = clen;
+        c->mib[side][round] = mib;
+        seen++;
+    }
+    if (pclose(p) != 0)
+    {
+        fprintf(stderr, "\"%s\" failed\n", cmd);
+        return false;
+    }
+    if (seen == 0)
+    {
+        fprintf(stderr, "\"%s\" printed no results\n", cmd);
+        return false;
+    }
+    for (int i = 0; i < ncells; i++)
+    {
+        if (strcmp(cells[i].mode, mode) != 0)
+            continue;
+        expected++;
+        if (cells[i].last_round[side] != round)
+            fprintf(stderr, "%s: round %d lacks cell %s %s %d\n", name,
+                    round + 1, cells[i].table, cells[i].type, cells[i].size);
+    }
+    if (seen != expected)
+    {
+        fprintf(stderr, "\"%s\" printed %d cells, the first run %d\n",
+                cmd, seen, expected);
+        return false;
+    }
+    return true;
+}
+
+/* ----------
+ * Output
+ * ----------
+ */
+static void
+json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', f);
+        if ((unsigned char) *s >= 0x20)
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static bool
+write_json(const char *path, const char *baseline, const char *variant,
+           int rounds, double threshold, double alpha, const char *bench_args,
+           int regressions)
+{
+    FILE *f = fopen(path, "w");
+    char stamp[32];
+    time_t now = time(NULL);
+
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(f, "{\n  \"timestamp\": \"%s\",\n  \"baseline\": ", stamp);
+    json_string(f, baseline);
+    fprintf(f, ",\n  \"variant\": ");
+    json_string(f, variant);
+    fprintf(f, ",\n  \"bench_args\": ");
+    json_string(f, bench_args);
+    fprintf(f, ",\n  \"rounds\": %d,\n  \"threshold_pct\": %g,\n"
+            "  \"alpha\": %g,\n  \"regressions\": %d,\n  \"cells\": [\n",
+            rounds, threshold, alpha, regressions);
+    for (int i = 0; i < ncells; i++)
+    {
+        Cell *c = &cells[i];
+
+        fprintf(f, "    {\"table\": \"%s\", \"type\": \"%s\", \"size\": %d,\n",
+                c->table, c->type, c->size);
+        for (int side = 0; side < 2; side++)
+        {
+            fprintf(f, "     \"%s\": {\"compressed_size\": %d, "
+                    "\"median_mib\": %.3f, \"mib\": [",
+                    side ? "variant" : "baseline", c->clen[side],
+                    c->median[side]);
+            for (int r = 0; r < rounds; r++)
+                fprintf(f, "%s%.3f", r ? ", " : "", c->mib[side][r]);
+            fprintf(f, "]},\n");
+        }
+        if (strcmp(c->verdict, "n/a") == 0)
+            fprintf(f, "     \"delta_pct\": null, \"ci95_pct\": null, "
+                    "\"p_value\": null, ");
+        else
+            fprintf(f, "     \"delta_pct\": %.3f, \"ci95_pct\": [%.3f, %.3f], "
+                    "\"p_value\": %.4g, ",
+                    c->delta_pct, c->ci_low_pct, c->ci_high_pct, c->p_value);
+        fprintf(f, "\"verdict\": \"%s\"}%s\n",
+                c->verdict, i + 1 < ncells ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+static const char *
+fmt_size(int size)
+{
+    static char buf[4][16];
+    static int next;
+    char *b = buf[next++ % 4];
+
+    if (size >= 1048576 && size % 1048576 == 0)
+        snprintf(b, 16, "%dM", size / 1048576);
+    else if (size >= 1024 && size % 1024 == 0)
+        snprintf(b, 16, "%dK", size / 1024);
+    else
+        snprintf(b, 16, "%dB", size);
+    return b;
+}
+
+/* ----------
+ * Main
+ * ----------
+ */
+static void
+usage(void)
+{
+    fprintf(stderr,
+            "usage: bench_compare [--rounds=N] [--threshold=PCT] [--alpha=P]\n"
+            "                     [--modes=compress,decompress] [--json=FILE]\n"
+            "                     BASELINE VARIANT [-- bench_pglz args]\n");
+    exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+    int rounds = 5;
+    double threshold = 3.0;
+    double alpha = 0.05;
+    const char *json = NULL;
+    char modes_buf[128] = "compress,decompress";
+    const char *modes[8];
+    int nmodes = 0;
+    const char *names[2] = { NULL, NULL };
+    char bench_args[MAX_CMD] = "";
+    int regressions = 0;
+    int unmeasured = 0;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+        {
+            i++;
+            break;
+        }
+        else if (strncmp(argv[i], "--rounds=", 9) == 0)
+            rounds = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--threshold=", 12) == 0)
+            threshold = atof(argv[i] + 12);
+        else if (strncmp(argv[i], "--alpha=", 8) == 0)
+            alpha = atof(argv[i] + 8);
+        else if (strncmp(argv[i], "--json=", 7) == 0)
+            json = argv[i] + 7;
+        else if (strncmp(argv[i], "--modes=", 8) == 0)
+            snprintf(modes_buf, sizeof(modes_buf), "%s", argv[i] + 8);
+        else if (argv[i][0] == '-')
+            usage();
+        else if (names[0] == NULL)
+            names[0] = argv[i];
+        else if (names[1] == NULL)
+            names[1] = argv[i];
+        else
+            usage();
+    }
+    for (; i < argc; i++)
+    {
+        size_t len = strlen(bench_args);
+
+        snprintf(bench_args + len, sizeof(bench_args) - len, " %s", argv[i]);
+    }
+    for (char *m = strtok(modes_buf, ","); m && nmodes < 8; m = strtok(NULL, ","))
+        modes[nmodes++] = m;
+
+    if (names[1] == NULL || nmodes == 0 || rounds < 2 ||
+        rounds > MAX_ROUNDS || threshold < 0 || alpha <= 0 || alpha >= 1)
+        usage();
+    if (rounds < 4)
+        fprintf(stderr, "warning: %d rounds are too few for p < %g\n",
+                rounds, alpha);
+
+    /*
+     * Alternate the order within each round (ABBA ...), so that drift over
+     * the run, e.g. thermal, does not favour either side.
+     */
+    for (int r = 0; r < rounds; r++)
+    {
+        fprintf(stderr, "round %d/%d\n", r + 1, rounds);
+        for (int m = 0; m < nmodes; m++)
+            for (int k = 0; k < 2; k++)
+            {
+                int side = (r % 2) ? 1 - k : k;
+
+                if (!run_side(names[side], modes[m], bench_args, side, r,
+                              r == 0 && k == 0))
+                    return 2;
+            }
+    }
+
+    printf("\n=== %s vs %s: %d rounds, threshold %.1f%%, alpha %g ===\n\n",
+           names[1], names[0], rounds, threshold, alpha);
+    printf("%-18s %-10s %6s %10s %10s %8s %19s %8s  %s\n",
+           "Table", "Type", "Size", "Base MiB/s", "Var MiB/s", "Change",
+           "95% CI", "p", "Verdict");
+    printf("%-18s %-10s %6s %10s %10s %8s %19s %8s  %s\n",
+           "-----", "----", "----", "----------", "---------", "------",
+           "------", "-", "-------");
+
+    for (int c = 0; c < ncells; c++)
+    {
+        Cell *cell = &cells[c];
+        char ci[32];
+
+        cell->median[0] = median(cell->mib[0], rounds);
+        cell->median[1] = median(cell->mib[1], rounds);
+        if (cell->clen[0] < 0 || cell->clen[1] < 0 || cell->median[0] <= 0)
+        {
+            cell->verdict = "n/a";
+            unmeasured++;
+            printf("%-18s %-10s %6s %10.1f %10.1f %8s %19s %8s  %s\n",
+                   cell->table, cell->type, fmt_size(cell->size),
+                   cell->median[0], cell->median[1], "n/a", "n/a", "n/a",
+                   cell->verdict);
+            continue;
+        }
+        cell->delta_pct = (cell->median[1] / cell->median[0] - 1.0) * 100.0;
+        bootstrap_ci(cell->mib[0], rounds, cell->mib[1], rounds,
+                     &cell->ci_low_pct, &cell->ci_high_pct);
+        cell->p_value = mann_whitney_p(cell->mib[0], rounds, cell->mib[1],
+                                       rounds);
+
+        if (cell->p_value < alpha && cell->delta_pct < -threshold)
+        {
+            cell->verdict = "regression";
+            regressions++;
+        }
+        else if (cell->p_value < alpha && cell->delta_pct > threshold)
+            cell->verdict = "faster";
+        else
+            cell->verdict = "same";
+
+        snprintf(ci, sizeof(ci), "[%+.1f%%, %+.1f%%]", cell->ci_low_pct,
+                 cell->ci_high_pct);
+        printf("%-18s %-10s %6s %10.1f %10.1f %+7.1f%% %19s %8.4f  %s\n",
+               cell->table, cell->type, fmt_size(cell->size),
+               cell->median[0], cell->median[1], cell->delta_pct, ci,
+               cell->p_value,
+               strcmp(cell->verdict, "regression") == 0 ? "REGRESSION" :
+               cell->verdict);
+    }
+
+    printf("\n%d of %d cells regressed by more than %.1f%% (%d more n/a)\n",
+           regressions, ncells - unmeasured, threshold, unmeasured);
+
+    if (json && !write_json(json, names[0], names[1], rounds, threshold,
+                            alpha, bench_args, regressions))
+        return 2;
+
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,1111 @@
+/*
+ * bench_micro.c — Cycles per byte of pglz's hot functions, called one at
+ * a time.
+ *
+ * bench_pglz times whole pglz_compress() and pglz_decompress() calls, so
+ * a step that speeds up one function and slows down another shows only
+ * the sum.  This harness #includes a variant's source (the functions are
+ * static) and drives each hot function directly:
+ *
+ *   pglz_hist_idx     the bucket hash of every input position
+ *   pglz_hist_add     every position inserted in order, recycling the
+ *                     oldest entry once the history is full, as the
+ *                     compressor does
+ *   pglz_hist_unlink  steps 3-19, which unlink a recycled entry by
+ *                     scanning its chain for the predecessor: batches of
+ *                     the 64 oldest entries unlinked from a copy of the
+ *                     full history, taken every 256 positions and put
+ *                     back afterwards
+ *   pglz_find_match   the searches of a greedy parse, with the history
+ *                     added in between: that replay minus the
+ *                     pglz_hist_add pass over the same positions
+ *   pglz_decompress   the tag loop over the input compressed with
+ *                     PGLZ_strategy_always; calls are control items
+ *                     (literals and tags)
+ *
+ * The trace is recorded once per input from a greedy parse with the
+ * variant's own pglz_find_match: where it searched and how far each
+ * match took it.  Every position is added to the history, as in the
+ * stock loop, whatever the variant's compressor skips, so that each step
+ * replays the same work.  Cycles are TSC ticks (rdtsc; nanoseconds on
+ * other architectures), the median of the passes.  Last-level cache
+ * misses, branch misses and L1d read misses come from perf_event_open,
+ * per KiB of input, and show as "n/a" when the counter cannot be opened.
+ *
+ * The static function signatures changed along the steps, so the build
+ * says which step it includes, and -DPGLZ_MICRO_UNLINK if the variant
+ * has pglz_hist_unlink (make micro-<variant> does this):
+ *   gcc -O2 -DFRONTEND -I./include -DPGLZ_MICRO_STEP=31 \
+ *       -DPGLZ_MICRO_SRC='"variants/pg_lzcompress_step31_pardecode.c"' \
+ *       -o micro_step31_pardecode bench_micro.c -lm -pthread
+ *
+ * Run:
+ *   taskset -c 0 ./micro_<variant> [variant-name] [--size=N] [--min-ms=N]
+ *                                  [--file=PATH ...] [--generations]
+ *                                  [--ways=2|4|8]
+ *
+ * --size sets the input size (default 65536).  --file adds the first
+ * --size bytes of a real file to the generated inputs (up to 8 files).
+ * --generations uses a generation-tagged context (step 8 on), --ways the
+ * bucket match finder (step 27 on); variants without them ignore them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifndef PGLZ_MICRO_STEP
+#define PGLZ_MICRO_STEP 0
+#endif
+#ifndef PGLZ_MICRO_SRC
+#define PGLZ_MICRO_SRC "pg_lzcompress_baseline.c"
+#endif
+
+#include PGLZ_MICRO_SRC
+
+/*
+ * Steps 3-19 unlink recycled entries with a predecessor scan; step 19b
+ * shares step 19's signatures but not the unlink, so the build says.
+ */
+#ifdef PGLZ_MICRO_UNLINK
+#define MICRO_HAVE_UNLINK 1
+#endif
+
+/* ----------
+ * Configuration
+ * ----------
+ */
+#define MIN_PASSES      5
+#define MAX_PASSES      10000
+#define MIN_BENCH_NS    200000000LL /* Run each function for at least 200ms */
+#define MAX_FILES       8
+
+/* Unlink batches: this many of the oldest entries every UNLINK_EVERY */
+#define UNLINK_BATCH    64
+#define UNLINK_EVERY    256
+
+static int64_t min_bench_ns = MIN_BENCH_NS;
+
+static inline int64_t
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CYCLE_UNIT "cyc"
+static inline uint64_t
+read_cycles(void)
+{
+    return __rdtsc();
+}
+#else
+#define CYCLE_UNIT "ns"
+static inline uint64_t
+read_cycles(void)
+{
+    return (uint64_t)now_ns();
+}
+#endif
+
+/* ----------
+ * Hardware event counters (perf_event_open), counting this thread only,
+ * user space only.  All helpers are no-ops returning -1 when the counter
+ * could not be opened.
+ * ----------
+ */
+#ifdef __linux__
+#define PERF_L1D_READ_MISS \
+    (PERF_COUNT_HW_CACHE_L1D | \
+     (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+#endif
+
+static int
+perf_counter_open(uint32_t type, uint64_t config)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void
+perf_counter_start(int fd)
+{
+#ifdef __linux__
+    if (fd < 0)
+        return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+static int64_t
+perf_counter_stop(int fd)
+{
+#ifdef __linux__
+    uint64_t count;
+
+    if (fd < 0)
+        return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+        return -1;
+    return (int64_t)count;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * The events counted around every timed section.  A pass may time
+ * several sections (the unlink batches); cycles and events add up over
+ * them.
+ */
+enum { EV_LLC, EV_BRANCH, EV_L1D, NUM_EVENTS };
+
+static const char *event_names[NUM_EVENTS] = {
+    "LLCMiss/KiB", "BrMiss/KiB", "L1dMiss/KiB"
+};
+
+static int event_fd[NUM_EVENTS];
+
+typedef struct
+{
+    uint64_t    cycles;
+    int64_t     events[NUM_EVENTS];     /* -1 = counter not available */
+    uint64_t    started;
+} PassCount;
+
+static void
+counters_open(void)
+{
+    event_fd[EV_LLC] = perf_counter_open(PERF_TYPE_HARDWARE,
+                                         PERF_COUNT_HW_CACHE_MISSES);
+    event_fd[EV_BRANCH] = perf_counter_open(PERF_TYPE_HARDWARE,
+                                            PERF_COUNT_HW_BRANCH_MISSES);
+    event_fd[EV_L1D] = perf_counter_open(PERF_TYPE_HW_CACHE,
+                                         PERF_L1D_READ_MISS);
+}
+
+static void
+pass_init(PassCount *pc)
+{
+    memset(pc, 0, sizeof(*pc));
+}
+
+static inline void
+pass_start(PassCount *pc)
+{
+    for (int e = 0; e < NUM_EVENTS; e++)
+        perf_counter_start(event_fd[e]);
+    pc->started = read_cycles();
+}
+
+static inline void
+pass_stop(PassCount *pc)
+{
+    uint64_t    stopped = read_cycles();
+
+    pc->cycles += stopped - pc->started;
+    for (int e = NUM_EVENTS - 1; e >= 0; e--)
+    {
+        int64_t     n = perf_counter_stop(event_fd[e]);
+
+        if (n < 0 || pc->events[e] < 0)
+            pc->events[e] = -1;
+        else
+            pc->events[e] += n;
+    }
+}
+
+/* ----------
+ * Data generators, as in bench_pglz.c
+ * ----------
+ */
+static uint64_t rng_state = 0x123456789ABCDEF0ULL;
+
+static uint64_t
+xorshift64(void)
+{
+    uint64_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    rng_state = x;
+    return x;
+}
+
+static void
+rng_seed(uint64_t seed)
+{
+    rng_state = seed ? seed : 1;
+}
+
+static void
+gen_random(char *buf, int len)
+{
+    rng_seed(42);
+    for (int i = 0; i < len; i++)
+        buf[i] = (char)(xorshift64() & 0xFF);
+}
+
+static const char *words[] = {
+    "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ", "dog ",
+    "and ", "then ", "runs ", "away ", "from ", "here ", "to ", "there ",
+    "with ", "some ", "data ", "that ", "is ", "quite ", "compressible ",
+    "in ", "nature ", "because ", "it ", "contains ", "many ", "repeated ",
+    "words ", "and ", "phrases ", "which ", "help ", "the ", "compression ",
+    "algorithm ", "find ", "matches ", "in ", "its ", "history ", "table ",
+    "PostgreSQL ", "is ", "an ", "advanced ", "open ", "source ", "relational ",
+    "database ", "management ", "system ", "that ", "supports ", "both ",
+    "SQL ", "and ", "JSON ", "querying ", "for ", "all ", "workloads ",
+    NULL
+};
+
+static void
+gen_english(char *buf, int len)
+{
+    int pos = 0;
+    int widx = 0;
+    rng_seed(42);
+
+    while (pos < len)
+    {
+        const char *w = words[widx];
+        if (w == NULL) {
+            widx = 0;
+            w = words[0];
+        }
+        int wlen = strlen(w);
+        int tocopy = (pos + wlen > len) ? (len - pos) : wlen;
+        memcpy(buf + pos, w, tocopy);
+        pos += tocopy;
+        widx++;
+        if ((xorshift64() & 0x7) == 0)
+            widx = xorshift64() % 60;
+    }
+}
+
+static void
+gen_redundant(char *buf, int len)
+{
+    const char pattern[] = "ABCDEFGHIJKLMNOP";
+    for (int i = 0; i < len; i++)
+        buf[i] = pattern[i % 16];
+}
+
+static void
+gen_pgbench(char *buf, int len)
+{
+    rng_seed(42);
+    int pos = 0;
+    int aid = 1;
+
+    while (pos < len)
+    {
+        char row[128];
+        int bid = (aid - 1) / 100000 + 1;
+        int abalance = (int)(xorshift64() % 200001) - 100000;
+        int rlen = snprintf(row, sizeof(row), "%d|%d|%d|", aid, bid, abalance);
+
+        memset(row + rlen, ' ', 84);
+        rlen += 84;
+        row[rlen++] = '\n';
+
+        int tocopy = (pos + rlen > len) ? (len - pos) : rlen;
+        memcpy(buf + pos, row, tocopy);
+        pos += tocopy;
+        aid++;
+    }
+}
+
+typedef struct
+{
+    const char *name;
+    void (*generate)(char *buf, int len);
+} InputType;
+
+static const InputType input_types[] = {
+    { "random",     gen_random },
+    { "english",    gen_english },
+    { "redundant",  gen_redundant },
+    { "pgbench",    gen_pgbench },
+};
+#define NUM_TYPES (sizeof(input_types) / sizeof(input_types[0]))
+
+/* ----------
+ * Calling the variant's functions
+ *
+ * One adapter per function covers the signatures of every step; the
+ * state the compressor keeps in locals (hist_next, recycle, mask) lives
+ * in a MicroState instead.
+ * ----------
+ */
+typedef struct
+{
+    const char *source;
+    const char *end;
+    int32       slen;
+    int         mask;
+    int         hist_next;
+    bool        recycle;
+    int         good_match;
+    int         good_drop;
+    bool        use_generations;
+    int         ways;
+#if PGLZ_MICRO_STEP >= 7
+    PGLZ_Context *ctx;
+#endif
+#if PGLZ_MICRO_STEP >= 18
+    PGLZ_HashKind hash;
+#endif
+#if PGLZ_MICRO_STEP >= 23
+    const uint8 *good_decay;
+    int         good_decay_len;
+#endif
+} MicroState;
+
+static void
+micro_init(MicroState *st, bool generations, int ways)
+{
+    const PGLZ_Strategy *strategy = PGLZ_strategy_default;
+
+    memset(st, 0, sizeof(*st));
+
+    /* Limit the match parameters to the supported range, as pglz does */
+    st->good_match = strategy->match_size_good;
+    if (st->good_match > PGLZ_MAX_MATCH)
+        st->good_match = PGLZ_MAX_MATCH;
+    else if (st->good_match < 17)
+        st->good_match = 17;
+    st->good_drop = strategy->match_size_drop;
+    if (st->good_drop < 0)
+        st->good_drop = 0;
+    else if (st->good_drop > 100)
+        st->good_drop = 100;
+
+#if PGLZ_MICRO_STEP >= 8
+    st->ctx = generations ?
+        pglz_context_create_extended(PGLZ_CTX_GENERATIONS) :
+        pglz_context_create();
+    st->use_generations = st->ctx->use_generations;
+#elif PGLZ_MICRO_STEP >= 7
+    st->ctx = pglz_context_create();
+#endif
+#if PGLZ_MICRO_STEP >= 18
+    st->hash = st->ctx->hash;
+#endif
+#if PGLZ_MICRO_STEP >= 23
+    st->good_decay = pglz_params_default.good_decay;
+    st->good_decay_len = pglz_params_default.good_decay_len;
+#endif
+#if PGLZ_MICRO_STEP >= 27
+    st->ways = ways;
+#endif
+}
+
+static void
+micro_free(MicroState *st)
+{
+#if PGLZ_MICRO_STEP >= 7
+    pglz_context_free(st->ctx);
+#endif
+}
+
+/* Empty history for source, as at the start of a pglz_compress call */
+static void
+micro_begin(MicroState *st, const char *source, int32 slen)
+{
+    int hashsz;
+
+    st->source = source;
+    st->end = source + slen;
+    st->slen = slen;
+    st->recycle = false;
+#if PGLZ_MICRO_STEP >= 22
+    hashsz = pglz_hash_size(slen);
+#else
+    if (slen < 128)
+        hashsz = 512;
+    else if (slen < 256)
+        hashsz = 1024;
+    else if (slen < 512)
+        hashsz = 2048;
+    else if (slen < 1024)
+        hashsz = 4096;
+    else
+        hashsz = 8192;
+#endif
+    st->mask = hashsz - 1;
+
+#if PGLZ_MICRO_STEP <= 1
+    memset(hist_start, 0, hashsz * sizeof(int16));
+    st->hist_next = 1;
+#elif PGLZ_MICRO_STEP <= 6
+    for (int i = 0; i < hashsz; i++)
+        hist_start[i] = PGLZ_INVALID_ENTRY;
+    st->hist_next = 0;
+#elif PGLZ_MICRO_STEP == 7
+    for (int i = 0; i < hashsz; i++)
+        st->ctx->hist_start[i] = PGLZ_INVALID_ENTRY;
+    st->hist_next = 0;
+#else
+    st->hist_next = 0;
+#if PGLZ_MICRO_STEP >= 27
+    if (st->ways)
+    {
+        int nbuckets = Min(hashsz, PGLZ_BUCKET_SLOTS) / st->ways;
+
+        st->mask = nbuckets - 1;
+        pglz_bucket_begin_call(st->ctx, nbuckets, st->ways);
+        return;
+    }
+#endif
+    pglz_begin_call(st->ctx, hashsz);
+#endif
+}
+
+static inline int
+micro_hist_idx(MicroState *st, const char *s)
+{
+#if PGLZ_MICRO_STEP >= 18
+    return pglz_hist_idx(s, st->end, st->mask, st->hash);
+#else
+    return pglz_hist_idx(s, st->end, st->mask);
+#endif
+}
+
+static inline void
+micro_hist_add(MicroState *st, const char *s)
+{
+#if PGLZ_MICRO_STEP == 0
+    /* The stock macro updates hist_next and recycle in place */
+    pglz_hist_add(hist_start, hist_entries, st->hist_next, st->recycle,
+                  s, st->end, st->mask);
+#elif PGLZ_MICRO_STEP <= 6
+    pglz_hist_add(hist_start, hist_entries, &st->hist_next, &st->recycle,
+                  s, st->end, st->mask);
+#elif PGLZ_MICRO_STEP == 7
+    pglz_hist_add(st->ctx, &st->hist_next, &st->recycle,
+                  s, st->end, st->mask);
+#elif PGLZ_MICRO_STEP == 8
+    pglz_hist_add(st->ctx, &st->hist_next, &st->recycle,
+                  s, st->end, st->mask, st->use_generations);
+#elif PGLZ_MICRO_STEP <= 17
+    pglz_hist_add(st->ctx, &st->hist_next, &st->recycle,
+                  s, st->end, st->mask, st->source, st->use_generations);
+#elif PGLZ_MICRO_STEP <= 24
+    pglz_hist_add(st->ctx, &st->hist_next, &st->recycle,
+                  s, st->end, st->mask, st->source, st->use_generations,
+                  st->hash);
+#elif PGLZ_MICRO_STEP <= 26
+    pglz_hist_add(st->ctx, &st->hist_next, &st->recycle,
+                  s, st->end, st->mask, st->source, st->use_generations,
+                  st->hash, false);
+#else
+    pglz_hist_add(st->ctx, &st->hist_next, &st->recycle,
+                  s, st->end, st->mask, st->source, st->use_generations,
+                  st->hash, false, st->ways);
+#endif
+}
+
+static inline int
+micro_find_match(MicroState *st, const char *s, int *lenp, int *offp)
+{
+#if PGLZ_MICRO_STEP <= 3
+    return pglz_find_match(hist_start, s, st->end, lenp, offp,
+                           st->good_match, st->good_drop, st->mask);
+#elif PGLZ_MICRO_STEP <= 6
+    return pglz_find_match(hist_start, s, st->end, lenp, offp,
+                           st->good_match, st->good_drop, st->mask,
+                           st->source);
+#elif PGLZ_MICRO_STEP == 7
+    return pglz_find_match(st->ctx, s, st->end, lenp, offp,
+                           st->good_match, st->good_drop, st->mask,
+                           st->source);
+#elif PGLZ_MICRO_STEP <= 17
+    return pglz_find_match(st->ctx, s, st->end, lenp, offp,
+                           st->good_match, st->good_drop, st->mask,
+                           st->source, st->use_generations);
+#elif PGLZ_MICRO_STEP <= 22
+    return pglz_find_match(st->ctx, s, st->end, lenp, offp,
+                           st->good_match, st->good_drop, st->mask,
+                           st->source, st->use_generations, st->hash);
+#elif PGLZ_MICRO_STEP <= 24
+    return pglz_find_match(st->ctx, s, st->end, lenp, offp,
+                           st->good_match, st->good_drop,
+                           st->good_decay, st->good_decay_len, st->mask,
+                           st->source, st->use_generations, st->hash);
+#elif PGLZ_MICRO_STEP <= 26
+    return pglz_find_match(st->ctx, s, st->end, lenp, offp,
+                           st->good_match, st->good_drop,
+                           st->good_decay, st->good_decay_len, st->mask,
+                           st->source, st->use_generations, st->hash, false);
+#else
+    return pglz_find_match(st->ctx, s, st->end, lenp, offp,
+                           st->good_match, st->good_drop,
+                           st->good_decay, st->good_decay_len, st->mask,
+                           st->source, st->use_generations, st->hash, false,
+                           st->ways);
+#endif
+}
+
+#ifdef MICRO_HAVE_UNLINK
+static inline void
+micro_hist_unlink(MicroState *st, int16 entry_idx)
+{
+#if PGLZ_MICRO_STEP <= 6
+    pglz_hist_unlink(hist_start, hist_entries, entry_idx);
+#elif PGLZ_MICRO_STEP == 7
+    pglz_hist_unlink(st->ctx, entry_idx);
+#else
+    pglz_hist_unlink(st->ctx, entry_idx, st->use_generations);
+#endif
+}
+
+/* A copy of the history, so that unlinked entries can be put back */
+#if PGLZ_MICRO_STEP <= 6
+typedef struct
+{
+    int16           start[PGLZ_MAX_HISTORY_LISTS];
+    PGLZ_HistEntry  entries[PGLZ_HISTORY_SIZE + 1];
+} MicroSnapshot;
+
+static void
+micro_save(MicroState *st, MicroSnapshot *snap)
+{
+    memcpy(snap->start, hist_start, sizeof(snap->start));
+    memcpy(snap->entries, hist_entries, sizeof(snap->entries));
+}
+
+static void
+micro_restore(MicroState *st, const MicroSnapshot *snap)
+{
+    memcpy(hist_start, snap->start, sizeof(snap->start));
+    memcpy(hist_entries, snap->entries, sizeof(snap->entries));
+}
+#else
+typedef PGLZ_Context MicroSnapshot;
+
+static void
+micro_save(MicroState *st, MicroSnapshot *snap)
+{
+    memcpy(snap, st->ctx, sizeof(*snap));
+}
+
+static void
+micro_restore(MicroState *st, const MicroSnapshot *snap)
+{
+    memcpy(st->ctx, snap, sizeof(*snap));
+}
+#endif
+#endif                          /* MICRO_HAVE_UNLINK */
+
+/* ----------
+ * Trace: the greedy parse of one input
+ * ----------
+ */
+typedef struct
+{
+    int32       pos;            /* where pglz_find_match searched */
+    int32       len;            /* match length, 0 = literal */
+} MicroProbe;
+
+typedef struct
+{
+    const char *name;
+    char       *data;
+    int32       len;
+    MicroProbe *probes;
+    int32       nprobes;
+    int32       nadds;          /* positions added to the history */
+    char       *compressed;     /* PGLZ_strategy_always, NULL if it failed */
+    int32       clen;
+    int32       nitems;         /* control items in compressed */
+    char       *decoded;
+} MicroInput;
+
+static void
+record_trace(MicroState *st, MicroInput *in)
+{
+    int32 pos = 0;
+
+    in->probes = malloc(sizeof(MicroProbe) * (in->len + 1));
+    in->nprobes = 0;
+    in->nadds = 0;
+    micro_begin(st, in->data, in->len);
+
+    /* The compressor's main loop stops with 3 bytes left, so do we */
+    while (pos < in->len - 3)
+    {
+        int match_len = 0;
+        int match_off = 0;
+        int step;
+
+        if (!micro_find_match(st, in->data + pos, &match_len, &match_off))
+            match_len = 0;
+        in->probes[in->nprobes].pos = pos;
+        in->probes[in->nprobes].len = match_len;
+        in->nprobes++;
+        step = match_len > 0 ? match_len : 1;
+        for (int i = 0; i < step; i++)
+            micro_hist_add(st, in->data + pos + i);
+        in->nadds += step;
+        pos += step;
+    }
+}
+
+static int32
+count_items(const char *compressed, int32 clen)
+{
+    const unsigned char *sp = (const unsigned char *) compressed;
+    const unsigned char *srcend = sp + clen;
+    int32 nitems = 0;
+
+    while (sp < srcend)
+    {
+        unsigned char ctrl = *sp++;
+
+        for (int bit = 0; bit < 8 && sp < srcend; bit++, ctrl >>= 1)
+        {
+            if (ctrl & 1)
+                sp += ((sp[0] & 0x0f) == 0x0f) ? 3 : 2;
+            else
+                sp++;
+            nitems++;
+        }
+    }
+    return nitems;
+}
+
+static void
+prepare_input(MicroState *st, MicroInput *in)
+{
+    record_trace(st, in);
+
+    in->compressed = malloc(PGLZ_MAX_OUTPUT(in->len));
+    in->decoded = malloc(in->len);
+    in->clen = pglz_compress(in->data, in->len, in->compressed,
+                             PGLZ_strategy_always);
+    if (in->clen < 0)
+    {
+        free(in->compressed);
+        in->compressed = NULL;
+        return;
+    }
+    in->nitems = count_items(in->compressed, in->clen);
+}
+
+/* ----------
+ * One pass over an input per function.  Setup is not timed; each pass
+ * brackets its timed sections with pass_start/pass_stop.
+ * ----------
+ */
+static volatile int sink;
+
+static void
+pass_hist_idx(MicroState *st, const MicroInput *in, PassCount *pc)
+{
+    int acc = 0;
+
+    micro_begin(st, in->data, in->len);
+    pass_start(pc);
+    for (int32 pos = 0; pos < in->len - 3; pos++)
+        acc += micro_hist_idx(st, in->data + pos);
+    pass_stop(pc);
+    sink = acc;
+}
+
+static void
+pass_hist_add(MicroState *st, const MicroInput *in, PassCount *pc)
+{
+    micro_begin(st, in->data, in->len);
+    pass_start(pc);
+    for (int32 i = 0; i < in->nprobes; i++)
+    {
+        const char *s = in->data + in->probes[i].pos;
+        int32 step = in->probes[i].len > 0 ? in->probes[i].len : 1;
+
+        while (step-- > 0)
+            micro_hist_add(st, s++);
+    }
+    pass_stop(pc);
+}
+
+static void
+pass_replay(MicroState *st, const MicroInput *in, PassCount *pc)
+{
+    int acc = 0;
+
+    micro_begin(st, in->data, in->len);
+    pass_start(pc);
+    for (int32 i = 0; i < in->nprobes; i++)
+    {
+        const char *s = in->data + in->probes[i].pos;
+        int32 step = in->probes[i].len > 0 ? in->probes[i].len : 1;
+        int match_len = 0;
+        int match_off = 0;
+
+        acc += micro_find_match(st, s, &match_len, &match_off);
+        while (step-- > 0)
+            micro_hist_add(st, s++);
+    }
+    pass_stop(pc);
+    sink = acc;
+}
+
+#ifdef MICRO_HAVE_UNLINK
+static MicroSnapshot unlink_snapshot;
+
+/*
+ * Unlink the UNLINK_BATCH oldest entries, the next ones pglz_hist_add
+ * would recycle, from a history that is full.  Since nothing is added in
+ * between, each chain is shorter by the entries the compressor would
+ * have added meanwhile, at most UNLINK_BATCH of the 4097.
+ */
+static void
+pass_hist_unlink(MicroState *st, const MicroInput *in, PassCount *pc)
+{
+    int32 added = 0;
+
+    micro_begin(st, in->data, in->len);
+    for (int32 i = 0; i < in->nprobes; i++)
+    {
+        const char *s = in->data + in->probes[i].pos;
+        int32 step = in->probes[i].len > 0 ? in->probes[i].len : 1;
+
+        while (step-- > 0)
+        {
+            micro_hist_add(st, s++);
+            if (++added % UNLINK_EVERY != 0 || !st->recycle)
+                continue;
+
+            micro_save(st, &unlink_snapshot);
+            pass_start(pc);
+            for (int j = 0; j < UNLINK_BATCH; j++)
+                micro_hist_unlink(st, (int16) ((st->hist_next + j) %
+                                               (PGLZ_HISTORY_SIZE + 1)));
+            pass_stop(pc);
+            micro_restore(st, &unlink_snapshot);
+        }
+    }
+}
+
+static int32
+count_unlinks(const MicroInput *in)
+{
+    int32 batches = 0;
+
+    for (int32 added = UNLINK_EVERY; added <= in->nadds;
+         added += UNLINK_EVERY)
+    {
+        if (added >= PGLZ_HISTORY_SIZE + 1)
+            batches++;
+    }
+    return batches * UNLINK_BATCH;
+}
+#endif
+
+static void
+pass_decompress(MicroState *st, const MicroInput *in, PassCount *pc)
+{
+    int32 rawsize;
+
+    pass_start(pc);
+    rawsize = pglz_decompress(in->compressed, in->clen, in->decoded,
+                              in->len, true);
+    pass_stop(pc);
+    if (rawsize != in->len)
+    {
+        fprintf(stderr, "%s: decompressed %d bytes, expected %d\n",
+                in->name, rawsize, in->len);
+        exit(1);
+    }
+}
+
+/* ----------
+ * Measurement: passes until min_bench_ns, median cycles, mean events
+ * ----------
+ */
+typedef void (*PassFn) (MicroState *st, const MicroInput *in, PassCount *pc);
+
+typedef struct
+{
+    double      cycles;                 /* median per pass */
+    double      events[NUM_EVENTS];     /* mean per pass, -1 = n/a */
+} Measurement;
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+    uint64_t va = *(const uint64_t *)a;
+    uint64_t vb = *(const uint64_t *)b;
+    if (va < vb) return -1;
+    if (va > vb) return 1;
+    return 0;
+}
+
+static void
+measure(PassFn fn, MicroState *st, const MicroInput *in, Measurement *m)
+{
+    static uint64_t cycles[MAX_PASSES];
+    int64_t     totals[NUM_EVENTS] = {0};
+    int         npasses = 0;
+    int64_t     t_end;
+    PassCount   pc;
+
+    /* Warm up caches and the branch predictors */
+    pass_init(&pc);
+    fn(st, in, &pc);
+
+    t_end = now_ns() + min_bench_ns;
+    while (npasses < MAX_PASSES &&
+           (npasses < MIN_PASSES || now_ns() < t_end))
+    {
+        pass_init(&pc);
+        fn(st, in, &pc);
+        cycles[npasses++] = pc.cycles;
+        for (int e = 0; e < NUM_EVENTS; e++)
+        {
+            if (pc.events[e] < 0 || totals[e] < 0)
+                totals[e] = -1;
+            else
+                totals[e] += pc.events[e];
+        }
+    }
+
+    qsort(cycles, npasses, sizeof(uint64_t), cmp_u64);
+    m->cycles = (double)cycles[npasses / 2];
+    for (int e = 0; e < NUM_EVENTS; e++)
+        m->events[e] = totals[e] < 0 ? -1 : (double)totals[e] / npasses;
+}
+
+static void
+print_row(const char *input, const char *func, const Measurement *m,
+          int32 nbytes, int32 ncalls)
+{
+    printf("%-12.12s  %-17s  %8.2f  %9.1f  %8d", input, func,
+           m->cycles / nbytes, ncalls > 0 ? m->cycles / ncalls : 0.0,
+           ncalls);
+    for (int e = 0; e < NUM_EVENTS; e++)
+    {
+        if (m->events[e] < 0)
+            printf("  %11s", "n/a");
+        else
+            printf("  %11.2f", m->events[e] * 1024.0 / nbytes);
+    }
+    printf("\n");
+}
+
+static void
+print_na(const char *input, const char *func, const char *why)
+{
+    printf("%-12.12s  %-17s  %s\n", input, func, why);
+}
+
+static void
+run_input(MicroState *st, MicroInput *in)
+{
+    Measurement m;
+    Measurement add;
+
+    measure(pass_hist_idx, st, in, &m);
+    print_row(in->name, "pglz_hist_idx", &m, in->len, in->len - 3);
+
+    measure(pass_hist_add, st, in, &add);
+    print_row(in->name, "pglz_hist_add", &add, in->len, in->nadds);
+
+#ifdef MICRO_HAVE_UNLINK
+    if (count_unlinks(in) > 0)
+    {
+        measure(pass_hist_unlink, st, in, &m);
+        print_row(in->name, "pglz_hist_unlink", &m, in->len,
+                  count_unlinks(in));
+    }
+    else
+        print_na(in->name, "pglz_hist_unlink", "(history never full)");
+#endif
+
+    /* The replay minus the additions it shares with pass_hist_add */
+    measure(pass_replay, st, in, &m);
+    m.cycles -= add.cycles;
+    if (m.cycles < 0)
+        m.cycles = 0;
+    for (int e = 0; e < NUM_EVENTS; e++)
+    {
+        if (m.events[e] >= 0 && add.events[e] >= 0)
+            m.events[e] = m.events[e] > add.events[e] ?
+                m.events[e] - add.events[e] : 0;
+        else
+            m.events[e] = -1;
+    }
+    print_row(in->name, "pglz_find_match", &m, in->len, in->nprobes);
+
+    if (in->compressed != NULL)
+    {
+        measure(pass_decompress, st, in, &m);
+        print_row(in->name, "pglz_decompress", &m, in->len, in->nitems);
+    }
+    else
+        print_na(in->name, "pglz_decompress", "(incompressible)");
+}
+
+static bool
+load_file(MicroInput *in, const char *path, int32 size)
+{
+    FILE       *f = fopen(path, "rb");
+    const char *base = strrchr(path, '/');
+
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    in->data = malloc(size);
+    in->len = (int32) fread(in->data, 1, size, f);
+    fclose(f);
+    if (in->len < 4)
+    {
+        fprintf(stderr, "%s: fewer than 4 bytes\n", path);
+        free(in->data);
+        return false;
+    }
+    in->name = base ? base + 1 : path;
+    return true;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *variant = "unknown";
+    const char *files[MAX_FILES];
+    int         nfiles = 0;
+    int32       size = 65536;
+    bool        generations = false;
+    int         ways = 0;
+    MicroState  st;
+    MicroInput  inputs[NUM_TYPES + MAX_FILES];
+    int         ninputs = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--size=", 7) == 0)
+            size = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--min-ms=", 9) == 0)
+            min_bench_ns = atoll(argv[i] + 9) * 1000000LL;
+        else if (strncmp(argv[i], "--file=", 7) == 0)
+        {
+            if (nfiles == MAX_FILES)
+            {
+                fprintf(stderr, "at most %d --file options\n", MAX_FILES);
+                return 1;
+            }
+            files[nfiles++] = argv[i] + 7;
+        }
+        else if (strcmp(argv[i], "--generations") == 0)
+            generations = true;
+        else if (strncmp(argv[i], "--ways=", 7) == 0)
+            ways = atoi(argv[i] + 7);
+        else if (argv[i][0] != '-')
+            variant = argv[i];
+        else
+        {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (size < 4)
+    {
+        fprintf(stderr, "--size must be at least 4\n");
+        return 1;
+    }
+    if (ways != 0 && ways != 2 && ways != 4 && ways != 8)
+    {
+        fprintf(stderr, "--ways must be 2, 4 or 8\n");
+        return 1;
+    }
+#if PGLZ_MICRO_STEP < 27
+    if (ways != 0)
+        fprintf(stderr, "%s: no bucket match finder, --ways ignored\n",
+                variant);
+    ways = 0;
+#endif
+#if PGLZ_MICRO_STEP < 8
+    if (generations)
+        fprintf(stderr, "%s: no generation-tagged context, "
+                "--generations ignored\n", variant);
+    generations = false;
+#endif
+
+    micro_init(&st, generations, ways);
+    counters_open();
+
+    for (int t = 0; t < (int) NUM_TYPES; t++)
+    {
+        MicroInput *in = &inputs[ninputs++];
+
+        memset(in, 0, sizeof(*in));
+        in->name = input_types[t].name;
+        in->data = malloc(size);
+        in->len = size;
+        input_types[t].generate(in->data, size);
+    }
+    for (int f = 0; f < nfiles; f++)
+    {
+        MicroInput *in = &inputs[ninputs];
+
+        memset(in, 0, sizeof(*in));
+        if (!load_file(in, files[f], size))
+            return 1;
+        ninputs++;
+    }
+
+    printf("micro: %s, %d-byte inputs%s%s\n", variant, size,
+           generations ? ", generation-tagged context" : "",
+           ways ? ", bucket match finder" : "");
+    printf("%s: median per pass (TSC ticks on x86); events per KiB of input\n\n",
+           CYCLE_UNIT);
+    printf("%-12s  %-17s  %6s/B  %6s/call  %8s", "Input", "Function",
+           CYCLE_UNIT, CYCLE_UNIT, "calls");
+    for (int e = 0; e < NUM_EVENTS; e++)
+        printf("  %11s", event_names[e]);
+    printf("\n");
+
+    for (int i = 0; i < ninputs; i++)
+    {
+        prepare_input(&st, &inputs[i]);
+        run_input(&st, &inputs[i]);
+        free(inputs[i].data);
+        free(inputs[i].probes);
+        free(inputs[i].compressed);
+        free(inputs[i].decoded);
+    }
+
+    micro_free(&st);
+    return 0;
+}
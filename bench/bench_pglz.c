@@ -8,13 +8,95 @@
  *   gcc -O2 -DFRONTEND -I./include -o bench_pglz bench_pglz.c <variant>.c
  *
  * Run:
- *   taskset -c 0 ./bench_pglz
+ *   taskset -c 0 ./bench_pglz [variant-name] [--md] [--tsv] [--perf]
+ *                             [--mode=<mode>] [--min-ms=N]
+ *                             [--hash=stock|fibonacci|crc32c] [--sample=N]
+ *                             [--skip=N]
+ *                             [--corpus=PATH] [--chunk=toast|page|N]
+ *                             [--threads=N] [--pin=none|cpu|numa]
+ *
+ * --perf adds the L1d read misses per call (from perf_event_open, the
+ * counter behind "perf stat -e L1-dcache-load-misses") to compress mode,
+ * and branch misses per call to decompress mode.
+ * Unavailable counters (no PMU access, e.g. perf_event_paranoid) show
+ * as "n/a".
+ *
+ * Variants built with -DPGLZ_STATS (make stats-<variant>) count hot-path
+ * events; compress mode then compresses each input once more with the
+ * counters reset and prints them per call after the throughput table.
+ *
+ * --tsv prints compress and decompress mode results as tab-separated
+ * lines for bench_compare.  --min-ms=N times each test for N ms instead
+ * of 500 (modes that use a fraction of that scale with it).
+ *
+ * --hash selects the bucket hash (pglz_set_hash) before any mode runs,
+ * for variants that provide it, so the contexts the modes create start
+ * with it too; the variant name is labelled with it.
+ * --sample=N makes compress mode call pglz_compress_ext with sample_size
+ * N (and the default skip settings) instead of pglz_compress.
+ * --skip=N does the same with skip_threshold N and no skip_rate, so that
+ * every match of N bytes or more skips its interior; --skip=0 adds every
+ * position to the history, which recycles an entry per position once the
+ * history is full.
+ *
+ * Modes:
+ *   compress   (default) compression throughput for every type and size
+ *   small      small-input latency: per-call hist_start reset vs a reused
+ *              generation-tagged PGLZ_Context
+ *   decompress decompression latency and throughput for every type and
+ *              size, with and without check_complete; --perf adds branch
+ *              misses per call
+ *   slice      1 KiB prefix of 1 MiB inputs: full decode vs prefix decode
+ *              vs pglz_decompress_slice
+ *   parallel   16 MiB inputs: pglz_compress vs pglz_compress_parallel
+ *              frames with 1, 2, 4 and 8 threads, then pglz_decompress vs
+ *              pglz_decompress_parallel, and 8 KiB reads at random offsets
+ *              by decoding the whole frame vs pglz_decompress_frame_range
+ *   batch      per-datum cost of 100 x 2 KiB pgbench rows: pglz_compress
+ *              loop vs reused context vs pglz_compress_batch
+ *   stream     1 MiB inputs: pglz_compress vs pglz_stream_update in 8 KiB
+ *              and 64 KiB pieces, and pglz_decompress vs pglz_decode_update
+ *              in 1996-byte (toast chunk) and 64 KiB pieces
+ *   level      ratio and compression/decompression speed of greedy matching
+ *              vs 1- and 2-step lazy matching vs PGLZ_strategy_archive, for
+ *              every type at 4 KiB, 64 KiB and 1 MiB
+ *   engine     ratio and compression speed of the chained history vs the
+ *              bucket match finder with 2, 4 and 8 ways, for every type at
+ *              2 KiB to 1 MiB
+ *   alloc      allocations and time per compress+decompress roundtrip,
+ *              with malloc()ed buffers per call vs a context's own
+ *              buffers, for every type at 4 KiB to 1 MiB
+ *   estimate   pglz_estimate_ratio() against the real compression rate,
+ *              with its cost, for every type at 2 KiB to 1 MiB and
+ *              samples of 512 B to 8 KiB
+ *   dict       ratio and speed of 300-800 B JSON and pgbench rows compressed
+ *              one by one without and with a 1 KiB and 4 KiB dictionary
+ *   sweep      compression time with every hash table size (256-16384
+ *              buckets) for every type and size from 64 B to 1 MiB, from a
+ *              context reset per call and a generation-tagged one, with the
+ *              fastest size and the one the variant's sizing table picks
+ *   fixed      pglz_compress_default/pglz_compress_always vs pglz_compress
+ *              with copies of the same strategies, which take the generic
+ *              code, for every type at 512 B to 1 MiB
+ *   corpus     real data: --corpus=PATH (a file, or a directory searched
+ *              recursively) is mapped and cut into --chunk=toast (2032 B,
+ *              the default), page (8 KiB) or N-byte chunks, compressed with
+ *              PGLZ_strategy_default as TOAST does; per file and in total,
+ *              aggregate and per-chunk throughput and ratio percentiles
+ *   mt         1, 2, 4 ... --threads threads (default: all CPUs), each with
+ *              its own context and 4 MiB of 2 KiB or 64 KiB inputs, for
+ *              every type: aggregate MiB/s, scaling, and per-thread p50
+ *              and p99 latency; --pin=cpu or numa binds the threads
+ *
+ * Modes that need entry points a variant does not provide are skipped.
  *
  * Or use the Makefile.
  */
 
 #define FRONTEND 1
+#define _GNU_SOURCE                 /* sched_getaffinity, pthread_setaffinity_np */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,9 +104,59 @@
 #include <stdbool.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 
 #include "common/pg_lzcompress.h"
 
+/*
+ * Entry points that only later variants provide.  Weak references keep
+ * this harness linkable against the baseline and earlier steps; modes
+ * that need them check for NULL first.
+ */
+#pragma weak pglz_context_create
+#pragma weak pglz_context_create_extended
+#pragma weak pglz_context_free
+#pragma weak pglz_compress_ctx
+#pragma weak pglz_decompress_slice
+#pragma weak pglz_compress_parallel
+#pragma weak pglz_compress_batch
+#pragma weak pglz_stream_begin
+#pragma weak pglz_stream_update
+#pragma weak pglz_stream_end
+#pragma weak pglz_decode_begin
+#pragma weak pglz_decode_update
+#pragma weak pglz_decode_end
+#pragma weak pglz_set_hash
+#pragma weak pglz_compress_ext
+#pragma weak PGLZ_strategy_archive
+#pragma weak pglz_hash_size
+#pragma weak pglz_compress_ctx_ext
+#pragma weak pglz_compress_default
+#pragma weak pglz_compress_always
+#pragma weak pglz_get_stats
+#pragma weak pglz_reset_stats
+#pragma weak pglz_bucket_ways
+#pragma weak pglz_context_create_allocator
+#pragma weak pglz_context_output_buffer
+#pragma weak pglz_context_raw_buffer
+#pragma weak pglz_estimate_ratio
+#pragma weak pglz_compress_ctx_dict
+#pragma weak pglz_decompress_dict
+#pragma weak pglz_decompress_parallel
+#pragma weak pglz_decompress_frame
+#pragma weak pglz_decompress_frame_range
+
 /* ----------
  * Configuration
  * ----------
@@ -34,6 +166,9 @@
 #define MAX_ITERS       1000000
 #define MIN_BENCH_NS    500000000LL  /* Run for at least 500ms per test */
 
+/* Time per test, MIN_BENCH_NS unless --min-ms says otherwise */
+static int64_t min_bench_ns = MIN_BENCH_NS;
+
 /* Test sizes */
 static const int test_sizes[] = { 512, 2048, 4096, 65536, 1048576 };
 #define NUM_SIZES (sizeof(test_sizes) / sizeof(test_sizes[0]))
@@ -50,6 +185,66 @@ now_ns(void)
     return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
+/* ----------
+ * Hardware event counters (perf_event_open), counting this thread only,
+ * user space only.  All helpers are no-ops returning -1 when the counter
+ * could not be opened.
+ * ----------
+ */
+#ifdef __linux__
+#define PERF_L1D_READ_MISS \
+    (PERF_COUNT_HW_CACHE_L1D | \
+     (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+#endif
+
+static int
+perf_counter_open(uint32_t type, uint64_t config)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void
+perf_counter_start(int fd)
+{
+#ifdef __linux__
+    if (fd < 0)
+        return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+static int64_t
+perf_counter_stop(int fd)
+{
+#ifdef __linux__
+    uint64_t count;
+
+    if (fd < 0)
+        return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+        return -1;
+    return (int64_t)count;
+#else
+    return -1;
+#endif
+}
+
 /* ----------
  * Comparison function for qsort (int64_t)
  * ----------
@@ -217,16 +412,107 @@ typedef struct
     double      p99_us;         /* p99 latency */
     double      mean_us;
     bool        compress_ok;    /* did compression succeed? */
+    double      events;         /* perf counter events per call, -1 = n/a */
+    bool        have_stats;     /* variant counts PGLZ_Stats */
+    PGLZ_Stats  stats;          /* of one call */
 } BenchResult;
 
+/*
+ * Set by --perf: add a hardware counter column to the result tables.
+ * Compress mode counts L1d read misses, decompress mode branch misses.
+ */
+static bool show_perf = false;
+static const char *perf_column = "L1dMiss/call";
+
+/*
+ * Set by --tsv: compress and decompress modes print their results as
+ * tab-separated lines, for bench_compare, instead of tables.
+ */
+static bool tsv = false;
+
+static const char *
+fmt_events(double per_call)
+{
+    static char buf[4][32];
+    static int idx = 0;
+    char *b = buf[idx++ & 3];
+
+    if (per_call < 0)
+        return "n/a";
+    snprintf(b, 32, "%.1f", per_call);
+    return b;
+}
+
+/*
+ * Set by --sample and --skip: compress mode goes through pglz_compress_ext
+ * with this strategy.
+ */
+static bool use_strategy_ext = false;
+static PGLZ_StrategyExt strategy_ext;
+
+static inline int32
+bench_compress(const char *input, int input_len, char *output)
+{
+    if (use_strategy_ext)
+        return pglz_compress_ext(input, input_len, output, &strategy_ext);
+    return pglz_compress(input, input_len, output, PGLZ_strategy_always);
+}
+
 /* ----------
  * Run a single benchmark: compress `iters` times, record per-call latencies.
- * Returns the number of iterations actually run.
+ * Returns the number of iterations actually run.  If l1d_fd is an open
+ * counter, the L1d misses over the measured iterations go to *l1d_misses.
  * ----------
  */
 static int
 run_bench(const char *input, int input_len, char *output, int output_len,
-          int64_t *latencies, int max_iters)
+          int64_t *latencies, int max_iters, int l1d_fd, int64_t *l1d_misses)
+{
+    int iters = 0;
+    int64_t total_ns = 0;
+
+    /* Warmup */
+    for (int i = 0; i < WARMUP_ITERS; i++)
+    {
+        bench_compress(input, input_len, output);
+    }
+
+    /* Measured iterations */
+    perf_counter_start(l1d_fd);
+    while (iters < max_iters)
+    {
+        int64_t t0 = now_ns();
+        bench_compress(input, input_len, output);
+        int64_t t1 = now_ns();
+
+        latencies[iters] = t1 - t0;
+        total_ns += (t1 - t0);
+        iters++;
+
+        /* Run at least MIN_ITERS, then check if we've hit min_bench_ns */
+        if (iters >= MIN_ITERS && total_ns >= min_bench_ns)
+            break;
+    }
+    *l1d_misses = perf_counter_stop(l1d_fd);
+
+    return iters;
+}
+
+/* ----------
+ * Same as run_bench, for pglz_decompress of clen bytes of compressed
+ * data back into rawsize bytes of output.  With slice, time
+ * pglz_decompress_slice instead (output must be PGLZ_SLICE_BUFSIZE).
+ * ----------
+ */
+#define DECOMPRESS(slice, src, slen, dst, rawsize, check_complete) \
+    ((slice) ? pglz_decompress_slice(src, slen, dst, rawsize) : \
+     pglz_decompress(src, slen, dst, rawsize, check_complete))
+
+static int
+run_decompress_bench(const char *compressed, int32 clen, char *output,
+                     int32 rawsize, bool check_complete, bool slice,
+                     int64_t *latencies, int max_iters, int event_fd,
+                     int64_t *events)
 {
     int iters = 0;
     int64_t total_ns = 0;
@@ -234,28 +520,60 @@ run_bench(const char *input, int input_len, char *output, int output_len,
     /* Warmup */
     for (int i = 0; i < WARMUP_ITERS; i++)
     {
-        pglz_compress(input, input_len, output, PGLZ_strategy_always);
+        DECOMPRESS(slice, compressed, clen, output, rawsize, check_complete);
     }
 
     /* Measured iterations */
+    perf_counter_start(event_fd);
     while (iters < max_iters)
     {
         int64_t t0 = now_ns();
-        pglz_compress(input, input_len, output, PGLZ_strategy_always);
+        DECOMPRESS(slice, compressed, clen, output, rawsize, check_complete);
         int64_t t1 = now_ns();
 
         latencies[iters] = t1 - t0;
         total_ns += (t1 - t0);
         iters++;
 
-        /* Run at least MIN_ITERS, then check if we've hit MIN_BENCH_NS */
-        if (iters >= MIN_ITERS && total_ns >= MIN_BENCH_NS)
+        if (iters >= MIN_ITERS && total_ns >= min_bench_ns)
             break;
     }
+    *events = perf_counter_stop(event_fd);
 
     return iters;
 }
 
+/* ----------
+ * Fill in a BenchResult from the latencies of `iters` calls on `size`
+ * uncompressed bytes (sorts latencies).
+ * ----------
+ */
+static void
+fill_result(BenchResult *r, const char *type_name, int size, int32 clen,
+            int64_t *latencies, int iters, int64_t events)
+{
+    /* Sort latencies for percentiles */
+    qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+
+    double total_ns = 0;
+    for (int i = 0; i < iters; i++)
+        total_ns += latencies[i];
+
+    r->type_name = type_name;
+    r->input_size = size;
+    r->iters = iters;
+    r->compressed_size = clen;
+    r->ratio = (clen >= 0) ? (double)clen / size : -1.0;
+    /* Throughput: based on total uncompressed bytes processed / total time */
+    r->throughput_mib = ((double)size * iters / (1024.0 * 1024.0)) /
+                        (total_ns / 1e9);
+    r->median_us = latencies[iters / 2] / 1000.0;
+    r->p99_us = latencies[(int)(iters * 0.99)] / 1000.0;
+    r->mean_us = total_ns / iters / 1000.0;
+    r->compress_ok = true;
+    r->events = (events >= 0) ? (double)events / iters : -1.0;
+}
+
 /* ----------
  * Verify compression round-trip
  * ----------
@@ -326,17 +644,23 @@ print_results(BenchResult *results, int nresults, const char *variant_name)
     printf("\n");
     printf("=== %s ===\n", variant_name);
     printf("\n");
-    printf("%-12s %8s %8s %10s %10s %10s %10s %8s\n",
+    printf("%-12s %8s %8s %10s %10s %10s %10s %8s",
            "Type", "Size", "CSize", "Ratio", "MiB/s", "Med(µs)", "P99(µs)", "Iters");
-    printf("%-12s %8s %8s %10s %10s %10s %10s %8s\n",
+    if (show_perf)
+        printf(" %12s", perf_column);
+    printf("\n");
+    printf("%-12s %8s %8s %10s %10s %10s %10s %8s",
            "----", "----", "-----", "-----", "-----", "------", "------", "-----");
+    if (show_perf)
+        printf(" %12s", "------------");
+    printf("\n");
 
     for (int i = 0; i < nresults; i++)
     {
         BenchResult *r = &results[i];
         if (r->compress_ok && r->compressed_size >= 0)
         {
-            printf("%-12s %8s %8d %9.2f%% %10.1f %10.2f %10.2f %8d\n",
+            printf("%-12s %8s %8d %9.2f%% %10.1f %10.2f %10.2f %8d",
                    r->type_name,
                    fmt_size(r->input_size),
                    r->compressed_size,
@@ -348,7 +672,7 @@ print_results(BenchResult *results, int nresults, const char *variant_name)
         }
         else
         {
-            printf("%-12s %8s %8s %10s %10.1f %10.2f %10.2f %8d\n",
+            printf("%-12s %8s %8s %10s %10.1f %10.2f %10.2f %8d",
                    r->type_name,
                    fmt_size(r->input_size),
                    "FAIL",
@@ -358,6 +682,9 @@ print_results(BenchResult *results, int nresults, const char *variant_name)
                    r->p99_us,
                    r->iters);
         }
+        if (show_perf)
+            printf(" %12s", fmt_events(r->events));
+        printf("\n");
     }
 }
 
@@ -369,15 +696,22 @@ static void
 print_results_md(BenchResult *results, int nresults, const char *variant_name)
 {
     printf("\n### %s\n\n", variant_name);
-    printf("| Type | Size | Compressed | Ratio | MiB/s | Median µs | P99 µs | Iters |\n");
-    printf("|------|------|-----------|-------|-------|-----------|--------|-------|\n");
+    printf("| Type | Size | Compressed | Ratio | MiB/s | Median µs | P99 µs | Iters |");
+    if (show_perf)
+        printf(" %s |", perf_column);
+    printf("\n");
+    printf("|------|------|-----------|-------|-------|-----------|--------|-------|");
+    if (show_perf)
+        printf("%.*s|", (int)strlen(perf_column) + 2,
+               "--------------------------------");
+    printf("\n");
 
     for (int i = 0; i < nresults; i++)
     {
         BenchResult *r = &results[i];
         if (r->compress_ok && r->compressed_size >= 0)
         {
-            printf("| %-10s | %6s | %9d | %6.2f%% | %8.1f | %9.2f | %8.2f | %6d |\n",
+            printf("| %-10s | %6s | %9d | %6.2f%% | %8.1f | %9.2f | %8.2f | %6d |",
                    r->type_name,
                    fmt_size(r->input_size),
                    r->compressed_size,
@@ -389,7 +723,7 @@ print_results_md(BenchResult *results, int nresults, const char *variant_name)
         }
         else
         {
-            printf("| %-10s | %6s | %9s | %6s | %8.1f | %9.2f | %8.2f | %6d |\n",
+            printf("| %-10s | %6s | %9s | %6s | %8.1f | %9.2f | %8.2f | %6d |",
                    r->type_name,
                    fmt_size(r->input_size),
                    "FAIL",
@@ -399,122 +733,3745 @@ print_results_md(BenchResult *results, int nresults, const char *variant_name)
                    r->p99_us,
                    r->iters);
         }
+        if (show_perf)
+            printf(" %*s |", (int)strlen(perf_column), fmt_events(r->events));
+        printf("\n");
     }
 }
 
 /* ----------
- * Main
+ * Print results as tab-separated lines, one per cell: table, type, size,
+ * compressed size, iterations, MiB/s, median and p99 µs.  This is the
+ * format bench_compare reads; table tells compress mode's results from
+ * decompress mode's two sets.
  * ----------
  */
-int
-main(int argc, char **argv)
+static void
+print_results_tsv(BenchResult *results, int nresults, const char *table)
 {
-    bool markdown = false;
+    for (int i = 0; i < nresults; i++)
+    {
+        BenchResult *r = &results[i];
 
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "--md") == 0 || strcmp(argv[i], "--markdown") == 0)
-            markdown = true;
+        printf("%s\t%s\t%d\t%d\t%d\t%.3f\t%.3f\t%.3f\n",
+               table, r->type_name, r->input_size,
+               r->compress_ok ? r->compressed_size : -1, r->iters,
+               r->throughput_mib, r->median_us, r->p99_us);
     }
+}
 
-    const char *variant = "pglz";
-    if (argc > 1 && argv[1][0] != '-')
-        variant = argv[1];
+/* ----------
+ * Print the PGLZ_Stats of one call per result next to its throughput:
+ * how long the history searches were and why they stopped, how full the
+ * history got, what the output consisted of, and why the call failed.
+ * ----------
+ */
+static double
+pct(uint64 part, uint64 whole)
+{
+    return whole ? (double)part / whole * 100.0 : 0.0;
+}
 
-    int total_tests = NUM_TYPES * NUM_SIZES;
-    BenchResult *results = calloc(total_tests, sizeof(BenchResult));
-    int64_t *latencies = malloc(MAX_ITERS * sizeof(int64_t));
+static const char *
+bailout_reason(const PGLZ_Stats *st)
+{
+    if (st->bailout_strategy)
+        return "strategy";
+    if (st->bailout_sample)
+        return "sample";
+    if (st->bailout_first_success)
+        return "first_success";
+    if (st->bailout_ratio)
+        return "ratio";
+    return "-";
+}
 
-    if (!results || !latencies) {
-        fprintf(stderr, "Out of memory\n");
-        return 1;
+static void
+print_stats(BenchResult *results, int nresults, const char *variant_name,
+            bool markdown)
+{
+    static const char *const bucket_names[PGLZ_STATS_MATCH_BUCKETS] = {
+        "3", "4-7", "8-15", "16-31", "32-63", "64-127", "128+"
+    };
+
+    if (markdown)
+    {
+        printf("\n### %s: hot-path counters per call\n\n", variant_name);
+        printf("| Type | Size | MiB/s | Searches | Hops/search | Limit %% | Offset %% | Dead %% | Recycled %% | Skipped | Literals | Matches |");
+        for (int b = 0; b < PGLZ_STATS_MATCH_BUCKETS; b++)
+            printf(" %s %% |", bucket_names[b]);
+        printf(" Bailout |\n");
+        printf("|------|------|-------|----------|-------------|---------|----------|--------|------------|---------|----------|---------|");
+        for (int b = 0; b < PGLZ_STATS_MATCH_BUCKETS; b++)
+            printf("------|");
+        printf("---------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: hot-path counters per call ===\n\n", variant_name);
+        printf("%-10s %5s %8s %8s %6s %6s %6s %6s %6s %8s %8s %7s",
+               "Type", "Size", "MiB/s", "Search", "Hops", "Limit%", "Offs%",
+               "Dead%", "Recyc%", "Skipped", "Literals", "Matches");
+        for (int b = 0; b < PGLZ_STATS_MATCH_BUCKETS; b++)
+            printf(" %6s", bucket_names[b]);
+        printf("  %s\n", "Bailout");
     }
 
-    /* Allocate max-sized buffers */
-    int max_size = test_sizes[NUM_SIZES - 1];
+    for (int i = 0; i < nresults; i++)
+    {
+        BenchResult *r = &results[i];
+        const PGLZ_Stats *st = &r->stats;
+        uint64 nmatches = 0;
+
+        if (!r->have_stats)
+            continue;
+        for (int b = 0; b < PGLZ_STATS_MATCH_BUCKETS; b++)
+            nmatches += st->matches[b];
+
+        if (markdown)
+            printf("| %-10s | %4s | %.1f | %llu | %.2f | %.2f | %.2f | %.2f | %.1f | %llu | %llu | %llu |",
+                   r->type_name, fmt_size(r->input_size), r->throughput_mib,
+                   (unsigned long long) st->searches,
+                   st->searches ? (double)st->chain_hops / st->searches : 0.0,
+                   pct(st->chain_limit_stops, st->searches),
+                   pct(st->offset_stops, st->searches),
+                   pct(st->dead_chain_stops, st->searches),
+                   pct(st->hist_recycles, st->hist_adds),
+                   (unsigned long long) st->skipped_positions,
+                   (unsigned long long) st->literals,
+                   (unsigned long long) nmatches);
+        else
+            printf("%-10s %5s %8.1f %8llu %6.2f %6.2f %6.2f %6.2f %6.1f %8llu %8llu %7llu",
+                   r->type_name, fmt_size(r->input_size), r->throughput_mib,
+                   (unsigned long long) st->searches,
+                   st->searches ? (double)st->chain_hops / st->searches : 0.0,
+                   pct(st->chain_limit_stops, st->searches),
+                   pct(st->offset_stops, st->searches),
+                   pct(st->dead_chain_stops, st->searches),
+                   pct(st->hist_recycles, st->hist_adds),
+                   (unsigned long long) st->skipped_positions,
+                   (unsigned long long) st->literals,
+                   (unsigned long long) nmatches);
+        for (int b = 0; b < PGLZ_STATS_MATCH_BUCKETS; b++)
+            printf(markdown ? " %.1f |" : " %6.1f", pct(st->matches[b], nmatches));
+        printf(markdown ? " %s |\n" : "  %s\n", bailout_reason(st));
+    }
+}
+
+/* ----------
+ * Small-input latency mode
+ *
+ * Compares, per call on inputs up to 2 KiB:
+ *   reset  pglz_compress(), which clears hashsz bucket heads every call
+ *   ctx    a reused plain PGLZ_Context (same reset, caller-owned memory)
+ *   gen    a reused PGLZ_CTX_GENERATIONS context (O(1) invalidation)
+ * ----------
+ */
+static const int small_sizes[] = { 64, 128, 256, 512, 1024, 2048 };
+#define NUM_SMALL_SIZES (sizeof(small_sizes) / sizeof(small_sizes[0]))
+
+/* Median latency, in ns, of compressing input with ctx (NULL = static) */
+static double
+median_compress_ns(PGLZ_Context *ctx, const char *input, int input_len,
+                   char *output, int64_t *latencies)
+{
+    int iters = 0;
+    int64_t total_ns = 0;
+
+    for (int i = 0; i < WARMUP_ITERS; i++)
+    {
+        if (ctx)
+            pglz_compress_ctx(ctx, input, input_len, output,
+                              PGLZ_strategy_always);
+        else
+            pglz_compress(input, input_len, output, PGLZ_strategy_always);
+    }
+
+    while (iters < MAX_ITERS)
+    {
+        int64_t t0 = now_ns();
+        if (ctx)
+            pglz_compress_ctx(ctx, input, input_len, output,
+                              PGLZ_strategy_always);
+        else
+            pglz_compress(input, input_len, output, PGLZ_strategy_always);
+        int64_t t1 = now_ns();
+
+        latencies[iters] = t1 - t0;
+        total_ns += (t1 - t0);
+        iters++;
+
+        if (iters >= MIN_ITERS && total_ns >= min_bench_ns)
+            break;
+    }
+
+    qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+    return latencies[iters / 2];
+}
+
+static int
+run_small_mode(const char *variant, bool markdown, int64_t *latencies)
+{
+    if (pglz_context_create_extended == NULL)
+    {
+        fprintf(stderr, "%s: no pglz_context_create_extended(), "
+                "skipping small-input mode\n", variant);
+        return 0;
+    }
+
+    PGLZ_Context *plain = pglz_context_create_extended(0);
+    PGLZ_Context *gen = pglz_context_create_extended(PGLZ_CTX_GENERATIONS);
+    int max_size = small_sizes[NUM_SMALL_SIZES - 1];
     char *input = malloc(max_size);
-    int output_len = PGLZ_MAX_OUTPUT(max_size);
-    char *output = malloc(output_len);
+    char *output = malloc(PGLZ_MAX_OUTPUT(max_size));
 
-    if (!input || !output) {
-        fprintf(stderr, "Out of memory for buffers\n");
+    if (!plain || !gen || !input || !output)
+    {
+        fprintf(stderr, "Out of memory\n");
         return 1;
     }
 
-    int ridx = 0;
+    if (markdown)
+    {
+        printf("\n### %s: small-input latency\n\n", variant);
+        printf("| Type | Size | Compressed | Reset µs | Ctx µs | Gen µs | Gen vs Reset |\n");
+        printf("|------|------|-----------|----------|--------|--------|--------------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: small-input latency ===\n\n", variant);
+        printf("%-12s %8s %8s %10s %10s %10s %13s\n",
+               "Type", "Size", "CSize", "Reset(µs)", "Ctx(µs)", "Gen(µs)",
+               "Gen vs Reset");
+        printf("%-12s %8s %8s %10s %10s %10s %13s\n",
+               "----", "----", "-----", "---------", "-------", "-------",
+               "------------");
+    }
+
     for (int t = 0; t < (int)NUM_TYPES; t++)
     {
-        for (int s = 0; s < (int)NUM_SIZES; s++)
+        for (int s = 0; s < (int)NUM_SMALL_SIZES; s++)
         {
-            int size = test_sizes[s];
+            int size = small_sizes[s];
             const InputType *itype = &input_types[t];
 
-            /* Generate input */
             itype->generate(input, size);
 
-            /* Verify round-trip first */
-            if (!verify_roundtrip(input, size)) {
-                fprintf(stderr, "ERROR: Round-trip verification failed for %s/%s!\n",
-                        itype->name, fmt_size(size));
-                results[ridx].type_name = itype->name;
-                results[ridx].input_size = size;
-                results[ridx].compress_ok = false;
-                ridx++;
-                continue;
-            }
-
-            /* Check if compression succeeds */
             int32 clen = pglz_compress(input, size, output,
                                        PGLZ_strategy_always);
+            double reset_ns = median_compress_ns(NULL, input, size, output,
+                                                 latencies);
+            double ctx_ns = median_compress_ns(plain, input, size, output,
+                                               latencies);
+            double gen_ns = median_compress_ns(gen, input, size, output,
+                                               latencies);
+            double delta = (gen_ns - reset_ns) / reset_ns * 100.0;
 
-            /* Run benchmark */
-            int iters = run_bench(input, size, output, output_len,
-                                  latencies, MAX_ITERS);
+            if (markdown)
+                printf("| %-10s | %6s | %9d | %8.3f | %6.3f | %6.3f | %+11.1f%% |\n",
+                       itype->name, fmt_size(size), clen,
+                       reset_ns / 1000.0, ctx_ns / 1000.0, gen_ns / 1000.0,
+                       delta);
+            else
+                printf("%-12s %8s %8d %10.3f %10.3f %10.3f %+12.1f%%\n",
+                       itype->name, fmt_size(size), clen,
+                       reset_ns / 1000.0, ctx_ns / 1000.0, gen_ns / 1000.0,
+                       delta);
+        }
+    }
 
-            /* Sort latencies for percentiles */
-            qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+    pglz_context_free(plain);
+    pglz_context_free(gen);
+    free(input);
+    free(output);
+    return 0;
+}
 
-            double median_ns = latencies[iters / 2];
-            double p99_ns = latencies[(int)(iters * 0.99)];
-            double total_ns = 0;
-            for (int i = 0; i < iters; i++)
-                total_ns += latencies[i];
-            double mean_ns = total_ns / iters;
+/* ----------
+ * Decompression mode
+ *
+ * Times pglz_decompress on the output of pglz_compress for each type and
+ * size, once with check_complete (full TOAST detoasting) and once
+ * without (the slice path), in the same table layout as compress mode.
+ * MiB/s is based on the decompressed size.  With --perf, the extra
+ * column is branch misses per call: the control-byte loop's literal/tag
+ * branch is the main source of mispredictions on mixed input.
+ * Incompressible inputs have nothing to decompress and show as FAIL.
+ * ----------
+ */
+static int
+run_decompress_mode(const char *variant, bool markdown, int64_t *latencies,
+                    BenchResult *results)
+{
+    int max_size = test_sizes[NUM_SIZES - 1];
+    char *input = malloc(max_size);
+    char *compressed = malloc(PGLZ_MAX_OUTPUT(max_size));
+    char *output = malloc(max_size);
+    int br_fd = -1;
+    int status = 1;
 
-            /* Throughput: based on total input bytes processed / total time */
-            double throughput_mib = ((double)size * iters / (1024.0 * 1024.0)) /
-                                   (total_ns / 1e9);
+    if (!input || !compressed || !output)
+    {
+        fprintf(stderr, "Out of memory\n");
+        goto done;
+    }
 
-            BenchResult *r = &results[ridx];
-            r->type_name = itype->name;
-            r->input_size = size;
-            r->iters = iters;
-            r->compressed_size = clen;
-            r->ratio = (clen >= 0) ? (double)clen / size : -1.0;
-            r->throughput_mib = throughput_mib;
-            r->median_us = median_ns / 1000.0;
-            r->p99_us = p99_ns / 1000.0;
-            r->mean_us = mean_ns / 1000.0;
-            r->compress_ok = true;
-
-            if (!markdown) {
-                fprintf(stderr, "  %-12s %8s: %.1f MiB/s, ratio=%.2f%%, median=%.2f µs (%d iters)\n",
-                        itype->name, fmt_size(size),
-                        throughput_mib,
-                        (clen >= 0) ? (double)clen / size * 100.0 : -1.0,
-                        median_ns / 1000.0,
-                        iters);
-            }
+    perf_column = "BrMiss/call";
+    if (show_perf)
+    {
+#ifdef __linux__
+        br_fd = perf_counter_open(PERF_TYPE_HARDWARE,
+                                  PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+        if (br_fd < 0)
+            fprintf(stderr, "warning: cannot open branch miss counter, "
+                    "reporting n/a\n");
+    }
 
-            ridx++;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        bool check_complete = (pass == 0);
+        char title[128];
+        int ridx = 0;
+
+        for (int t = 0; t < (int)NUM_TYPES; t++)
+        {
+            for (int s = 0; s < (int)NUM_SIZES; s++)
+            {
+                int size = test_sizes[s];
+                const InputType *itype = &input_types[t];
+                BenchResult *r = &results[ridx++];
+
+                itype->generate(input, size);
+
+                int32 clen = pglz_compress(input, size, compressed,
+                                           PGLZ_strategy_always);
+                if (clen < 0)
+                {
+                    memset(r, 0, sizeof(*r));
+                    r->type_name = itype->name;
+                    r->input_size = size;
+                    r->compressed_size = clen;
+                    r->events = -1.0;
+                    continue;
+                }
+
+                if (pglz_decompress(compressed, clen, output, size,
+                                    check_complete) != size ||
+                    memcmp(input, output, size) != 0)
+                {
+                    fprintf(stderr, "ERROR: Round-trip verification failed for %s/%s!\n",
+                            itype->name, fmt_size(size));
+                    goto done;
+                }
+
+                int64_t br_misses;
+                int iters = run_decompress_bench(compressed, clen, output,
+                                                 size, check_complete, false,
+                                                 latencies, MAX_ITERS,
+                                                 br_fd, &br_misses);
+
+                fill_result(r, itype->name, size, clen, latencies, iters,
+                            br_misses);
+
+                if (!markdown && !tsv)
+                    fprintf(stderr, "  %-12s %8s: %.1f MiB/s, median=%.2f µs (%d iters)%s\n",
+                            itype->name, fmt_size(size), r->throughput_mib,
+                            r->median_us, iters,
+                            check_complete ? "" : ", no check");
+            }
         }
+
+        snprintf(title, sizeof(title), "%s: decompress, check_complete=%s",
+                 variant, check_complete ? "true" : "false");
+        if (tsv)
+            print_results_tsv(results, ridx, check_complete ?
+                              "decompress" : "decompress_nocheck");
+        else if (markdown)
+            print_results_md(results, ridx, title);
+        else
+            print_results(results, ridx, title);
     }
+    status = 0;
 
-    /* Print results */
-    if (markdown)
+done:
+#ifdef __linux__
+    if (br_fd >= 0)
+        close(br_fd);
+#endif
+    free(input);
+    free(compressed);
+    free(output);
+    return status;
+}
+
+/* ----------
+ * Slice mode
+ *
+ * substr()/prefix reads on large TOASTed values: decompress the first
+ * SLICE_PREFIX bytes of a SLICE_INPUT-byte value, with slen cut down by
+ * pglz_maximum_compressed_size() as detoasting does, and compare against
+ * decompressing the whole value.  Columns:
+ *   full    pglz_decompress(..., SLICE_INPUT, true)
+ *   prefix  pglz_decompress(..., SLICE_PREFIX, false)
+ *   slice   pglz_decompress_slice(..., SLICE_PREFIX), if the variant has it
+ * ----------
+ */
+#define SLICE_INPUT     1048576
+#define SLICE_PREFIX    1024
+
+static int
+run_slice_mode(const char *variant, bool markdown, int64_t *latencies)
+{
+    char *input = malloc(SLICE_INPUT);
+    char *compressed = malloc(PGLZ_MAX_OUTPUT(SLICE_INPUT));
+    char *output = malloc(SLICE_INPUT);
+    char *slice_buf = malloc(PGLZ_SLICE_BUFSIZE(SLICE_PREFIX));
+    bool have_slice = (pglz_decompress_slice != NULL);
+
+    if (!input || !compressed || !output || !slice_buf)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (!have_slice)
+        fprintf(stderr, "%s: no pglz_decompress_slice(), "
+                "reporting n/a\n", variant);
+
+    if (markdown)
+    {
+        printf("\n### %s: %s prefix of %s inputs\n\n", variant,
+               fmt_size(SLICE_PREFIX), fmt_size(SLICE_INPUT));
+        printf("| Type | Compressed | Full µs | Prefix µs | Prefix P99 µs | Slice µs | Slice P99 µs | Slice vs Prefix |\n");
+        printf("|------|-----------|---------|-----------|---------------|----------|--------------|-----------------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: %s prefix of %s inputs ===\n\n", variant,
+               fmt_size(SLICE_PREFIX), fmt_size(SLICE_INPUT));
+        printf("%-12s %8s %10s %10s %10s %10s %10s %16s\n",
+               "Type", "CSize", "Full(µs)", "Prefix(µs)", "P99(µs)",
+               "Slice(µs)", "P99(µs)", "Slice vs Prefix");
+        printf("%-12s %8s %10s %10s %10s %10s %10s %16s\n",
+               "----", "-----", "--------", "----------", "-------",
+               "---------", "-------", "---------------");
+    }
+
+    for (int t = 0; t < (int)NUM_TYPES; t++)
+    {
+        const InputType *itype = &input_types[t];
+        BenchResult full, prefix, slice;
+        int64_t events;
+        int iters;
+
+        itype->generate(input, SLICE_INPUT);
+
+        int32 clen = pglz_compress(input, SLICE_INPUT, compressed,
+                                   PGLZ_strategy_always);
+        if (clen < 0)
+            continue;
+
+        int32 plen = pglz_maximum_compressed_size(SLICE_PREFIX, clen);
+
+        if (pglz_decompress(compressed, plen, output, SLICE_PREFIX,
+                            false) != SLICE_PREFIX ||
+            memcmp(input, output, SLICE_PREFIX) != 0 ||
+            (have_slice &&
+             (pglz_decompress_slice(compressed, plen, slice_buf,
+                                    SLICE_PREFIX) != SLICE_PREFIX ||
+              memcmp(input, slice_buf, SLICE_PREFIX) != 0)))
+        {
+            fprintf(stderr, "ERROR: prefix verification failed for %s!\n",
+                    itype->name);
+            return 1;
+        }
+
+        iters = run_decompress_bench(compressed, clen, output, SLICE_INPUT,
+                                     true, false, latencies, MAX_ITERS,
+                                     -1, &events);
+        fill_result(&full, itype->name, SLICE_INPUT, clen, latencies,
+                    iters, events);
+
+        iters = run_decompress_bench(compressed, plen, output, SLICE_PREFIX,
+                                     false, false, latencies, MAX_ITERS,
+                                     -1, &events);
+        fill_result(&prefix, itype->name, SLICE_PREFIX, plen, latencies,
+                    iters, events);
+
+        if (have_slice)
+        {
+            iters = run_decompress_bench(compressed, plen, slice_buf,
+                                         SLICE_PREFIX, false, true,
+                                         latencies, MAX_ITERS, -1, &events);
+            fill_result(&slice, itype->name, SLICE_PREFIX, plen, latencies,
+                        iters, events);
+        }
+
+        char slice_us[32], slice_p99[32], delta[32];
+
+        if (have_slice)
+        {
+            snprintf(slice_us, sizeof(slice_us), "%.3f", slice.median_us);
+            snprintf(slice_p99, sizeof(slice_p99), "%.3f", slice.p99_us);
+            snprintf(delta, sizeof(delta), "%+.1f%%",
+                     (slice.median_us - prefix.median_us) /
+                     prefix.median_us * 100.0);
+        }
+        else
+        {
+            strcpy(slice_us, "n/a");
+            strcpy(slice_p99, "n/a");
+            strcpy(delta, "n/a");
+        }
+
+        if (markdown)
+            printf("| %-10s | %9d | %7.2f | %9.3f | %13.3f | %8s | %12s | %15s |\n",
+                   itype->name, clen, full.median_us, prefix.median_us,
+                   prefix.p99_us, slice_us, slice_p99, delta);
+        else
+            printf("%-12s %8d %10.2f %10.3f %10.3f %10s %10s %16s\n",
+                   itype->name, clen, full.median_us, prefix.median_us,
+                   prefix.p99_us, slice_us, slice_p99, delta);
+    }
+
+    free(input);
+    free(compressed);
+    free(output);
+    free(slice_buf);
+    return 0;
+}
+
+/* ----------
+ * Parallel mode
+ *
+ * Bulk (backup/archive sized) inputs: single-stream pglz_compress
+ * against the chunked frames of pglz_compress_parallel at several thread
+ * counts.  Each call takes tens of milliseconds, so this mode runs a few
+ * iterations (at least PARALLEL_MIN_ITERS) rather than MIN_ITERS.
+ * MiB/s is from the median wall-clock time of a call.
+ *
+ * Variants with pglz_decompress_parallel add the same table for
+ * decompression, and one for random access: PARALLEL_READS reads of
+ * PARALLEL_READ_SIZE bytes at random offsets, by decoding the whole frame
+ * and copying the range out as a reader without the index would, and
+ * with pglz_decompress_frame_range.  Those times are medians per read.
+ * ----------
+ */
+#define PARALLEL_INPUT      (16 * 1048576)
+#define PARALLEL_MIN_ITERS  3
+#define PARALLEL_READS      64
+#define PARALLEL_READ_SIZE  8192
+
+static const int parallel_threads[] = { 1, 2, 4, 8 };
+#define NUM_PARALLEL_THREADS \
+    (sizeof(parallel_threads) / sizeof(parallel_threads[0]))
+
+/* Median ns of compressing input; nthreads 0 = pglz_compress */
+static double
+median_parallel_ns(const char *input, char *output, int nthreads,
+                   int64_t *latencies, int32 *clen)
+{
+    int iters = 0;
+    int64_t total_ns = 0;
+
+    while (iters < MAX_ITERS)
+    {
+        int64_t t0 = now_ns();
+        if (nthreads == 0)
+            *clen = pglz_compress(input, PARALLEL_INPUT, output,
+                                  PGLZ_strategy_always);
+        else
+            *clen = pglz_compress_parallel(input, PARALLEL_INPUT, output,
+                                           PGLZ_strategy_always, nthreads);
+        int64_t t1 = now_ns();
+
+        latencies[iters] = t1 - t0;
+        total_ns += (t1 - t0);
+        iters++;
+
+        if (iters >= PARALLEL_MIN_ITERS && total_ns >= min_bench_ns)
+            break;
+    }
+
+    qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+    return latencies[iters / 2];
+}
+
+/*
+ * Median ns of decompressing what median_parallel_ns() made with
+ * nthreads (0 = pglz_decompress of a pglz_compress result).
+ */
+static double
+median_parallel_decode_ns(const char *compressed, int32 clen, char *output,
+                          int nthreads, int64_t *latencies)
+{
+    int iters = 0;
+    int64_t total_ns = 0;
+
+    while (iters < MAX_ITERS)
+    {
+        int64_t t0 = now_ns();
+        int32 dlen;
+
+        if (nthreads == 0)
+            dlen = pglz_decompress(compressed, clen, output, PARALLEL_INPUT,
+                                   true);
+        else
+            dlen = pglz_decompress_parallel(compressed, clen, output,
+                                            PARALLEL_INPUT, nthreads);
+        int64_t t1 = now_ns();
+
+        if (dlen != PARALLEL_INPUT)
+        {
+            fprintf(stderr, "parallel mode: decompression failed\n");
+            exit(1);
+        }
+        latencies[iters] = t1 - t0;
+        total_ns += (t1 - t0);
+        iters++;
+
+        if (iters >= PARALLEL_MIN_ITERS && total_ns >= min_bench_ns)
+            break;
+    }
+
+    qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+    return latencies[iters / 2];
+}
+
+/*
+ * Median ns per read of PARALLEL_READS ranges of frame: with whole, by
+ * decoding all of it into scratch and copying the range out.
+ */
+static double
+median_range_ns(bool whole, PGLZ_Context *ctx, const char *frame,
+                int32 flen, char *scratch, char *out, int64_t *latencies)
+{
+    int iters = 0;
+    int64_t total_ns = 0;
+
+    rng_seed(7);
+    while (iters < MAX_ITERS)
+    {
+        int32 off = xorshift64() % (PARALLEL_INPUT - PARALLEL_READ_SIZE + 1);
+        int32 n;
+
+        int64_t t0 = now_ns();
+        if (whole)
+        {
+            n = pglz_decompress_frame(frame, flen, scratch, PARALLEL_INPUT);
+            memcpy(out, scratch + off, PARALLEL_READ_SIZE);
+        }
+        else
+            n = pglz_decompress_frame_range(ctx, frame, flen, out, off,
+                                            PARALLEL_READ_SIZE);
+        int64_t t1 = now_ns();
+
+        if (n < 0)
+        {
+            fprintf(stderr, "parallel mode: range read failed\n");
+            exit(1);
+        }
+        latencies[iters] = t1 - t0;
+        total_ns += (t1 - t0);
+        iters++;
+
+        if (iters >= PARALLEL_READS && total_ns >= min_bench_ns / 4)
+            break;
+    }
+
+    qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+    return latencies[iters / 2];
+}
+
+static void
+run_parallel_decode(const char *variant, bool markdown, int64_t *latencies,
+                    char *input, char *output)
+{
+    char *stream = malloc(PGLZ_MAX_OUTPUT(PARALLEL_INPUT));
+    char *decoded = malloc(PARALLEL_INPUT);
+    char *range = malloc(PARALLEL_READ_SIZE);
+    PGLZ_Context *ctx = pglz_context_create();
+    bool have_range = (pglz_decompress_frame != NULL &&
+                       pglz_decompress_frame_range != NULL);
+
+    if (!stream || !decoded || !range || !ctx)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    if (markdown)
+    {
+        printf("\n### %s: parallel frame decompression, %s inputs\n\n",
+               variant, fmt_size(PARALLEL_INPUT));
+        printf("| Type | Threads | MiB/s | Median ms | vs pglz_decompress |\n");
+        printf("|------|---------|-------|-----------|--------------------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: parallel frame decompression, %s inputs ===\n\n",
+               variant, fmt_size(PARALLEL_INPUT));
+        printf("%-12s %8s %10s %10s %19s\n",
+               "Type", "Threads", "MiB/s", "Med(ms)", "vs pglz_decompress");
+        printf("%-12s %8s %10s %10s %19s\n",
+               "----", "-------", "-----", "-------", "------------------");
+    }
+
+    double whole_ns[NUM_TYPES];
+    double range_ns[NUM_TYPES];
+
+    for (int t = 0; t < (int)NUM_TYPES; t++)
+    {
+        const InputType *itype = &input_types[t];
+        int32 slen, flen;
+        double single_ns = 0;
+
+        whole_ns[t] = range_ns[t] = -1;
+        itype->generate(input, PARALLEL_INPUT);
+        slen = pglz_compress(input, PARALLEL_INPUT, stream,
+                             PGLZ_strategy_always);
+        flen = pglz_compress_parallel(input, PARALLEL_INPUT, output,
+                                      PGLZ_strategy_always, 1);
+        if (slen < 0 || flen < 0)
+            continue;           /* nothing to decompress */
+
+        for (int p = -1; p < (int)NUM_PARALLEL_THREADS; p++)
+        {
+            int nthreads = (p < 0) ? 0 : parallel_threads[p];
+            double ns = median_parallel_decode_ns(p < 0 ? stream : output,
+                                                  p < 0 ? slen : flen,
+                                                  decoded, nthreads,
+                                                  latencies);
+            double mib = (double)PARALLEL_INPUT / (1024.0 * 1024.0) /
+                         (ns / 1e9);
+            char threads[16];
+
+            if (p < 0)
+            {
+                single_ns = ns;
+                strcpy(threads, "stream");
+            }
+            else
+                snprintf(threads, sizeof(threads), "%d", nthreads);
+
+            if (markdown)
+                printf("| %-10s | %7s | %8.1f | %9.2f | %17.2fx |\n",
+                       itype->name, threads, mib, ns / 1e6, single_ns / ns);
+            else
+                printf("%-12s %8s %10.1f %10.2f %18.2fx\n",
+                       itype->name, threads, mib, ns / 1e6, single_ns / ns);
+        }
+
+        if (!have_range)
+            continue;
+        whole_ns[t] = median_range_ns(true, ctx, output, flen, decoded,
+                                      range, latencies);
+        range_ns[t] = median_range_ns(false, ctx, output, flen, decoded,
+                                      range, latencies);
+    }
+
+    if (!have_range)
+        fprintf(stderr, "%s: no pglz_decompress_frame_range(), "
+                "skipping range reads\n", variant);
+    else if (markdown)
+    {
+        printf("\n### %s: %s reads at random offsets of a %s frame\n\n",
+               variant, fmt_size(PARALLEL_READ_SIZE), fmt_size(PARALLEL_INPUT));
+        printf("| Type | Whole frame us | Range us | Speedup |\n");
+        printf("|------|----------------|----------|---------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: %s reads at random offsets of a %s frame ===\n\n",
+               variant, fmt_size(PARALLEL_READ_SIZE), fmt_size(PARALLEL_INPUT));
+        printf("%-12s %15s %10s %10s\n", "Type", "Whole frame us",
+               "Range us", "Speedup");
+        printf("%-12s %15s %10s %10s\n", "----", "--------------",
+               "--------", "-------");
+    }
+    for (int t = 0; t < (int)NUM_TYPES; t++)
+    {
+        if (whole_ns[t] < 0)
+            continue;
+        if (markdown)
+            printf("| %-10s | %14.1f | %8.1f | %6.0fx |\n",
+                   input_types[t].name, whole_ns[t] / 1000.0,
+                   range_ns[t] / 1000.0, whole_ns[t] / range_ns[t]);
+        else
+            printf("%-12s %15.1f %10.1f %9.0fx\n",
+                   input_types[t].name, whole_ns[t] / 1000.0,
+                   range_ns[t] / 1000.0, whole_ns[t] / range_ns[t]);
+    }
+
+    pglz_context_free(ctx);
+    free(stream);
+    free(decoded);
+    free(range);
+}
+
+static int
+run_parallel_mode(const char *variant, bool markdown, int64_t *latencies)
+{
+    if (pglz_compress_parallel == NULL)
+    {
+        fprintf(stderr, "%s: no pglz_compress_parallel(), "
+                "skipping parallel mode\n", variant);
+        return 0;
+    }
+
+    char *input = malloc(PARALLEL_INPUT);
+    char *output = malloc(PGLZ_FRAME_MAX_OUTPUT(PARALLEL_INPUT));
+
+    if (!input || !output)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (markdown)
+    {
+        printf("\n### %s: parallel frames, %s inputs\n\n", variant,
+               fmt_size(PARALLEL_INPUT));
+        printf("| Type | Threads | Compressed | Ratio | MiB/s | Median ms | vs pglz_compress |\n");
+        printf("|------|---------|-----------|-------|-------|-----------|------------------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: parallel frames, %s inputs ===\n\n", variant,
+               fmt_size(PARALLEL_INPUT));
+        printf("%-12s %8s %10s %10s %10s %10s %17s\n",
+               "Type", "Threads", "CSize", "Ratio", "MiB/s", "Med(ms)",
+               "vs pglz_compress");
+        printf("%-12s %8s %10s %10s %10s %10s %17s\n",
+               "----", "-------", "-----", "-----", "-----", "-------",
+               "----------------");
+    }
+
+    for (int t = 0; t < (int)NUM_TYPES; t++)
+    {
+        const InputType *itype = &input_types[t];
+        double single_ns = 0;
+
+        itype->generate(input, PARALLEL_INPUT);
+
+        /* Row -1 is the single-stream baseline */
+        for (int p = -1; p < (int)NUM_PARALLEL_THREADS; p++)
+        {
+            int nthreads = (p < 0) ? 0 : parallel_threads[p];
+            int32 clen;
+            double ns = median_parallel_ns(input, output, nthreads,
+                                           latencies, &clen);
+            double mib = (double)PARALLEL_INPUT / (1024.0 * 1024.0) /
+                         (ns / 1e9);
+            char threads[16], csize[16], ratio[16];
+
+            if (p < 0)
+            {
+                single_ns = ns;
+                strcpy(threads, "stream");
+            }
+            else
+                snprintf(threads, sizeof(threads), "%d", nthreads);
+            if (clen >= 0)
+            {
+                snprintf(csize, sizeof(csize), "%d", clen);
+                snprintf(ratio, sizeof(ratio), "%.2f%%",
+                         (double)clen / PARALLEL_INPUT * 100.0);
+            }
+            else
+            {
+                strcpy(csize, "FAIL");
+                strcpy(ratio, "N/A");
+            }
+
+            if (markdown)
+                printf("| %-10s | %7s | %9s | %6s | %8.1f | %9.2f | %15.2fx |\n",
+                       itype->name, threads, csize, ratio, mib, ns / 1e6,
+                       single_ns / ns);
+            else
+                printf("%-12s %8s %10s %10s %10.1f %10.2f %16.2fx\n",
+                       itype->name, threads, csize, ratio, mib, ns / 1e6,
+                       single_ns / ns);
+        }
+    }
+
+    if (pglz_decompress_parallel != NULL)
+        run_parallel_decode(variant, markdown, latencies, input, output);
+
+    free(input);
+    free(output);
+    return 0;
+}
+
+/* ----------
+ * Batch mode
+ *
+ * Many small datums back to back, as in COPY or WAL generation: one
+ * 200 KiB pgbench buffer cut into BATCH_SIZE rows of BATCH_DATUM bytes,
+ * each compressed into its own output slot.  Reports the median cost per
+ * datum of compressing the whole batch with
+ *   loop   pglz_compress() per datum
+ *   ctx    pglz_compress_ctx() per datum, one PGLZ_CTX_GENERATIONS context
+ *   batch  one pglz_compress_batch() call
+ * ----------
+ */
+#define BATCH_SIZE      100
+#define BATCH_DATUM     2048
+
+typedef enum
+{
+    BATCH_LOOP,
+    BATCH_CTX,
+    BATCH_CALL
+} BatchMethod;
+
+static void
+compress_batch_once(BatchMethod method, PGLZ_Context *ctx, const char **srcs,
+                    const int32 *lens, char **dests, int32 *out_lens)
+{
+    switch (method)
+    {
+        case BATCH_LOOP:
+            for (int i = 0; i < BATCH_SIZE; i++)
+                out_lens[i] = pglz_compress(srcs[i], lens[i], dests[i],
+                                            PGLZ_strategy_default);
+            break;
+        case BATCH_CTX:
+            for (int i = 0; i < BATCH_SIZE; i++)
+                out_lens[i] = pglz_compress_ctx(ctx, srcs[i], lens[i],
+                                                dests[i],
+                                                PGLZ_strategy_default);
+            break;
+        case BATCH_CALL:
+            pglz_compress_batch(srcs, lens, dests, out_lens, BATCH_SIZE,
+                                PGLZ_strategy_default);
+            break;
+    }
+}
+
+/* Median ns per datum of compressing the whole batch with method */
+static double
+median_batch_ns(BatchMethod method, PGLZ_Context *ctx, const char **srcs,
+                const int32 *lens, char **dests, int32 *out_lens,
+                int64_t *latencies)
+{
+    int iters = 0;
+    int64_t total_ns = 0;
+
+    /* Warmup: each batch is already BATCH_SIZE calls */
+    for (int i = 0; i < WARMUP_ITERS / 10; i++)
+        compress_batch_once(method, ctx, srcs, lens, dests, out_lens);
+
+    while (iters < MAX_ITERS)
+    {
+        int64_t t0 = now_ns();
+        compress_batch_once(method, ctx, srcs, lens, dests, out_lens);
+        int64_t t1 = now_ns();
+
+        latencies[iters] = t1 - t0;
+        total_ns += (t1 - t0);
+        iters++;
+
+        if (iters >= MIN_ITERS / 10 && total_ns >= min_bench_ns)
+            break;
+    }
+
+    qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+    return (double)latencies[iters / 2] / BATCH_SIZE;
+}
+
+static int
+run_batch_mode(const char *variant, bool markdown, int64_t *latencies)
+{
+    char *pool = malloc(BATCH_SIZE * BATCH_DATUM);
+    char *outpool = malloc(BATCH_SIZE * PGLZ_MAX_OUTPUT(BATCH_DATUM));
+    const char *srcs[BATCH_SIZE];
+    char *dests[BATCH_SIZE];
+    int32 lens[BATCH_SIZE];
+    int32 out_lens[BATCH_SIZE];
+    PGLZ_Context *ctx = NULL;
+    static const char *const method_names[] = { "loop", "ctx", "batch" };
+    double ns[3];
+    int64_t total_out = 0;
+
+    if (!pool || !outpool)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    gen_pgbench(pool, BATCH_SIZE * BATCH_DATUM);
+    for (int i = 0; i < BATCH_SIZE; i++)
+    {
+        srcs[i] = pool + i * BATCH_DATUM;
+        lens[i] = BATCH_DATUM;
+        dests[i] = outpool + i * PGLZ_MAX_OUTPUT(BATCH_DATUM);
+    }
+
+    if (pglz_context_create_extended != NULL)
+        ctx = pglz_context_create_extended(PGLZ_CTX_GENERATIONS);
+
+    for (int m = 0; m < 3; m++)
+    {
+        if ((m == BATCH_CTX && ctx == NULL) ||
+            (m == BATCH_CALL && pglz_compress_batch == NULL))
+        {
+            ns[m] = -1;
+            continue;
+        }
+        ns[m] = median_batch_ns((BatchMethod) m, ctx, srcs, lens, dests,
+                                out_lens, latencies);
+    }
+
+    for (int i = 0; i < BATCH_SIZE; i++)
+        total_out += (out_lens[i] >= 0) ? out_lens[i] : lens[i];
+
+    if (markdown)
+    {
+        printf("\n### %s: batch of %d x %s pgbench rows (%.2f%% stored)\n\n",
+               variant, BATCH_SIZE, fmt_size(BATCH_DATUM),
+               (double)total_out / (BATCH_SIZE * BATCH_DATUM) * 100.0);
+        printf("| Method | ns/datum | MiB/s | vs loop |\n");
+        printf("|--------|----------|-------|---------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: batch of %d x %s pgbench rows (%.2f%% stored) ===\n\n",
+               variant, BATCH_SIZE, fmt_size(BATCH_DATUM),
+               (double)total_out / (BATCH_SIZE * BATCH_DATUM) * 100.0);
+        printf("%-8s %10s %10s %10s\n", "Method", "ns/datum", "MiB/s",
+               "vs loop");
+        printf("%-8s %10s %10s %10s\n", "------", "--------", "-----",
+               "-------");
+    }
+
+    for (int m = 0; m < 3; m++)
+    {
+        if (ns[m] < 0)
+        {
+            if (markdown)
+                printf("| %-6s | %8s | %5s | %7s |\n", method_names[m],
+                       "n/a", "n/a", "n/a");
+            else
+                printf("%-8s %10s %10s %10s\n", method_names[m], "n/a",
+                       "n/a", "n/a");
+            continue;
+        }
+
+        double mib = BATCH_DATUM / (1024.0 * 1024.0) / (ns[m] / 1e9);
+        double delta = (ns[m] - ns[BATCH_LOOP]) / ns[BATCH_LOOP] * 100.0;
+
+        if (markdown)
+            printf("| %-6s | %8.1f | %5.1f | %+6.1f%% |\n", method_names[m],
+                   ns[m], mib, delta);
+        else
+            printf("%-8s %10.1f %10.1f %+9.1f%%\n", method_names[m], ns[m],
+                   mib, delta);
+    }
+
+    if (ctx)
+        pglz_context_free(ctx);
+    free(pool);
+    free(outpool);
+    return 0;
+}
+
+/* ----------
+ * Stream mode
+ *
+ * 1 MiB inputs: one pglz_compress() call on the whole buffer against
+ * feeding it to pglz_stream_update() in pieces of STREAM_PIECES bytes,
+ * each piece's output going to the same small buffer, as a producer
+ * writing to a socket or file would.  The decode table does the same for
+ * pglz_decompress() against pglz_decode_update() fed the compressed data
+ * in DECODE_PIECES pieces; 1996 bytes is the toast chunk size with 8 KiB
+ * pages.  MiB/s is from the median time of processing the whole input.
+ * ----------
+ */
+#define STREAM_INPUT        1048576
+
+static const int stream_pieces[] = { 8192, 65536 };
+static const int decode_pieces[] = { 1996, 65536 };
+#define NUM_STREAM_PIECES \
+    (sizeof(stream_pieces) / sizeof(stream_pieces[0]))
+
+static int32
+compress_stream_once(const char *input, int piece, char *output)
+{
+    PGLZ_Stream *stream = pglz_stream_begin(PGLZ_strategy_always);
+    int32 total = 0;
+
+    if (stream == NULL)
+        return -1;
+    for (int off = 0; off < STREAM_INPUT; off += piece)
+    {
+        int n = STREAM_INPUT - off < piece ? STREAM_INPUT - off : piece;
+
+        total += pglz_stream_update(stream, input + off, n, output);
+    }
+    return total + pglz_stream_end(stream, output);
+}
+
+static int32
+decode_stream_once(const char *compressed, int32 clen, int piece,
+                   char *output)
+{
+    PGLZ_DecodeStream *stream = pglz_decode_begin(output, STREAM_INPUT);
+
+    if (stream == NULL)
+        return -1;
+    for (int off = 0; off < clen; off += piece)
+        pglz_decode_update(stream, compressed + off,
+                           clen - off < piece ? clen - off : piece);
+    return pglz_decode_end(stream, true);
+}
+
+/*
+ * Median ns of one pass over the input; piece 0 = one-shot call.  With
+ * decode, compressed holds clen bytes to decompress into output; else
+ * input is compressed into output and *result is the compressed size.
+ */
+static double
+median_stream_ns(bool decode, const char *input, const char *compressed,
+                 int32 clen, char *output, int piece, int64_t *latencies,
+                 int32 *result)
+{
+    int iters = 0;
+    int64_t total_ns = 0;
+
+    while (iters < MAX_ITERS)
+    {
+        int64_t t0 = now_ns();
+        if (decode && piece == 0)
+            *result = pglz_decompress(compressed, clen, output,
+                                      STREAM_INPUT, true);
+        else if (decode)
+            *result = decode_stream_once(compressed, clen, piece, output);
+        else if (piece == 0)
+            *result = pglz_compress(input, STREAM_INPUT, output,
+                                    PGLZ_strategy_always);
+        else
+            *result = compress_stream_once(input, piece, output);
+        int64_t t1 = now_ns();
+
+        latencies[iters] = t1 - t0;
+        total_ns += (t1 - t0);
+        iters++;
+
+        if (iters >= MIN_ITERS / 10 && total_ns >= min_bench_ns)
+            break;
+    }
+
+    qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+    return latencies[iters / 2];
+}
+
+static void
+print_stream_header(const char *variant, bool markdown, bool decode)
+{
+    const char *what = decode ? "decompression" : "compression";
+    const char *vs = decode ? "vs pglz_decompress" : "vs pglz_compress";
+
+    if (markdown)
+    {
+        printf("\n### %s: streaming %s, %s inputs\n\n", variant, what,
+               fmt_size(STREAM_INPUT));
+        printf("| Type | Pieces | Compressed | Ratio | MiB/s | Median ms | %s |\n",
+               vs);
+        printf("|------|--------|-----------|-------|-------|-----------|--------------------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: streaming %s, %s inputs ===\n\n", variant, what,
+               fmt_size(STREAM_INPUT));
+        printf("%-12s %8s %10s %10s %10s %10s %19s\n",
+               "Type", "Pieces", "CSize", "Ratio", "MiB/s", "Med(ms)", vs);
+        printf("%-12s %8s %10s %10s %10s %10s %19s\n",
+               "----", "------", "-----", "-----", "-----", "-------",
+               "------------------");
+    }
+}
+
+static int
+run_stream_mode(const char *variant, bool markdown, int64_t *latencies)
+{
+    if (pglz_stream_begin == NULL)
+    {
+        fprintf(stderr, "%s: no pglz_stream_begin(), "
+                "skipping stream mode\n", variant);
+        return 0;
+    }
+
+    char *input = malloc(STREAM_INPUT);
+    char *output = malloc(PGLZ_STREAM_MAX_OUTPUT(STREAM_INPUT));
+    char *compressed = malloc(PGLZ_MAX_OUTPUT(STREAM_INPUT));
+
+    if (!input || !output || !compressed)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for (int d = 0; d < 2; d++)
+    {
+        bool decode = (d == 1);
+        const int *pieces_list = decode ? decode_pieces : stream_pieces;
+
+        if (decode && pglz_decode_begin == NULL)
+        {
+            fprintf(stderr, "%s: no pglz_decode_begin(), "
+                    "skipping stream decoding\n", variant);
+            break;
+        }
+        print_stream_header(variant, markdown, decode);
+
+        for (int t = 0; t < (int)NUM_TYPES; t++)
+        {
+            const InputType *itype = &input_types[t];
+            int32 clen;
+            double whole_ns = 0;
+
+            itype->generate(input, STREAM_INPUT);
+            clen = pglz_compress(input, STREAM_INPUT, compressed,
+                                 PGLZ_strategy_always);
+            if (decode && clen < 0)
+                continue;       /* nothing to decode */
+
+            /* Row -1 is the one-shot baseline */
+            for (int p = -1; p < (int)NUM_STREAM_PIECES; p++)
+            {
+                int piece = (p < 0) ? 0 : pieces_list[p];
+                int32 result;
+                double ns = median_stream_ns(decode, input, compressed, clen,
+                                             output, piece, latencies,
+                                             &result);
+                double mib = (double)STREAM_INPUT / (1024.0 * 1024.0) /
+                             (ns / 1e9);
+                int32 csize_val = decode ? clen : result;
+                char pieces[16], csize[16], ratio[16];
+
+                if (p < 0)
+                {
+                    whole_ns = ns;
+                    strcpy(pieces, "whole");
+                }
+                else if (piece % 1024 != 0)
+                    snprintf(pieces, sizeof(pieces), "%dB", piece);
+                else
+                    snprintf(pieces, sizeof(pieces), "%s", fmt_size(piece));
+                if (csize_val >= 0 && (!decode || result == STREAM_INPUT))
+                {
+                    snprintf(csize, sizeof(csize), "%d", csize_val);
+                    snprintf(ratio, sizeof(ratio), "%.2f%%",
+                             (double)csize_val / STREAM_INPUT * 100.0);
+                }
+                else
+                {
+                    strcpy(csize, "FAIL");
+                    strcpy(ratio, "N/A");
+                }
+
+                if (markdown)
+                    printf("| %-10s | %6s | %9s | %6s | %8.1f | %9.2f | %17.2fx |\n",
+                           itype->name, pieces, csize, ratio, mib, ns / 1e6,
+                           whole_ns / ns);
+                else
+                    printf("%-12s %8s %10s %10s %10.1f %10.2f %18.2fx\n",
+                           itype->name, pieces, csize, ratio, mib, ns / 1e6,
+                           whole_ns / ns);
+            }
+        }
+    }
+
+    free(input);
+    free(output);
+    free(compressed);
+    return 0;
+}
+
+/* ----------
+ * Level mode: what lazy matching buys.  Each row compresses through
+ * pglz_compress_ext: "greedy" is PGLZ_strategy_always with the default
+ * skip settings (the same output as pglz_compress), "lazy1" and "lazy2"
+ * add lazy_steps, and "archive" is PGLZ_strategy_archive.  Every output
+ * is decompressed and checked; the speeds are from the median call.
+ * ----------
+ */
+static const int level_sizes[] = { 4096, 65536, 1048576 };
+#define NUM_LEVEL_SIZES (sizeof(level_sizes) / sizeof(level_sizes[0]))
+#define NUM_LEVELS      4
+
+/*
+ * Median ns of one call.  With decode, compressed holds clen bytes to
+ * decompress into output; else input is compressed into output with
+ * strategy and *result is the compressed size.
+ */
+static double
+median_level_ns(bool decode, const PGLZ_StrategyExt *strategy,
+                const char *input, int size, const char *compressed,
+                int32 clen, char *output, int64_t *latencies, int32 *result)
+{
+    int iters = 0;
+    int64_t total_ns = 0;
+
+    for (int i = 0; i < WARMUP_ITERS / 10; i++)
+    {
+        if (decode)
+            *result = pglz_decompress(compressed, clen, output, size, true);
+        else
+            *result = pglz_compress_ext(input, size, output, strategy);
+    }
+
+    while (iters < MAX_ITERS)
+    {
+        int64_t t0 = now_ns();
+        if (decode)
+            *result = pglz_decompress(compressed, clen, output, size, true);
+        else
+            *result = pglz_compress_ext(input, size, output, strategy);
+        int64_t t1 = now_ns();
+
+        latencies[iters] = t1 - t0;
+        total_ns += (t1 - t0);
+        iters++;
+
+        if (iters >= MIN_ITERS / 10 && total_ns >= min_bench_ns)
+            break;
+    }
+
+    qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+    return latencies[iters / 2];
+}
+
+static int
+run_level_mode(const char *variant, bool markdown, int64_t *latencies)
+{
+    static const char *const level_names[NUM_LEVELS] = {
+        "greedy", "lazy1", "lazy2", "archive"
+    };
+    PGLZ_StrategyExt levels[NUM_LEVELS];
+    int max_size = level_sizes[NUM_LEVEL_SIZES - 1];
+    int rc = 0;
+
+    if (pglz_compress_ext == NULL || &PGLZ_strategy_archive == NULL)
+    {
+        fprintf(stderr, "%s: no lazy matching, skipping level mode\n",
+                variant);
+        return 0;
+    }
+
+    for (int l = 0; l < NUM_LEVELS - 1; l++)
+    {
+        memset(&levels[l], 0, sizeof(levels[l]));
+        levels[l].base = *PGLZ_strategy_always;
+        levels[l].skip_threshold = PGLZ_SKIP_THRESHOLD_DEFAULT;
+        levels[l].skip_rate = PGLZ_SKIP_RATE_DEFAULT;
+        levels[l].lazy_steps = l;
+    }
+    levels[NUM_LEVELS - 1] = *PGLZ_strategy_archive;
+
+    char *input = malloc(max_size);
+    char *compressed = malloc(PGLZ_MAX_OUTPUT(max_size));
+    char *output = malloc(max_size);
+
+    if (!input || !compressed || !output)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (markdown)
+    {
+        printf("\n### %s: greedy vs lazy matching\n\n", variant);
+        printf("| Type | Size | Level | Compressed | Ratio | Comp MiB/s | vs greedy | Decomp MiB/s |\n");
+        printf("|------|------|-------|-----------|-------|------------|-----------|--------------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: greedy vs lazy matching ===\n\n", variant);
+        printf("%-12s %6s %8s %10s %8s %11s %10s %13s\n",
+               "Type", "Size", "Level", "CSize", "Ratio", "Comp MiB/s",
+               "vs greedy", "Decomp MiB/s");
+        printf("%-12s %6s %8s %10s %8s %11s %10s %13s\n",
+               "----", "----", "-----", "-----", "-----", "----------",
+               "---------", "------------");
+    }
+
+    for (int t = 0; t < (int)NUM_TYPES; t++)
+    {
+        const InputType *itype = &input_types[t];
+
+        for (int s = 0; s < (int)NUM_LEVEL_SIZES; s++)
+        {
+            int size = level_sizes[s];
+            double greedy_ns = 0;
+
+            itype->generate(input, size);
+            for (int l = 0; l < NUM_LEVELS; l++)
+            {
+                int32 clen;
+                int32 dlen;
+                double ns = median_level_ns(false, &levels[l], input, size,
+                                            NULL, 0, compressed, latencies,
+                                            &clen);
+                double mib = (double)size / (1024.0 * 1024.0) / (ns / 1e9);
+                char csize[16], ratio[16], dmib[16];
+
+                if (l == 0)
+                    greedy_ns = ns;
+                if (clen >= 0)
+                {
+                    double dns = median_level_ns(true, NULL, NULL, size,
+                                                 compressed, clen, output,
+                                                 latencies, &dlen);
+
+                    if (dlen != size || memcmp(input, output, size) != 0)
+                    {
+                        fprintf(stderr, "ROUNDTRIP FAILURE: %s %s level %s\n",
+                                itype->name, fmt_size(size), level_names[l]);
+                        rc = 1;
+                    }
+                    snprintf(csize, sizeof(csize), "%d", clen);
+                    snprintf(ratio, sizeof(ratio), "%.2f%%",
+                             (double)clen / size * 100.0);
+                    snprintf(dmib, sizeof(dmib), "%.1f",
+                             (double)size / (1024.0 * 1024.0) / (dns / 1e9));
+                }
+                else
+                {
+                    strcpy(csize, "FAIL");
+                    strcpy(ratio, "N/A");
+                    strcpy(dmib, "N/A");
+                }
+
+                if (markdown)
+                    printf("| %-10s | %4s | %-7s | %9s | %6s | %10.1f | %8.2fx | %12s |\n",
+                           itype->name, fmt_size(size), level_names[l], csize,
+                           ratio, mib, greedy_ns / ns, dmib);
+                else
+                    printf("%-12s %6s %8s %10s %8s %11.1f %9.2fx %13s\n",
+                           itype->name, fmt_size(size), level_names[l], csize,
+                           ratio, mib, greedy_ns / ns, dmib);
+            }
+        }
+    }
+
+    free(input);
+    free(compressed);
+    free(output);
+    return rc;
+}
+
+/* ----------
+ * Engine mode: chains vs fixed-width buckets.  Each row compresses
+ * through pglz_compress_ext with PGLZ_strategy_always and the default skip
+ * settings; "chain" leaves bucket_ways at 0 (the same output as
+ * pglz_compress), the others set it.  Every output is decompressed and
+ * checked; the speed is from the median call.
+ * ----------
+ */
+static const int engine_sizes[] = { 2048, 4096, 65536, 1048576 };
+#define NUM_ENGINE_SIZES (sizeof(engine_sizes) / sizeof(engine_sizes[0]))
+#define NUM_ENGINES      4
+
+static int
+run_engine_mode(const char *variant, bool markdown, int64_t *latencies)
+{
+    static const char *const engine_names[NUM_ENGINES] = {
+        "chain", "2-way", "4-way", "8-way"
+    };
+    static const int engine_ways[NUM_ENGINES] = { 0, 2, 4, 8 };
+    PGLZ_StrategyExt engines[NUM_ENGINES];
+    int max_size = engine_sizes[NUM_ENGINE_SIZES - 1];
+    int rc = 0;
+
+    if (pglz_compress_ext == NULL || pglz_bucket_ways == NULL)
+    {
+        fprintf(stderr, "%s: no bucket match finder, skipping engine mode\n",
+                variant);
+        return 0;
+    }
+
+    for (int e = 0; e < NUM_ENGINES; e++)
+    {
+        memset(&engines[e], 0, sizeof(engines[e]));
+        engines[e].base = *PGLZ_strategy_always;
+        engines[e].skip_threshold = PGLZ_SKIP_THRESHOLD_DEFAULT;
+        engines[e].skip_rate = PGLZ_SKIP_RATE_DEFAULT;
+        engines[e].bucket_ways = engine_ways[e];
+    }
+
+    char *input = malloc(max_size);
+    char *compressed = malloc(PGLZ_MAX_OUTPUT(max_size));
+    char *output = malloc(max_size);
+
+    if (!input || !compressed || !output)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (markdown)
+    {
+        printf("\n### %s: chained history vs bucket match finder\n\n", variant);
+        printf("| Type | Size | Engine | Compressed | Ratio | Comp MiB/s | vs chain |\n");
+        printf("|------|------|--------|-----------|-------|------------|----------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: chained history vs bucket match finder ===\n\n",
+               variant);
+        printf("%-12s %6s %8s %10s %8s %11s %10s\n",
+               "Type", "Size", "Engine", "CSize", "Ratio", "Comp MiB/s",
+               "vs chain");
+        printf("%-12s %6s %8s %10s %8s %11s %10s\n",
+               "----", "----", "------", "-----", "-----", "----------",
+               "--------");
+    }
+
+    for (int t = 0; t < (int)NUM_TYPES; t++)
+    {
+        const InputType *itype = &input_types[t];
+
+        for (int s = 0; s < (int)NUM_ENGINE_SIZES; s++)
+        {
+            int size = engine_sizes[s];
+            double chain_ns = 0;
+
+            itype->generate(input, size);
+            for (int e = 0; e < NUM_ENGINES; e++)
+            {
+                int32 clen;
+                double ns = median_level_ns(false, &engines[e], input, size,
+                                            NULL, 0, compressed, latencies,
+                                            &clen);
+                double mib = (double)size / (1024.0 * 1024.0) / (ns / 1e9);
+                char csize[16], ratio[16];
+
+                if (e == 0)
+                    chain_ns = ns;
+                if (clen >= 0)
+                {
+                    int32 dlen = pglz_decompress(compressed, clen, output,
+                                                 size, true);
+
+                    if (dlen != size || memcmp(input, output, size) != 0)
+                    {
+                        fprintf(stderr, "ROUNDTRIP FAILURE: %s %s engine %s\n",
+                                itype->name, fmt_size(size), engine_names[e]);
+                        rc = 1;
+                    }
+                    snprintf(csize, sizeof(csize), "%d", clen);
+                    snprintf(ratio, sizeof(ratio), "%.2f%%",
+                             (double)clen / size * 100.0);
+                }
+                else
+                {
+                    strcpy(csize, "FAIL");
+                    strcpy(ratio, "N/A");
+                }
+
+                if (markdown)
+                    printf("| %-10s | %4s | %-6s | %9s | %6s | %10.1f | %7.2fx |\n",
+                           itype->name, fmt_size(size), engine_names[e], csize,
+                           ratio, mib, chain_ns / ns);
+                else
+                    printf("%-12s %6s %8s %10s %8s %11.1f %9.2fx\n",
+                           itype->name, fmt_size(size), engine_names[e], csize,
+                           ratio, mib, chain_ns / ns);
+            }
+        }
+    }
+
+    free(input);
+    free(compressed);
+    free(output);
+    return rc;
+}
+
+/* ----------
+ * Alloc mode: what do per-call buffers cost?  Each roundtrip compresses
+ * with PGLZ_strategy_always through one context and decompresses what
+ * compressed, either into buffers malloc()ed and freed per call, as most
+ * callers do, or into the context's own buffers.  The context gets its
+ * memory through counting callbacks, so "steady" is every allocation
+ * pglz made over the timed calls, divided by their number; "first" is
+ * what the first call after creating the context allocated.
+ * ----------
+ */
+static const int alloc_sizes[] = { 4096, 65536, 1048576 };
+#define NUM_ALLOC_SIZES (sizeof(alloc_sizes) / sizeof(alloc_sizes[0]))
+
+static int64_t bench_allocs;
+
+static void *
+counting_alloc(size_t size, void *arg)
+{
+    bench_allocs++;
+    return malloc(size);
+}
+
+static void
+counting_free(void *ptr, size_t size, void *arg)
+{
+    free(ptr);
+}
+
+/* One roundtrip; false if it fails to reproduce input */
+static bool
+alloc_roundtrip(PGLZ_Context *ctx, bool context_buffers, const char *input,
+                int size)
+{
+    char *compressed;
+    char *output;
+    bool ok = true;
+
+    if (context_buffers)
+    {
+        compressed = pglz_context_output_buffer(ctx, size);
+        output = pglz_context_raw_buffer(ctx, size);
+    }
+    else
+    {
+        bench_allocs += 2;
+        compressed = malloc(PGLZ_MAX_OUTPUT(size));
+        output = malloc(size);
+    }
+    if (!compressed || !output)
+        ok = false;
+    else
+    {
+        int32 clen = pglz_compress_ctx(ctx, input, size, compressed,
+                                       PGLZ_strategy_always);
+
+        if (clen >= 0)
+            ok = pglz_decompress(compressed, clen, output, size, true) == size &&
+                 memcmp(input, output, size) == 0;
+    }
+    if (!context_buffers)
+    {
+        free(compressed);
+        free(output);
+    }
+    return ok;
+}
+
+static int
+run_alloc_mode(const char *variant, bool markdown, int64_t *latencies)
+{
+    static const char *const buffer_names[2] = { "malloc", "context" };
+    PGLZ_Allocator allocator = { counting_alloc, counting_free, NULL };
+    int max_size = alloc_sizes[NUM_ALLOC_SIZES - 1];
+    int rc = 0;
+
+    if (pglz_context_create_allocator == NULL)
+    {
+        fprintf(stderr, "%s: no context buffers, skipping alloc mode\n",
+                variant);
+        return 0;
+    }
+
+    char *input = malloc(max_size);
+    if (!input)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (markdown)
+    {
+        printf("\n### %s: per-call buffers vs context buffers\n\n", variant);
+        printf("| Type | Size | Buffers | Allocs first | Allocs/call | Roundtrip us | MiB/s | vs malloc |\n");
+        printf("|------|------|---------|--------------|-------------|--------------|-------|-----------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: per-call buffers vs context buffers ===\n\n",
+               variant);
+        printf("%-12s %6s %8s %7s %8s %13s %9s %10s\n",
+               "Type", "Size", "Buffers", "First", "Steady", "Roundtrip us",
+               "MiB/s", "vs malloc");
+        printf("%-12s %6s %8s %7s %8s %13s %9s %10s\n",
+               "----", "----", "-------", "-----", "------", "------------",
+               "-----", "---------");
+    }
+
+    for (int t = 0; t < (int)NUM_TYPES; t++)
+    {
+        const InputType *itype = &input_types[t];
+
+        for (int s = 0; s < (int)NUM_ALLOC_SIZES; s++)
+        {
+            int size = alloc_sizes[s];
+            double malloc_ns = 0;
+
+            itype->generate(input, size);
+            for (int b = 0; b < 2; b++)
+            {
+                PGLZ_Context *ctx =
+                    pglz_context_create_allocator(PGLZ_CTX_GENERATIONS,
+                                                  &allocator);
+                bool ok = ctx != NULL;
+                int64_t first;
+                int64_t steady;
+                int64_t total_ns = 0;
+                int iters = 0;
+
+                if (!ok)
+                {
+                    fprintf(stderr, "Out of memory\n");
+                    free(input);
+                    return 1;
+                }
+
+                bench_allocs = 0;
+                ok &= alloc_roundtrip(ctx, b == 1, input, size);
+                first = bench_allocs;
+                for (int i = 0; i < WARMUP_ITERS / 10; i++)
+                    ok &= alloc_roundtrip(ctx, b == 1, input, size);
+
+                bench_allocs = 0;
+                while (iters < MAX_ITERS)
+                {
+                    int64_t t0 = now_ns();
+                    ok &= alloc_roundtrip(ctx, b == 1, input, size);
+                    int64_t t1 = now_ns();
+
+                    latencies[iters] = t1 - t0;
+                    total_ns += (t1 - t0);
+                    iters++;
+
+                    if (iters >= MIN_ITERS / 10 && total_ns >= min_bench_ns)
+                        break;
+                }
+                steady = bench_allocs;
+                pglz_context_free(ctx);
+
+                if (!ok)
+                {
+                    fprintf(stderr, "ROUNDTRIP FAILURE: %s %s with %s buffers\n",
+                            itype->name, fmt_size(size), buffer_names[b]);
+                    rc = 1;
+                }
+
+                qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+                double ns = latencies[iters / 2];
+                double mib = (double)size / (1024.0 * 1024.0) / (ns / 1e9);
+
+                if (b == 0)
+                    malloc_ns = ns;
+                if (markdown)
+                    printf("| %-10s | %4s | %-7s | %12lld | %11.2f | %12.1f | %5.0f | %8.2fx |\n",
+                           itype->name, fmt_size(size), buffer_names[b],
+                           (long long) first, (double) steady / iters,
+                           ns / 1000.0, mib, malloc_ns / ns);
+                else
+                    printf("%-12s %6s %8s %7lld %8.2f %13.1f %9.0f %9.2fx\n",
+                           itype->name, fmt_size(size), buffer_names[b],
+                           (long long) first, (double) steady / iters,
+                           ns / 1000.0, mib, malloc_ns / ns);
+            }
+        }
+    }
+
+    free(input);
+    return rc;
+}
+
+/* ----------
+ * Estimate mode: how good is pglz_estimate_ratio()?  For every input the
+ * real rate is what pglz_compress() with PGLZ_strategy_always saves (0
+ * when it fails), and the estimate is taken with several sample sizes.
+ * "Decision" is what a caller with PGLZ_strategy_default's min_comp_rate
+ * of 25% would make from the estimate: "ok" when it agrees with the real
+ * rate, "skip" when it skips a compression that would have made it,
+ * "waste" when it compresses what then misses the limit.  Both times are
+ * medians of one call.  "auto" is the default sample (sample_bytes 0).
+ * ----------
+ */
+static const int estimate_sizes[] = { 2048, 4096, 65536, 1048576 };
+static const int estimate_samples[] = { 0, 512, 2048, 8192 };
+#define NUM_ESTIMATE_SIZES   (sizeof(estimate_sizes) / sizeof(estimate_sizes[0]))
+#define NUM_ESTIMATE_SAMPLES (sizeof(estimate_samples) / sizeof(estimate_samples[0]))
+#define ESTIMATE_MIN_RATE    25
+
+/*
+ * Median ns of one call: with compress, of pglz_compress() into
+ * compressed, with *result the compressed size; else of
+ * pglz_estimate_ratio(), with *result the estimate.
+ */
+static double
+median_estimate_ns(bool compress, const char *input, int size, int sample,
+                   char *compressed, int64_t *latencies, int32 *result)
+{
+    int iters = 0;
+    int64_t total_ns = 0;
+
+    for (int i = 0; i < WARMUP_ITERS / 10; i++)
+    {
+        if (compress)
+            *result = pglz_compress(input, size, compressed,
+                                    PGLZ_strategy_always);
+        else
+            *result = pglz_estimate_ratio(input, size, sample);
+    }
+
+    while (iters < MAX_ITERS)
+    {
+        int64_t t0 = now_ns();
+        if (compress)
+            *result = pglz_compress(input, size, compressed,
+                                    PGLZ_strategy_always);
+        else
+            *result = pglz_estimate_ratio(input, size, sample);
+        int64_t t1 = now_ns();
+
+        latencies[iters] = t1 - t0;
+        total_ns += (t1 - t0);
+        iters++;
+
+        if (iters >= MIN_ITERS / 10 && total_ns >= min_bench_ns / 4)
+            break;
+    }
+
+    qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+    return latencies[iters / 2];
+}
+
+static int
+run_estimate_mode(const char *variant, bool markdown, int64_t *latencies)
+{
+    int max_size = estimate_sizes[NUM_ESTIMATE_SIZES - 1];
+    double abs_err = 0;
+    int nrows = 0;
+    int agreed = 0;
+
+    if (pglz_estimate_ratio == NULL)
+    {
+        fprintf(stderr, "%s: no pglz_estimate_ratio, skipping estimate mode\n",
+                variant);
+        return 0;
+    }
+
+    char *input = malloc(max_size);
+    char *compressed = malloc(PGLZ_MAX_OUTPUT(max_size));
+
+    if (!input || !compressed)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (markdown)
+    {
+        printf("\n### %s: estimated vs real compression rate\n\n", variant);
+        printf("| Type | Size | Sample | Real | Estimate | Error | Est us | Comp us | Decision |\n");
+        printf("|------|------|--------|------|----------|-------|--------|---------|----------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: estimated vs real compression rate ===\n\n",
+               variant);
+        printf("%-12s %6s %6s %6s %8s %6s %8s %9s %8s\n",
+               "Type", "Size", "Sample", "Real", "Estimate", "Error",
+               "Est us", "Comp us", "Decision");
+        printf("%-12s %6s %6s %6s %8s %6s %8s %9s %8s\n",
+               "----", "----", "------", "----", "--------", "-----",
+               "------", "-------", "--------");
+    }
+
+    for (int t = 0; t < (int)NUM_TYPES; t++)
+    {
+        const InputType *itype = &input_types[t];
+
+        for (int s = 0; s < (int)NUM_ESTIMATE_SIZES; s++)
+        {
+            int size = estimate_sizes[s];
+            int32 clen;
+            double comp_ns;
+            int real;
+
+            itype->generate(input, size);
+            comp_ns = median_estimate_ns(true, input, size, 0, compressed,
+                                         latencies, &clen);
+            real = clen >= 0 ?
+                100 - (int)(((int64_t) clen * 100 + size - 1) / size) : 0;
+
+            for (int k = 0; k < (int)NUM_ESTIMATE_SAMPLES; k++)
+            {
+                int sample = estimate_samples[k];
+                int32 est;
+                double ns;
+                const char *decision;
+
+                const char *sample_name = sample ? fmt_size(sample) : "auto";
+
+                if (sample > size)
+                    continue;
+                ns = median_estimate_ns(false, input, size, sample, NULL,
+                                        latencies, &est);
+                if ((est >= ESTIMATE_MIN_RATE) == (real >= ESTIMATE_MIN_RATE))
+                    decision = "ok";
+                else
+                    decision = real >= ESTIMATE_MIN_RATE ? "skip" : "waste";
+                abs_err += abs(est - real);
+                agreed += decision[0] == 'o';
+                nrows++;
+
+                if (markdown)
+                    printf("| %-10s | %4s | %6s | %3d%% | %7d%% | %+4d | %6.1f | %7.1f | %-8s |\n",
+                           itype->name, fmt_size(size), sample_name,
+                           real, est, est - real, ns / 1000.0,
+                           comp_ns / 1000.0, decision);
+                else
+                    printf("%-12s %6s %6s %5d%% %7d%% %+6d %8.1f %9.1f %8s\n",
+                           itype->name, fmt_size(size), sample_name,
+                           real, est, est - real, ns / 1000.0,
+                           comp_ns / 1000.0, decision);
+            }
+        }
+    }
+
+    printf("\nMean absolute error %.1f points; %d of %d decisions at %d%% agree\n",
+           abs_err / nrows, agreed, nrows, ESTIMATE_MIN_RATE);
+
+    free(input);
+    free(compressed);
+    return 0;
+}
+
+/* ----------
+ * Dict mode: what a dictionary buys small, similar datums.  DICT_ROWS
+ * JSON documents and DICT_ROWS groups of pgbench_accounts rows, 300 to
+ * 800 bytes each, are compressed one by one with PGLZ_strategy_default
+ * through pglz_compress_ctx_dict(), without a dictionary and with the
+ * last 1 KiB and 4 KiB of other rows of the same kind, as a caller would
+ * train one.  "Stored" is the total output in percent of the input,
+ * counting rows that do not compress at their raw size; "Comp" is how
+ * many do.  The times are medians per row over the whole set, for
+ * compressing and for decompressing the rows that compressed.
+ * ----------
+ */
+#define DICT_ROWS           256
+#define DICT_ROW_MIN        300
+#define DICT_ROW_MAX        800
+
+static const int dict_sizes[] = { 0, 1024, PGLZ_DICT_MAX_SIZE };
+#define NUM_DICT_SIZES      (sizeof(dict_sizes) / sizeof(dict_sizes[0]))
+
+static const char *const dict_names[] = {
+    "alice", "bob", "carol", "dave", "erin", "frank", "grace", "heidi",
+    "ivan", "judy", "mallory", "oscar", "peggy", "trent", "victor", "wendy"
+};
+static const char *const dict_cities[] = {
+    "Berlin", "Lisbon", "Oslo", "Toronto", "Osaka", "Austin", "Nairobi",
+    "Santiago"
+};
+static const char *const dict_statuses[] = {
+    "active", "pending", "suspended", "closed"
+};
+
+#define DICT_PICK(array) ((array)[xorshift64() % \
+                                  (sizeof(array) / sizeof((array)[0]))])
+
+/*
+ * One JSON document of the shape an application keeps in a jsonb column,
+ * cut to a length of DICT_ROW_MIN..DICT_ROW_MAX by a free-text note.
+ */
+static int
+gen_dict_json(char *buf, int id)
+{
+    int target = DICT_ROW_MIN + (int)(xorshift64() % (DICT_ROW_MAX - DICT_ROW_MIN + 1));
+    const char *name = DICT_PICK(dict_names);
+    int len;
+
+    len = snprintf(buf, DICT_ROW_MAX,
+                   "{\"id\": %d, \"user\": {\"name\": \"%s\", \"email\": "
+                   "\"%s%d@example.com\", \"city\": \"%s\"}, \"status\": "
+                   "\"%s\", \"balance\": %d.%02d, \"created_at\": "
+                   "\"2024-%02d-%02dT%02d:%02d:%02dZ\", \"tags\": [\"%s\", "
+                   "\"%s\"], \"flags\": {\"verified\": %s, \"newsletter\": "
+                   "%s}, \"note\": \"",
+                   id, name, name, (int)(xorshift64() % 1000),
+                   DICT_PICK(dict_cities), DICT_PICK(dict_statuses),
+                   (int)(xorshift64() % 100000), (int)(xorshift64() % 100),
+                   (int)(xorshift64() % 12) + 1, (int)(xorshift64() % 28) + 1,
+                   (int)(xorshift64() % 24), (int)(xorshift64() % 60),
+                   (int)(xorshift64() % 60), DICT_PICK(dict_statuses),
+                   DICT_PICK(dict_cities),
+                   (xorshift64() & 1) ? "true" : "false",
+                   (xorshift64() & 1) ? "true" : "false");
+    while (len < target - 2)
+    {
+        const char *w = words[xorshift64() % 60];
+        int wlen = strlen(w);
+
+        if (len + wlen > target - 2)
+            wlen = target - 2 - len;
+        memcpy(buf + len, w, wlen);
+        len += wlen;
+    }
+    memcpy(buf + len, "\"}", 2);
+    return len + 2;
+}
+
+/* Consecutive pgbench_accounts rows as gen_pgbench() writes them */
+static int
+gen_dict_pgbench(char *buf, int id)
+{
+    int target = DICT_ROW_MIN + (int)(xorshift64() % (DICT_ROW_MAX - DICT_ROW_MIN + 1));
+    int len = 0;
+    int aid = id * 8 + 1;
+
+    while (len < target)
+    {
+        char row[128];
+        int rlen = snprintf(row, sizeof(row), "%d|%d|%d|", aid,
+                            (aid - 1) / 100000 + 1,
+                            (int)(xorshift64() % 200001) - 100000);
+
+        memset(row + rlen, ' ', 84);
+        rlen += 84;
+        row[rlen++] = '\n';
+        if (len + rlen > target)
+            rlen = target - len;
+        memcpy(buf + len, row, rlen);
+        len += rlen;
+        aid++;
+    }
+    return len;
+}
+
+/*
+ * Compress all rows (with compress), or decompress those that compressed
+ * and check that they come back whole.
+ */
+static void
+dict_pass(bool compress, PGLZ_Context *ctx, char *const *rows,
+          const int32 *lens, char *const *comp, int32 *clens, char *out,
+          const char *dict, int32 dictlen)
+{
+    for (int r = 0; r < DICT_ROWS; r++)
+    {
+        if (compress)
+            clens[r] = pglz_compress_ctx_dict(ctx, rows[r], lens[r], comp[r],
+                                              PGLZ_strategy_default,
+                                              dict, dictlen);
+        else if (clens[r] >= 0 &&
+                 (pglz_decompress_dict(comp[r], clens[r], out, lens[r], true,
+                                       dict, dictlen) != lens[r] ||
+                  memcmp(out, rows[r], lens[r]) != 0))
+        {
+            fprintf(stderr, "dict mode: row %d did not round-trip\n", r);
+            exit(1);
+        }
+    }
+}
+
+/* Median ns per row of dict_pass() */
+static double
+median_dict_ns(bool compress, PGLZ_Context *ctx, char *const *rows,
+               const int32 *lens, char *const *comp, int32 *clens,
+               char *out, const char *dict, int32 dictlen,
+               int64_t *latencies)
+{
+    int iters = 0;
+    int64_t total_ns = 0;
+
+    /* Warmup: each pass is already DICT_ROWS calls */
+    for (int i = 0; i < WARMUP_ITERS / 10; i++)
+        dict_pass(compress, ctx, rows, lens, comp, clens, out, dict, dictlen);
+
+    while (iters < MAX_ITERS)
+    {
+        int64_t t0 = now_ns();
+        dict_pass(compress, ctx, rows, lens, comp, clens, out, dict, dictlen);
+        int64_t t1 = now_ns();
+
+        latencies[iters] = t1 - t0;
+        total_ns += (t1 - t0);
+        iters++;
+
+        if (iters >= MIN_ITERS / 10 && total_ns >= min_bench_ns / 4)
+            break;
+    }
+
+    qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+    return (double)latencies[iters / 2] / DICT_ROWS;
+}
+
+static int
+run_dict_mode(const char *variant, bool markdown, int64_t *latencies)
+{
+    static const char *const kind_names[] = { "json", "pgbench" };
+    char *rows[DICT_ROWS];
+    char *comp[DICT_ROWS];
+    int32 lens[DICT_ROWS];
+    int32 clens[DICT_ROWS];
+    char *out = malloc(DICT_ROW_MAX);
+    char *dict = malloc(PGLZ_DICT_MAX_SIZE);
+    PGLZ_Context *ctx;
+
+    if (pglz_compress_ctx_dict == NULL)
+    {
+        fprintf(stderr, "%s: no pglz_compress_ctx_dict, skipping dict mode\n",
+                variant);
+        free(out);
+        free(dict);
+        return 0;
+    }
+
+    ctx = pglz_context_create_extended(PGLZ_CTX_GENERATIONS);
+    for (int r = 0; r < DICT_ROWS; r++)
+    {
+        rows[r] = malloc(DICT_ROW_MAX);
+        comp[r] = malloc(PGLZ_MAX_OUTPUT(DICT_ROW_MAX));
+    }
+    if (!out || !dict || !ctx || !rows[DICT_ROWS - 1] || !comp[DICT_ROWS - 1])
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (markdown)
+    {
+        printf("\n### %s: %d rows of %d-%d B, compressed one by one with a dictionary\n\n",
+               variant, DICT_ROWS, DICT_ROW_MIN, DICT_ROW_MAX);
+        printf("| Type | Dict | Stored | Comp | Comp ns/row | MiB/s | Decomp ns/row | MiB/s |\n");
+        printf("|------|------|--------|------|-------------|-------|---------------|-------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: %d rows of %d-%d B, compressed one by one with a dictionary ===\n\n",
+               variant, DICT_ROWS, DICT_ROW_MIN, DICT_ROW_MAX);
+        printf("%-8s %6s %7s %5s %12s %8s %14s %8s\n",
+               "Type", "Dict", "Stored", "Comp", "Comp ns/row", "MiB/s",
+               "Decomp ns/row", "MiB/s");
+        printf("%-8s %6s %7s %5s %12s %8s %14s %8s\n",
+               "----", "----", "------", "----", "-----------", "-----",
+               "-------------", "-----");
+    }
+
+    for (int kind = 0; kind < 2; kind++)
+    {
+        int (*gen)(char *, int) = kind ? gen_dict_pgbench : gen_dict_json;
+        int64_t total_in = 0;
+        int dictfill = 0;
+
+        /* The dictionary: other rows, the latest at its end */
+        rng_seed(7);
+        while (dictfill < PGLZ_DICT_MAX_SIZE)
+        {
+            char row[DICT_ROW_MAX];
+            int rlen = gen(row, 100000 + dictfill);
+            int n = Min(rlen, PGLZ_DICT_MAX_SIZE - dictfill);
+
+            memcpy(dict + PGLZ_DICT_MAX_SIZE - dictfill - n, row, n);
+            dictfill += n;
+        }
+
+        rng_seed(42);
+        for (int r = 0; r < DICT_ROWS; r++)
+        {
+            lens[r] = gen(rows[r], r);
+            total_in += lens[r];
+        }
+
+        for (int d = 0; d < (int)NUM_DICT_SIZES; d++)
+        {
+            int32 dictlen = dict_sizes[d];
+            const char *dstart = dict + PGLZ_DICT_MAX_SIZE - dictlen;
+            int64_t total_out = 0;
+            int ncomp = 0;
+            double comp_ns, decomp_ns;
+
+            comp_ns = median_dict_ns(true, ctx, rows, lens, comp, clens, out,
+                                     dstart, dictlen, latencies);
+            decomp_ns = median_dict_ns(false, ctx, rows, lens, comp, clens,
+                                       out, dstart, dictlen, latencies);
+            for (int r = 0; r < DICT_ROWS; r++)
+            {
+                total_out += clens[r] >= 0 ? clens[r] : lens[r];
+                ncomp += clens[r] >= 0;
+            }
+
+            double stored = (double)total_out / total_in * 100.0;
+            double row_mib = (double)total_in / DICT_ROWS / (1024.0 * 1024.0);
+            const char *dname = dictlen ? fmt_size(dictlen) : "none";
+
+            if (markdown)
+                printf("| %-7s | %4s | %5.1f%% | %4d | %11.0f | %5.1f | %13.0f | %5.1f |\n",
+                       kind_names[kind], dname, stored, ncomp, comp_ns,
+                       row_mib / (comp_ns / 1e9), decomp_ns,
+                       row_mib / (decomp_ns / 1e9));
+            else
+                printf("%-8s %6s %6.1f%% %5d %12.0f %8.1f %14.0f %8.1f\n",
+                       kind_names[kind], dname, stored, ncomp, comp_ns,
+                       row_mib / (comp_ns / 1e9), decomp_ns,
+                       row_mib / (decomp_ns / 1e9));
+        }
+    }
+
+    for (int r = 0; r < DICT_ROWS; r++)
+    {
+        free(rows[r]);
+        free(comp[r]);
+    }
+    pglz_context_free(ctx);
+    free(out);
+    free(dict);
+    return 0;
+}
+
+/* ----------
+ * Sweep mode: is the sizing table right?  Every input is compressed
+ * through pglz_compress_ctx_ext with PGLZ_strategy_always, the default
+ * skip settings and each hash_size in turn, once from a plain context,
+ * which clears the table on every call as pglz_compress does, and once
+ * from a generation-tagged one, which does not.  Cells are median
+ * microseconds per call.  "Spread" is how far the compressed sizes of
+ * the row are apart, in percent of the input; "Table" is what
+ * pglz_hash_size picks.  The summary picks, per input size, the hash
+ * size with the lowest mean time relative to each type's fastest.
+ * ----------
+ */
+static const int sweep_sizes[] = {
+    64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 65536, 1048576
+};
+static const int sweep_hash_sizes[] = {
+    256, 512, 1024, 2048, 4096, 8192, 16384
+};
+#define NUM_SWEEP_SIZES (sizeof(sweep_sizes) / sizeof(sweep_sizes[0]))
+#define NUM_SWEEP_HASH_SIZES \
+    (sizeof(sweep_hash_sizes) / sizeof(sweep_hash_sizes[0]))
+/* 2 contexts x 4 types x 11 sizes x 7 hash sizes: keep each one short */
+#define SWEEP_BENCH_NS  (min_bench_ns / 10)
+
+static double
+median_sweep_ns(PGLZ_Context *ctx, const PGLZ_StrategyExt *strategy,
+                const char *input, int size, char *output,
+                int64_t *latencies, int32 *clen)
+{
+    int iters = 0;
+    int64_t total_ns = 0;
+
+    for (int i = 0; i < WARMUP_ITERS / 10; i++)
+        *clen = pglz_compress_ctx_ext(ctx, input, size, output, strategy);
+
+    while (iters < MAX_ITERS)
+    {
+        int64_t t0 = now_ns();
+        *clen = pglz_compress_ctx_ext(ctx, input, size, output, strategy);
+        int64_t t1 = now_ns();
+
+        latencies[iters] = t1 - t0;
+        total_ns += (t1 - t0);
+        iters++;
+
+        if (iters >= MIN_ITERS / 10 && total_ns >= SWEEP_BENCH_NS)
+            break;
+    }
+
+    qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+    return latencies[iters / 2];
+}
+
+static int
+run_sweep_mode(const char *variant, bool markdown, int64_t *latencies)
+{
+    static const char *const ctx_names[2] = {
+        "reset per call", "generations"
+    };
+    static double ns[2][NUM_TYPES][NUM_SWEEP_SIZES][NUM_SWEEP_HASH_SIZES];
+    int max_size = sweep_sizes[NUM_SWEEP_SIZES - 1];
+    PGLZ_StrategyExt strategy;
+
+    if (pglz_compress_ctx_ext == NULL || pglz_hash_size == NULL ||
+        pglz_context_create_extended == NULL)
+    {
+        fprintf(stderr, "%s: no pglz_hash_size(), skipping sweep mode\n",
+                variant);
+        return 0;
+    }
+
+    PGLZ_Context *ctxs[2] = {
+        pglz_context_create_extended(0),
+        pglz_context_create_extended(PGLZ_CTX_GENERATIONS)
+    };
+    char *input = malloc(max_size);
+    char *output = malloc(PGLZ_MAX_OUTPUT(max_size));
+
+    if (!ctxs[0] || !ctxs[1] || !input || !output)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    memset(&strategy, 0, sizeof(strategy));
+    strategy.base = *PGLZ_strategy_always;
+    strategy.skip_threshold = PGLZ_SKIP_THRESHOLD_DEFAULT;
+    strategy.skip_rate = PGLZ_SKIP_RATE_DEFAULT;
+
+    for (int c = 0; c < 2; c++)
+    {
+        if (markdown)
+        {
+            printf("\n### %s: hash table size sweep, %s (µs per call)\n\n",
+                   variant, ctx_names[c]);
+            printf("| Type | Size |");
+            for (int h = 0; h < (int)NUM_SWEEP_HASH_SIZES; h++)
+                printf(" %d |", sweep_hash_sizes[h]);
+            printf(" Spread | Best | Table |\n|------|------|");
+            for (int h = 0; h < (int)NUM_SWEEP_HASH_SIZES; h++)
+                printf("------|");
+            printf("--------|------|-------|\n");
+        }
+        else
+        {
+            printf("\n=== %s: hash table size sweep, %s (µs per call) ===\n\n",
+                   variant, ctx_names[c]);
+            printf("%-10s %6s", "Type", "Size");
+            for (int h = 0; h < (int)NUM_SWEEP_HASH_SIZES; h++)
+                printf(" %8d", sweep_hash_sizes[h]);
+            printf(" %8s %6s %6s\n", "Spread", "Best", "Table");
+        }
+
+        for (int t = 0; t < (int)NUM_TYPES; t++)
+        {
+            const InputType *itype = &input_types[t];
+
+            for (int s = 0; s < (int)NUM_SWEEP_SIZES; s++)
+            {
+                int size = sweep_sizes[s];
+                int32 cmin = INT32_MAX;
+                int32 cmax = 0;
+                int best = 0;
+
+                itype->generate(input, size);
+                if (markdown)
+                    printf("| %-8s | %4s |", itype->name, fmt_size(size));
+                else
+                    printf("%-10s %6s", itype->name, fmt_size(size));
+                for (int h = 0; h < (int)NUM_SWEEP_HASH_SIZES; h++)
+                {
+                    int32 clen;
+
+                    strategy.hash_size = sweep_hash_sizes[h];
+                    ns[c][t][s][h] = median_sweep_ns(ctxs[c], &strategy, input,
+                                                     size, output, latencies,
+                                                     &clen);
+                    if (clen < 0)
+                        clen = size;    /* stored uncompressed */
+                    if (clen < cmin)
+                        cmin = clen;
+                    if (clen > cmax)
+                        cmax = clen;
+                    if (ns[c][t][s][h] < ns[c][t][s][best])
+                        best = h;
+                    if (markdown)
+                        printf(" %.2f |", ns[c][t][s][h] / 1000.0);
+                    else
+                        printf(" %8.2f", ns[c][t][s][h] / 1000.0);
+                }
+                if (markdown)
+                    printf(" %.2f%% | %d | %d |\n",
+                           (double)(cmax - cmin) / size * 100.0,
+                           sweep_hash_sizes[best], pglz_hash_size(size));
+                else
+                    printf(" %7.2f%% %6d %6d\n",
+                           (double)(cmax - cmin) / size * 100.0,
+                           sweep_hash_sizes[best], pglz_hash_size(size));
+            }
+        }
+    }
+
+    /* Per size: the hash size with the lowest mean of time / type's best */
+    if (markdown)
+    {
+        printf("\n### %s: best hash table size over all types\n\n", variant);
+        printf("| Size | Table | Best (reset) | vs Table | Best (generations) | vs Table |\n");
+        printf("|------|-------|--------------|----------|--------------------|----------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: best hash table size over all types ===\n\n",
+               variant);
+        printf("%6s %6s %13s %9s %19s %9s\n", "Size", "Table",
+               "Best(reset)", "vs Table", "Best(generations)", "vs Table");
+    }
+    for (int s = 0; s < (int)NUM_SWEEP_SIZES; s++)
+    {
+        int table = pglz_hash_size(sweep_sizes[s]);
+        int best[2];
+        double gain[2];
+
+        for (int c = 0; c < 2; c++)
+        {
+            double rel[NUM_SWEEP_HASH_SIZES];
+            int table_h = -1;
+
+            best[c] = 0;
+            for (int h = 0; h < (int)NUM_SWEEP_HASH_SIZES; h++)
+            {
+                rel[h] = 0;
+                for (int t = 0; t < (int)NUM_TYPES; t++)
+                {
+                    double type_best = ns[c][t][s][0];
+
+                    for (int k = 1; k < (int)NUM_SWEEP_HASH_SIZES; k++)
+                        if (ns[c][t][s][k] < type_best)
+                            type_best = ns[c][t][s][k];
+                    rel[h] += ns[c][t][s][h] / type_best / NUM_TYPES;
+                }
+                if (rel[h] < rel[best[c]])
+                    best[c] = h;
+                if (sweep_hash_sizes[h] == table)
+                    table_h = h;
+            }
+            /* How much slower the table's choice is than the best, on average */
+            gain[c] = table_h >= 0 ? (rel[table_h] / rel[best[c]] - 1) * 100.0 : 0;
+        }
+        if (markdown)
+            printf("| %4s | %d | %d | %+.1f%% | %d | %+.1f%% |\n",
+                   fmt_size(sweep_sizes[s]), table,
+                   sweep_hash_sizes[best[0]], gain[0],
+                   sweep_hash_sizes[best[1]], gain[1]);
+        else
+            printf("%6s %6d %13d %8.1f%% %19d %8.1f%%\n",
+                   fmt_size(sweep_sizes[s]), table,
+                   sweep_hash_sizes[best[0]], gain[0],
+                   sweep_hash_sizes[best[1]], gain[1]);
+    }
+
+    pglz_context_free(ctxs[0]);
+    pglz_context_free(ctxs[1]);
+    free(input);
+    free(output);
+    return 0;
+}
+
+/* ----------
+ * Fixed mode: what compiling for one strategy buys.  "generic" calls
+ * pglz_compress with a copy of the standard strategy, which the variant
+ * cannot tell from any other strategy; "fixed" calls the variant's
+ * pglz_compress_default or pglz_compress_always.  The outputs must be
+ * identical.  Times are the median call.
+ * ----------
+ */
+static const int fixed_sizes[] = { 512, 2048, 8192, 65536, 1048576 };
+#define NUM_FIXED_SIZES (sizeof(fixed_sizes) / sizeof(fixed_sizes[0]))
+
+typedef int32 (*FixedCompressFn) (const char *source, int32 slen, char *dest);
+
+static double
+median_fixed_ns(FixedCompressFn fixed, const PGLZ_Strategy *strategy,
+                const char *input, int size, char *output,
+                int64_t *latencies, int32 *clen)
+{
+    int iters = 0;
+    int64_t total_ns = 0;
+
+    for (int i = 0; i < WARMUP_ITERS / 10; i++)
+        *clen = fixed ? fixed(input, size, output)
+                      : pglz_compress(input, size, output, strategy);
+
+    while (iters < MAX_ITERS)
+    {
+        int64_t t0 = now_ns();
+        *clen = fixed ? fixed(input, size, output)
+                      : pglz_compress(input, size, output, strategy);
+        int64_t t1 = now_ns();
+
+        latencies[iters] = t1 - t0;
+        total_ns += (t1 - t0);
+        iters++;
+
+        if (iters >= MIN_ITERS / 10 && total_ns >= min_bench_ns)
+            break;
+    }
+
+    qsort(latencies, iters, sizeof(int64_t), cmp_i64);
+    return latencies[iters / 2];
+}
+
+static int
+run_fixed_mode(const char *variant, bool markdown, int64_t *latencies)
+{
+    static const char *const names[2] = { "default", "always" };
+    const PGLZ_Strategy copies[2] = {
+        *PGLZ_strategy_default, *PGLZ_strategy_always
+    };
+    FixedCompressFn fixed[2] = { pglz_compress_default, pglz_compress_always };
+    int max_size = fixed_sizes[NUM_FIXED_SIZES - 1];
+    int rc = 0;
+
+    if (pglz_compress_default == NULL || pglz_compress_always == NULL)
+    {
+        fprintf(stderr, "%s: no pglz_compress_default(), skipping fixed mode\n",
+                variant);
+        return 0;
+    }
+
+    char *input = malloc(max_size);
+    char *generic_out = malloc(PGLZ_MAX_OUTPUT(max_size));
+    char *fixed_out = malloc(PGLZ_MAX_OUTPUT(max_size));
+
+    if (!input || !generic_out || !fixed_out)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (markdown)
+    {
+        printf("\n### %s: fixed-strategy vs generic compression\n\n", variant);
+        printf("| Type | Size | Strategy | Generic MiB/s | Fixed MiB/s | Speedup |\n");
+        printf("|------|------|----------|---------------|-------------|---------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: fixed-strategy vs generic compression ===\n\n",
+               variant);
+        printf("%-12s %6s %9s %14s %12s %8s\n", "Type", "Size", "Strategy",
+               "Generic MiB/s", "Fixed MiB/s", "Speedup");
+        printf("%-12s %6s %9s %14s %12s %8s\n", "----", "----", "--------",
+               "-------------", "-----------", "-------");
+    }
+
+    for (int t = 0; t < (int)NUM_TYPES; t++)
+    {
+        const InputType *itype = &input_types[t];
+
+        for (int s = 0; s < (int)NUM_FIXED_SIZES; s++)
+        {
+            int size = fixed_sizes[s];
+            double mib = (double)size / (1024.0 * 1024.0);
+
+            itype->generate(input, size);
+            for (int k = 0; k < 2; k++)
+            {
+                int32 glen;
+                int32 flen;
+                double gns = median_fixed_ns(NULL, &copies[k], input, size,
+                                             generic_out, latencies, &glen);
+                double fns = median_fixed_ns(fixed[k], NULL, input, size,
+                                             fixed_out, latencies, &flen);
+
+                if (glen != flen ||
+                    (glen >= 0 && memcmp(generic_out, fixed_out, glen) != 0))
+                {
+                    fprintf(stderr, "OUTPUT MISMATCH: %s %s strategy %s\n",
+                            itype->name, fmt_size(size), names[k]);
+                    rc = 1;
+                }
+
+                if (markdown)
+                    printf("| %-10s | %4s | %-8s | %13.1f | %11.1f | %6.2fx |\n",
+                           itype->name, fmt_size(size), names[k],
+                           mib / (gns / 1e9), mib / (fns / 1e9), gns / fns);
+                else
+                    printf("%-12s %6s %9s %14.1f %12.1f %7.2fx\n",
+                           itype->name, fmt_size(size), names[k],
+                           mib / (gns / 1e9), mib / (fns / 1e9), gns / fns);
+            }
+        }
+    }
+
+    free(input);
+    free(generic_out);
+    free(fixed_out);
+    return rc;
+}
+
+/* ----------
+ * Corpus mode: real data instead of generated.  Every regular file under
+ * the corpus path is mapped read-only, in path order, and cut into chunks
+ * that are compressed straight from the mapping.  Each chunk is
+ * compressed and decompressed CORPUS_ROUNDS times, keeping its fastest
+ * time of each, and checked once.  A chunk that does not compress is
+ * counted at 100% (stored raw) and not decompressed.  "Raw" is the share
+ * of such chunks; the percentiles are over chunks, the MiB/s columns
+ * before them over all bytes.  A histogram of all chunks' ratios follows.
+ * ----------
+ */
+#define CORPUS_ROUNDS       5
+#define CORPUS_TOAST_CHUNK  2032    /* TOAST_TUPLE_THRESHOLD, 8 KiB pages */
+#define CORPUS_PAGE_CHUNK   8192    /* BLCKSZ */
+#define CORPUS_MAX_CHUNK    (1 << 30)
+#define CORPUS_MAX_FILES    100000
+
+typedef struct
+{
+    char       *path;
+    const char *data;           /* the mapping */
+    size_t      len;
+    int         first_chunk;
+    int         nchunks;
+} CorpusFile;
+
+typedef struct
+{
+    const char *data;           /* into the file's mapping */
+    int32       len;
+    int32       clen;           /* -1 if stored raw */
+    int64_t     comp_ns;        /* fastest of CORPUS_ROUNDS */
+    int64_t     decomp_ns;
+} CorpusChunk;
+
+static CorpusFile *corpus_files;
+static int corpus_nfiles;
+
+static int
+cmp_corpus_path(const void *a, const void *b)
+{
+    return strcmp(((const CorpusFile *) a)->path,
+                  ((const CorpusFile *) b)->path);
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double va = *(const double *)a;
+    double vb = *(const double *)b;
+    return (va > vb) - (va < vb);
+}
+
+/* Collect the regular, non-empty files at or below path */
+static int
+corpus_collect(const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) != 0)
+    {
+        fprintf(stderr, "cannot stat \"%s\": %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (S_ISDIR(st.st_mode))
+    {
+        DIR *dir = opendir(path);
+        struct dirent *de;
+        int rc = 0;
+
+        if (dir == NULL)
+        {
+            fprintf(stderr, "cannot open \"%s\": %s\n", path, strerror(errno));
+            return 1;
+        }
+        while (rc == 0 && (de = readdir(dir)) != NULL)
+        {
+            char sub[4096];
+
+            if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+                continue;
+            snprintf(sub, sizeof(sub), "%s/%s", path, de->d_name);
+            rc = corpus_collect(sub);
+        }
+        closedir(dir);
+        return rc;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_size == 0)
+        return 0;
+    if (corpus_nfiles >= CORPUS_MAX_FILES)
+    {
+        fprintf(stderr, "more than %d files under the corpus path\n",
+                CORPUS_MAX_FILES);
+        return 1;
+    }
+    corpus_files[corpus_nfiles].path = strdup(path);
+    corpus_files[corpus_nfiles].len = (size_t) st.st_size;
+    corpus_nfiles++;
+    return 0;
+}
+
+/* Map every collected file; returns 0 on success */
+static int
+corpus_map(void)
+{
+    for (int f = 0; f < corpus_nfiles; f++)
+    {
+        CorpusFile *cf = &corpus_files[f];
+        int fd = open(cf->path, O_RDONLY);
+        void *map;
+
+        if (fd < 0)
+        {
+            fprintf(stderr, "cannot open \"%s\": %s\n", cf->path,
+                    strerror(errno));
+            return 1;
+        }
+        map = mmap(NULL, cf->len, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            fprintf(stderr, "cannot map \"%s\": %s\n", cf->path,
+                    strerror(errno));
+            return 1;
+        }
+        cf->data = map;
+    }
+    return 0;
+}
+
+/*
+ * Print one row: totals over chunks[0 .. n), which are reordered.  The
+ * scratch array holds n doubles.
+ */
+static void
+corpus_row(const char *name, CorpusChunk *chunks, int n, double *scratch,
+           bool markdown)
+{
+    double in = 0, out = 0, comp_ns = 0, decomp_ns = 0, decomp_in = 0;
+    int raw = 0;
+    double mib_p[3], ratio_p[3];
+    static const double q[3] = { 0.10, 0.50, 0.90 };
+
+    for (int i = 0; i < n; i++)
+    {
+        in += chunks[i].len;
+        out += chunks[i].clen >= 0 ? chunks[i].clen : chunks[i].len;
+        comp_ns += chunks[i].comp_ns;
+        if (chunks[i].clen >= 0)
+        {
+            decomp_in += chunks[i].len;
+            decomp_ns += chunks[i].decomp_ns;
+        }
+        else
+            raw++;
+    }
+
+    for (int i = 0; i < n; i++)
+        scratch[i] = (double)chunks[i].len / (1024.0 * 1024.0) /
+                     (chunks[i].comp_ns / 1e9);
+    qsort(scratch, n, sizeof(double), cmp_double);
+    for (int k = 0; k < 3; k++)
+        mib_p[k] = scratch[(int)(q[k] * (n - 1))];
+
+    for (int i = 0; i < n; i++)
+        scratch[i] = (chunks[i].clen >= 0 ? chunks[i].clen : chunks[i].len) *
+                     100.0 / chunks[i].len;
+    qsort(scratch, n, sizeof(double), cmp_double);
+    for (int k = 0; k < 3; k++)
+        ratio_p[k] = scratch[(int)(q[k] * (n - 1))];
+
+    double comp_mib = in / (1024.0 * 1024.0) / (comp_ns / 1e9);
+    double decomp_mib = decomp_ns > 0 ?
+        decomp_in / (1024.0 * 1024.0) / (decomp_ns / 1e9) : 0;
+
+    if (markdown)
+        printf("| %s | %d | %.1f | %.2f%% | %.1f%% | %.1f | %.1f | %.1f | %.1f | %.2f%% | %.2f%% | %.2f%% | %.1f |\n",
+               name, n, in / (1024.0 * 1024.0), out / in * 100.0,
+               raw * 100.0 / n, comp_mib, mib_p[0], mib_p[1], mib_p[2],
+               ratio_p[0], ratio_p[1], ratio_p[2], decomp_mib);
+    else
+        printf("%-28.28s %8d %9.1f %7.2f%% %6.1f%% %9.1f %8.1f %8.1f %8.1f %7.2f%% %7.2f%% %7.2f%% %9.1f\n",
+               name, n, in / (1024.0 * 1024.0), out / in * 100.0,
+               raw * 100.0 / n, comp_mib, mib_p[0], mib_p[1], mib_p[2],
+               ratio_p[0], ratio_p[1], ratio_p[2], decomp_mib);
+}
+
+static int
+run_corpus_mode(const char *variant, bool markdown, const char *corpus,
+                const char *chunk_arg)
+{
+    int chunk_size;
+    int64_t nchunks = 0;
+    CorpusChunk *chunks;
+    double *scratch;
+    char *compressed;
+    char *output;
+    int rc = 0;
+
+    if (corpus == NULL)
+    {
+        fprintf(stderr, "corpus mode needs --corpus=PATH\n");
+        return 1;
+    }
+    if (chunk_arg == NULL || strcmp(chunk_arg, "toast") == 0)
+        chunk_size = CORPUS_TOAST_CHUNK;
+    else if (strcmp(chunk_arg, "page") == 0)
+        chunk_size = CORPUS_PAGE_CHUNK;
+    else
+        chunk_size = atoi(chunk_arg);
+    if (chunk_size <= 0 || chunk_size > CORPUS_MAX_CHUNK)
+    {
+        fprintf(stderr, "bad --chunk \"%s\": toast, page or 1-%d bytes\n",
+                chunk_arg, CORPUS_MAX_CHUNK);
+        return 1;
+    }
+
+    corpus_files = calloc(CORPUS_MAX_FILES, sizeof(CorpusFile));
+    if (!corpus_files)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    if (corpus_collect(corpus) != 0)
+        return 1;
+    if (corpus_nfiles == 0)
+    {
+        fprintf(stderr, "no non-empty files under \"%s\"\n", corpus);
+        return 1;
+    }
+    qsort(corpus_files, corpus_nfiles, sizeof(CorpusFile), cmp_corpus_path);
+    if (corpus_map() != 0)
+        return 1;
+
+    for (int f = 0; f < corpus_nfiles; f++)
+    {
+        corpus_files[f].first_chunk = (int) nchunks;
+        corpus_files[f].nchunks = (int) ((corpus_files[f].len + chunk_size - 1) /
+                                         chunk_size);
+        nchunks += corpus_files[f].nchunks;
+    }
+    if (nchunks > INT32_MAX)
+    {
+        fprintf(stderr, "too many chunks; use a larger --chunk\n");
+        return 1;
+    }
+
+    chunks = calloc(nchunks, sizeof(CorpusChunk));
+    scratch = malloc(nchunks * sizeof(double));
+    compressed = malloc(PGLZ_MAX_OUTPUT(chunk_size));
+    output = malloc(chunk_size);
+    if (!chunks || !scratch || !compressed || !output)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (int f = 0; f < corpus_nfiles; f++)
+    {
+        CorpusFile *cf = &corpus_files[f];
+
+        for (int c = 0; c < cf->nchunks; c++)
+        {
+            CorpusChunk *ch = &chunks[cf->first_chunk + c];
+            size_t off = (size_t) c * chunk_size;
+
+            ch->data = cf->data + off;
+            ch->len = (int32) Min((size_t) chunk_size, cf->len - off);
+            ch->comp_ns = INT64_MAX;
+            ch->decomp_ns = INT64_MAX;
+        }
+    }
+
+    for (int r = 0; r < CORPUS_ROUNDS; r++)
+    {
+        for (int64_t i = 0; i < nchunks; i++)
+        {
+            CorpusChunk *ch = &chunks[i];
+            int64_t t0 = now_ns();
+            int32 clen = pglz_compress(ch->data, ch->len, compressed,
+                                       PGLZ_strategy_default);
+            int64_t t1 = now_ns();
+
+            ch->clen = clen;
+            ch->comp_ns = Min(ch->comp_ns, t1 - t0);
+            if (clen < 0)
+                continue;
+
+            t0 = now_ns();
+            int32 dlen = pglz_decompress(compressed, clen, output, ch->len,
+                                         true);
+            t1 = now_ns();
+            ch->decomp_ns = Min(ch->decomp_ns, t1 - t0);
+
+            if (r == 0 &&
+                (dlen != ch->len || memcmp(ch->data, output, ch->len) != 0))
+            {
+                fprintf(stderr, "ROUNDTRIP FAILURE: chunk %lld (%d bytes)\n",
+                        (long long) i, ch->len);
+                rc = 1;
+            }
+        }
+    }
+
+    if (markdown)
+    {
+        printf("\n### %s: corpus %s, %d-byte chunks\n\n", variant, corpus,
+               chunk_size);
+        printf("| File | Chunks | MiB | Ratio | Raw | Comp MiB/s | p10 MiB/s | p50 MiB/s | p90 MiB/s | p10 ratio | p50 ratio | p90 ratio | Decomp MiB/s |\n");
+        printf("|------|--------|-----|-------|-----|------------|-----------|-----------|-----------|-----------|-----------|-----------|--------------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: corpus %s, %d-byte chunks ===\n\n", variant, corpus,
+               chunk_size);
+        printf("%-28s %8s %9s %8s %7s %9s %8s %8s %8s %8s %8s %8s %9s\n",
+               "File", "Chunks", "MiB", "Ratio", "Raw", "Comp", "p10", "p50",
+               "p90", "p10", "p50", "p90", "Decomp");
+        printf("%-28s %8s %9s %8s %7s %9s %8s %8s %8s %8s %8s %8s %9s\n",
+               "", "", "", "", "", "MiB/s", "MiB/s", "MiB/s", "MiB/s",
+               "ratio", "ratio", "ratio", "MiB/s");
+    }
+
+    /* Per file, by path relative to the corpus path, then everything */
+    if (corpus_nfiles > 1)
+    {
+        size_t prefix = strlen(corpus);
+
+        for (int f = 0; f < corpus_nfiles; f++)
+        {
+            const char *name = corpus_files[f].path + prefix;
+
+            while (*name == '/')
+                name++;
+            corpus_row(name, &chunks[corpus_files[f].first_chunk],
+                       corpus_files[f].nchunks, scratch, markdown);
+        }
+    }
+    corpus_row("total", chunks, (int) nchunks, scratch, markdown);
+
+    /* Ratio distribution of all chunks, in tenths; raw chunks apart */
+    {
+        int64_t hist[11] = { 0 };
+
+        for (int64_t i = 0; i < nchunks; i++)
+        {
+            if (chunks[i].clen < 0)
+                hist[10]++;
+            else
+                hist[Min((int64_t) chunks[i].clen * 10 / chunks[i].len, 9)]++;
+        }
+        if (markdown)
+            printf("\n| Ratio | Chunks | Share |\n|-------|--------|-------|\n");
+        else
+            printf("\n%-10s %8s %7s\n", "Ratio", "Chunks", "Share");
+        for (int b = 0; b <= 10; b++)
+        {
+            char label[16];
+
+            if (b < 10)
+                snprintf(label, sizeof(label), "%d-%d%%", b * 10, b * 10 + 10);
+            else
+                snprintf(label, sizeof(label), "raw");
+            if (markdown)
+                printf("| %s | %lld | %.1f%% |\n", label, (long long) hist[b],
+                       hist[b] * 100.0 / nchunks);
+            else
+                printf("%-10s %8lld %6.1f%%\n", label, (long long) hist[b],
+                       hist[b] * 100.0 / nchunks);
+        }
+    }
+
+    for (int f = 0; f < corpus_nfiles; f++)
+    {
+        munmap((void *) corpus_files[f].data, corpus_files[f].len);
+        free(corpus_files[f].path);
+    }
+    free(corpus_files);
+    free(chunks);
+    free(scratch);
+    free(compressed);
+    free(output);
+    return rc;
+}
+
+/* ----------
+ * Multi-core mode: N threads at once instead of one.  Each thread has its
+ * own PGLZ_Context and its own copy of an MT_WORKSET buffer of one type,
+ * cut into MT_SIZE pieces that it compresses or decompresses in turn for
+ * MT_BENCH_NS, timing every call.  This runs at 1, 2, 4 ... --threads
+ * threads (default: every CPU the process may run on), so the threads
+ * share L2, L3 and memory bandwidth the way concurrent backends do.
+ *
+ * MiB/s is the input (compress) or output (decompress) bytes of all
+ * threads over the wall time of the run, and "Scaling" that divided by
+ * the 1-thread figure.  Latencies are per call: the median of the
+ * threads' p50s, and of their p99s next to the worst thread's p99.
+ *
+ * --pin=cpu binds thread i to the i-th allowed CPU; --pin=numa deals the
+ * threads round-robin over the NUMA nodes (from /sys) and binds them
+ * within the node.  Pinned threads copy their inputs after binding, so
+ * with numa the memory is node-local.  Without a context API (baseline,
+ * steps 1-6) only decompression runs, as the static history of
+ * pglz_compress is not thread-safe.
+ * ----------
+ */
+#define MT_WORKSET      (4 * 1048576)   /* per thread, well beyond L2 */
+#define MT_BENCH_NS     (min_bench_ns / 2)
+#define MT_MAX_SAMPLES  (1 << 18)       /* per thread; later calls untimed */
+#define MT_MAX_THREADS  1024
+
+static const int mt_sizes[] = { 2048, 65536 };
+#define NUM_MT_SIZES (sizeof(mt_sizes) / sizeof(mt_sizes[0]))
+
+typedef enum
+{
+    MT_PIN_NONE,
+    MT_PIN_CPU,
+    MT_PIN_NUMA
+} MtPin;
+
+typedef struct
+{
+    /* Set up by the caller */
+    bool        decompress;
+    int         size;
+    int         npieces;        /* of staged input / compressed data */
+    const char *stage_in;
+    const char *stage_comp;     /* npieces slots of PGLZ_MAX_OUTPUT(size) */
+    const int32 *stage_clen;    /* -1 = incompressible, not decompressed */
+    int         cpu;            /* -1 = not pinned */
+    pthread_barrier_t *barrier;
+
+    /* Filled in by the thread */
+    bool        failed;
+    int64_t     bytes;
+    int64_t     start_ns;
+    int64_t     end_ns;
+    int         nlat;
+    int64_t    *lat;
+} MtThread;
+
+/* CPUs the process may run on, and which NUMA node each is on */
+static int mt_ncpus;
+static int mt_cpus[MT_MAX_THREADS];
+static int mt_node[MT_MAX_THREADS];
+static int mt_nnodes = 1;
+
+static void
+mt_find_cpus(void)
+{
+#ifdef __linux__
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int c = 0; c < CPU_SETSIZE && mt_ncpus < MT_MAX_THREADS; c++)
+            if (CPU_ISSET(c, &set))
+                mt_cpus[mt_ncpus++] = c;
+    }
+
+    /* nodeN/cpuN links say which node a CPU is on; no /sys, one node */
+    for (int i = 0; i < mt_ncpus; i++)
+    {
+        for (int n = 0; n < MT_MAX_THREADS; n++)
+        {
+            char path[96];
+            struct stat st;
+
+            snprintf(path, sizeof(path),
+                     "/sys/devices/system/node/node%d/cpu%d", n, mt_cpus[i]);
+            if (stat(path, &st) == 0)
+            {
+                mt_node[i] = n;
+                mt_nnodes = Max(mt_nnodes, n + 1);
+                break;
+            }
+        }
+    }
+#endif
+    if (mt_ncpus == 0)
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+        mt_ncpus = (int) Min(Max(n, 1), MT_MAX_THREADS);
+        for (int i = 0; i < mt_ncpus; i++)
+            mt_cpus[i] = i;
+    }
+}
+
+/* The CPU thread i of nthreads runs on, -1 for none */
+static int
+mt_pick_cpu(MtPin pin, int i)
+{
+    if (pin == MT_PIN_CPU)
+        return mt_cpus[i % mt_ncpus];
+    if (pin == MT_PIN_NUMA)
+    {
+        int node = i % mt_nnodes;
+        int nth = i / mt_nnodes;
+        int seen = 0;
+
+        /* Nodes without allowed CPUs fall through to the plain order */
+        for (int round = 0; round < 2; round++)
+        {
+            for (int c = 0; c < mt_ncpus; c++)
+            {
+                if (mt_node[c] != node)
+                    continue;
+                if (seen++ == nth)
+                    return mt_cpus[c];
+            }
+            if (seen == 0)
+                break;
+            nth %= seen;
+            seen = 0;
+        }
+        return mt_cpus[i % mt_ncpus];
+    }
+    return -1;
+}
+
+static void *
+mt_worker(void *arg)
+{
+    MtThread   *th = arg;
+    int         size = th->size;
+    int         slot = PGLZ_MAX_OUTPUT(size);
+    size_t      inlen = (size_t) th->npieces * size;
+    char       *in = NULL;
+    char       *comp = NULL;
+    char       *out = malloc(slot);
+    char       *check = malloc(size);
+    PGLZ_Context *ctx = NULL;
+    int         nvalid = 0;
+
+#ifdef __linux__
+    if (th->cpu >= 0)
+    {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(th->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+
+    /* First touch after pinning, so the pages land on this thread's node */
+    if (th->decompress)
+    {
+        comp = malloc((size_t) th->npieces * slot);
+        if (comp)
+            memcpy(comp, th->stage_comp, (size_t) th->npieces * slot);
+    }
+    else
+    {
+        in = malloc(inlen);
+        if (in)
+            memcpy(in, th->stage_in, inlen);
+        if (pglz_context_create_extended)
+            ctx = pglz_context_create_extended(PGLZ_CTX_GENERATIONS);
+        else
+            ctx = pglz_context_create();
+    }
+    th->lat = malloc(MT_MAX_SAMPLES * sizeof(int64_t));
+    th->failed = !out || !check || !th->lat || (th->decompress ? !comp : !in || !ctx);
+
+    /* Warm up, and check every piece once against the staged input */
+    for (int p = 0; !th->failed && p < th->npieces; p++)
+    {
+        const char *src = th->stage_in + (size_t) p * size;
+        int32 clen;
+
+        if (th->decompress)
+        {
+            clen = th->stage_clen[p];
+            if (clen < 0)
+                continue;
+            if (pglz_decompress(comp + (size_t) p * slot, clen, check, size,
+                                true) != size)
+                th->failed = true;
+        }
+        else
+        {
+            clen = pglz_compress_ctx(ctx, in + (size_t) p * size, size, out,
+                                     PGLZ_strategy_always);
+            if (clen < 0)
+            {
+                nvalid++;
+                continue;
+            }
+            if (pglz_decompress(out, clen, check, size, true) != size)
+                th->failed = true;
+        }
+        if (!th->failed && memcmp(check, src, size) != 0)
+            th->failed = true;
+        nvalid++;
+    }
+    if (nvalid == 0)
+        th->failed = true;
+
+    pthread_barrier_wait(th->barrier);
+
+    th->bytes = 0;
+    th->nlat = 0;
+    th->start_ns = now_ns();
+    th->end_ns = th->start_ns;
+    for (int p = 0; !th->failed && th->end_ns - th->start_ns < MT_BENCH_NS;
+         p = (p + 1) % th->npieces)
+    {
+        if (th->decompress && th->stage_clen[p] < 0)
+            continue;
+
+        int64_t t0 = now_ns();
+        if (th->decompress)
+            pglz_decompress(comp + (size_t) p * slot, th->stage_clen[p], out,
+                            size, true);
+        else
+            pglz_compress_ctx(ctx, in + (size_t) p * size, size, out,
+                              PGLZ_strategy_always);
+        int64_t t1 = now_ns();
+
+        if (th->nlat < MT_MAX_SAMPLES)
+            th->lat[th->nlat++] = t1 - t0;
+        th->bytes += size;
+        th->end_ns = t1;
+    }
+
+    if (ctx)
+        pglz_context_free(ctx);
+    free(in);
+    free(comp);
+    free(out);
+    free(check);
+    return NULL;
+}
+
+/*
+ * One run of nthreads threads; returns false if a thread failed.  mib,
+ * p50, p99 and p99max are the row's figures (latencies in ns).
+ */
+static bool
+mt_run(MtThread *threads, int nthreads, MtPin pin, double *mib, double *p50,
+       double *p99, double *p99max)
+{
+    pthread_t   tids[MT_MAX_THREADS];
+    pthread_barrier_t barrier;
+    double      p50s[MT_MAX_THREADS], p99s[MT_MAX_THREADS];
+    int64_t     start = INT64_MAX, end = 0, bytes = 0;
+    bool        ok = true;
+
+    pthread_barrier_init(&barrier, NULL, nthreads);
+    for (int i = 0; i < nthreads; i++)
+    {
+        threads[i].cpu = mt_pick_cpu(pin, i);
+        threads[i].barrier = &barrier;
+        threads[i].lat = NULL;
+        if (pthread_create(&tids[i], NULL, mt_worker, &threads[i]) != 0)
+        {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(tids[i], NULL);
+    pthread_barrier_destroy(&barrier);
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        MtThread *th = &threads[i];
+
+        if (th->failed || th->nlat == 0)
+            ok = false;
+        else
+        {
+            qsort(th->lat, th->nlat, sizeof(int64_t), cmp_i64);
+            p50s[i] = th->lat[th->nlat / 2];
+            p99s[i] = th->lat[(int) (0.99 * (th->nlat - 1))];
+            start = Min(start, th->start_ns);
+            end = Max(end, th->end_ns);
+            bytes += th->bytes;
+        }
+        free(th->lat);
+    }
+    if (!ok)
+        return false;
+
+    qsort(p50s, nthreads, sizeof(double), cmp_double);
+    qsort(p99s, nthreads, sizeof(double), cmp_double);
+    *mib = bytes / (1024.0 * 1024.0) / ((end - start) / 1e9);
+    *p50 = p50s[nthreads / 2];
+    *p99 = p99s[nthreads / 2];
+    *p99max = p99s[nthreads - 1];
+    return true;
+}
+
+static int
+run_mt_mode(const char *variant, bool markdown, int max_threads,
+            const char *pin_arg)
+{
+    MtPin       pin = MT_PIN_NONE;
+    bool        have_ctx = pglz_compress_ctx != NULL &&
+                           (pglz_context_create_extended != NULL ||
+                            pglz_context_create != NULL);
+    int         counts[32];
+    int         ncounts = 0;
+    int         max_pieces = MT_WORKSET / mt_sizes[0];
+    size_t      max_comp = 0;
+    MtThread   *threads;
+    char       *stage_in = malloc(MT_WORKSET);
+    char       *stage_comp;
+    int32      *stage_clen = malloc(max_pieces * sizeof(int32));
+    int         rc = 0;
+
+    for (int s = 0; s < (int)NUM_MT_SIZES; s++)
+        max_comp = Max(max_comp, (size_t) (MT_WORKSET / mt_sizes[s]) *
+                       PGLZ_MAX_OUTPUT(mt_sizes[s]));
+    stage_comp = malloc(max_comp);
+
+    if (pin_arg == NULL || strcmp(pin_arg, "none") == 0)
+        pin = MT_PIN_NONE;
+    else if (strcmp(pin_arg, "cpu") == 0)
+        pin = MT_PIN_CPU;
+    else if (strcmp(pin_arg, "numa") == 0)
+        pin = MT_PIN_NUMA;
+    else
+    {
+        fprintf(stderr, "unknown --pin \"%s\": none, cpu or numa\n", pin_arg);
+        return 1;
+    }
+#ifndef __linux__
+    if (pin != MT_PIN_NONE)
+    {
+        fprintf(stderr, "--pin needs Linux, running unpinned\n");
+        pin = MT_PIN_NONE;
+    }
+#endif
+
+    mt_find_cpus();
+    if (max_threads <= 0)
+        max_threads = mt_ncpus;
+    max_threads = Min(max_threads, MT_MAX_THREADS);
+    for (int n = 1; n < max_threads; n *= 2)
+        counts[ncounts++] = n;
+    counts[ncounts++] = max_threads;
+
+    threads = calloc(max_threads, sizeof(MtThread));
+    if (!threads || !stage_in || !stage_comp || !stage_clen)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    if (!have_ctx)
+        fprintf(stderr, "%s: no pglz_compress_ctx(), "
+                "multi-core mode runs decompression only\n", variant);
+
+    if (markdown)
+    {
+        printf("\n### %s: multi-core, %d CPUs, %d NUMA node%s, pin=%s\n\n",
+               variant, mt_ncpus, mt_nnodes, mt_nnodes == 1 ? "" : "s",
+               pin_arg ? pin_arg : "none");
+        printf("| Op | Type | Size | Threads | MiB/s | Scaling | p50 µs | p99 µs | worst p99 µs |\n");
+        printf("|----|------|------|---------|-------|---------|--------|--------|--------------|\n");
+    }
+    else
+    {
+        printf("\n=== %s: multi-core, %d CPUs, %d NUMA node%s, pin=%s ===\n\n",
+               variant, mt_ncpus, mt_nnodes, mt_nnodes == 1 ? "" : "s",
+               pin_arg ? pin_arg : "none");
+        printf("%-10s %-12s %8s %8s %10s %8s %9s %9s %10s\n",
+               "Op", "Type", "Size", "Threads", "MiB/s", "Scaling",
+               "p50(µs)", "p99(µs)", "worst p99");
+        printf("%-10s %-12s %8s %8s %10s %8s %9s %9s %10s\n",
+               "--", "----", "----", "-------", "-----", "-------",
+               "-------", "-------", "---------");
+    }
+
+    for (int op = have_ctx ? 0 : 1; op < 2; op++)
+    {
+        bool decompress = (op == 1);
+
+        for (int t = 0; t < (int)NUM_TYPES; t++)
+        {
+            const InputType *itype = &input_types[t];
+
+            itype->generate(stage_in, MT_WORKSET);
+
+            for (int s = 0; s < (int)NUM_MT_SIZES; s++)
+            {
+                int size = mt_sizes[s];
+                int npieces = MT_WORKSET / size;
+                int slot = PGLZ_MAX_OUTPUT(size);
+                double one = 0;
+
+                for (int p = 0; p < npieces; p++)
+                    stage_clen[p] = pglz_compress(stage_in + (size_t) p * size,
+                                                  size,
+                                                  stage_comp + (size_t) p * slot,
+                                                  PGLZ_strategy_always);
+
+                for (int c = 0; c < ncounts; c++)
+                {
+                    int nthreads = counts[c];
+                    double mib, p50, p99, p99max;
+
+                    for (int i = 0; i < nthreads; i++)
+                    {
+                        threads[i].decompress = decompress;
+                        threads[i].size = size;
+                        threads[i].npieces = npieces;
+                        threads[i].stage_in = stage_in;
+                        threads[i].stage_comp = stage_comp;
+                        threads[i].stage_clen = stage_clen;
+                    }
+
+                    if (!mt_run(threads, nthreads, pin, &mib, &p50, &p99,
+                                &p99max))
+                    {
+                        /* Incompressible input has nothing to decompress */
+                        bool none = true;
+
+                        for (int p = 0; p < npieces; p++)
+                            if (stage_clen[p] >= 0)
+                                none = false;
+                        if (markdown)
+                            printf("| %s | %s | %s | %d | FAIL | | | | |\n",
+                                   decompress ? "decompress" : "compress",
+                                   itype->name, fmt_size(size), nthreads);
+                        else
+                            printf("%-10s %-12s %8s %8d %10s\n",
+                                   decompress ? "decompress" : "compress",
+                                   itype->name, fmt_size(size), nthreads,
+                                   "FAIL");
+                        if (none)
+                            break;
+                        rc = 1;
+                        continue;
+                    }
+                    if (nthreads == 1)
+                        one = mib;
+
+                    if (markdown)
+                        printf("| %s | %s | %s | %d | %.1f | %.2fx | %.2f | %.2f | %.2f |\n",
+                               decompress ? "decompress" : "compress",
+                               itype->name, fmt_size(size), nthreads, mib,
+                               one > 0 ? mib / one : 0, p50 / 1000.0,
+                               p99 / 1000.0, p99max / 1000.0);
+                    else
+                        printf("%-10s %-12s %8s %8d %10.1f %7.2fx %9.2f %9.2f %10.2f\n",
+                               decompress ? "decompress" : "compress",
+                               itype->name, fmt_size(size), nthreads, mib,
+                               one > 0 ? mib / one : 0, p50 / 1000.0,
+                               p99 / 1000.0, p99max / 1000.0);
+                }
+            }
+        }
+    }
+
+    free(threads);
+    free(stage_in);
+    free(stage_comp);
+    free(stage_clen);
+    return rc;
+}
+
+/* ----------
+ * Main
+ * ----------
+ */
+int
+main(int argc, char **argv)
+{
+    bool markdown = false;
+    const char *mode = "compress";
+    const char *hash = NULL;
+    const char *corpus = NULL;
+    const char *chunk_arg = NULL;
+    const char *pin_arg = NULL;
+    int max_threads = 0;
+    int sample_size = 0;
+    int skip_threshold = -1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--md") == 0 || strcmp(argv[i], "--markdown") == 0)
+            markdown = true;
+        else if (strcmp(argv[i], "--perf") == 0)
+            show_perf = true;
+        else if (strcmp(argv[i], "--tsv") == 0)
+            tsv = true;
+        else if (strncmp(argv[i], "--min-ms=", 9) == 0)
+            min_bench_ns = atoll(argv[i] + 9) * 1000000LL;
+        else if (strncmp(argv[i], "--mode=", 7) == 0)
+            mode = argv[i] + 7;
+        else if (strncmp(argv[i], "--hash=", 7) == 0)
+            hash = argv[i] + 7;
+        else if (strncmp(argv[i], "--sample=", 9) == 0)
+            sample_size = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--skip=", 7) == 0)
+            skip_threshold = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--corpus=", 9) == 0)
+            corpus = argv[i] + 9;
+        else if (strncmp(argv[i], "--chunk=", 8) == 0)
+            chunk_arg = argv[i] + 8;
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+            max_threads = atoi(argv[i] + 10);
+        else if (strncmp(argv[i], "--pin=", 6) == 0)
+            pin_arg = argv[i] + 6;
+    }
+
+    if (min_bench_ns <= 0)
+    {
+        fprintf(stderr, "--min-ms must be at least 1\n");
+        return 1;
+    }
+
+    const char *variant = "pglz";
+    if (argc > 1 && argv[1][0] != '-')
+        variant = argv[1];
+
+    if (hash)
+    {
+        static char label[64];
+        PGLZ_HashKind kind;
+
+        if (strcmp(hash, "stock") == 0)
+            kind = PGLZ_HASH_STOCK;
+        else if (strcmp(hash, "fibonacci") == 0)
+            kind = PGLZ_HASH_FIBONACCI;
+        else if (strcmp(hash, "crc32c") == 0)
+            kind = PGLZ_HASH_CRC32C;
+        else {
+            fprintf(stderr, "unknown hash \"%s\"\n", hash);
+            return 1;
+        }
+        if (!pglz_set_hash) {
+            fprintf(stderr, "%s does not provide pglz_set_hash\n", variant);
+            return 1;
+        }
+        if (!pglz_set_hash(kind)) {
+            fprintf(stderr, "hash \"%s\" is not available in this build "
+                    "(crc32c needs CFLAGS_ARCH=-msse4.2)\n", hash);
+            return 1;
+        }
+        snprintf(label, sizeof(label), "%s, hash=%s", variant, hash);
+        variant = label;
+    }
+
+    if (sample_size > 0 || skip_threshold >= 0)
+    {
+        static char label[112];
+        char sample_label[24] = "";
+        char skip_label[24] = "";
+
+        if (!pglz_compress_ext) {
+            fprintf(stderr, "%s does not provide pglz_compress_ext\n", variant);
+            return 1;
+        }
+        strategy_ext.base = *PGLZ_strategy_always;
+        strategy_ext.skip_threshold = PGLZ_SKIP_THRESHOLD_DEFAULT;
+        strategy_ext.skip_rate = PGLZ_SKIP_RATE_DEFAULT;
+        strategy_ext.sample_size = sample_size;
+        if (sample_size > 0)
+            snprintf(sample_label, sizeof(sample_label), ", sample=%d",
+                     sample_size);
+        if (skip_threshold >= 0) {
+            strategy_ext.skip_threshold = skip_threshold;
+            strategy_ext.skip_rate = 0;
+            snprintf(skip_label, sizeof(skip_label), ", skip=%d",
+                     skip_threshold);
+        }
+        use_strategy_ext = true;
+        snprintf(label, sizeof(label), "%s%s%s", variant, sample_label,
+                 skip_label);
+        variant = label;
+    }
+
+    int total_tests = NUM_TYPES * NUM_SIZES;
+    BenchResult *results = calloc(total_tests, sizeof(BenchResult));
+    int64_t *latencies = malloc(MAX_ITERS * sizeof(int64_t));
+
+    if (!results || !latencies) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (strcmp(mode, "small") == 0)
+    {
+        int rc = run_small_mode(variant, markdown, latencies);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "decompress") == 0)
+    {
+        int rc = run_decompress_mode(variant, markdown, latencies, results);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "slice") == 0)
+    {
+        int rc = run_slice_mode(variant, markdown, latencies);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "parallel") == 0)
+    {
+        int rc = run_parallel_mode(variant, markdown, latencies);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "batch") == 0)
+    {
+        int rc = run_batch_mode(variant, markdown, latencies);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "stream") == 0)
+    {
+        int rc = run_stream_mode(variant, markdown, latencies);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "level") == 0)
+    {
+        int rc = run_level_mode(variant, markdown, latencies);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "engine") == 0)
+    {
+        int rc = run_engine_mode(variant, markdown, latencies);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "alloc") == 0)
+    {
+        int rc = run_alloc_mode(variant, markdown, latencies);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "estimate") == 0)
+    {
+        int rc = run_estimate_mode(variant, markdown, latencies);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "dict") == 0)
+    {
+        int rc = run_dict_mode(variant, markdown, latencies);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "sweep") == 0)
+    {
+        int rc = run_sweep_mode(variant, markdown, latencies);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "fixed") == 0)
+    {
+        int rc = run_fixed_mode(variant, markdown, latencies);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "corpus") == 0)
+    {
+        int rc = run_corpus_mode(variant, markdown, corpus, chunk_arg);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "mt") == 0)
+    {
+        int rc = run_mt_mode(variant, markdown, max_threads, pin_arg);
+        free(latencies);
+        free(results);
+        return rc;
+    }
+    else if (strcmp(mode, "compress") != 0)
+    {
+        fprintf(stderr, "unknown mode \"%s\"\n", mode);
+        return 1;
+    }
+
+    /* Allocate max-sized buffers */
+    int max_size = test_sizes[NUM_SIZES - 1];
+    char *input = malloc(max_size);
+    int output_len = PGLZ_MAX_OUTPUT(max_size);
+    char *output = malloc(output_len);
+
+    if (!input || !output) {
+        fprintf(stderr, "Out of memory for buffers\n");
+        return 1;
+    }
+
+    int l1d_fd = -1;
+    if (show_perf)
+    {
+#ifdef __linux__
+        l1d_fd = perf_counter_open(PERF_TYPE_HW_CACHE, PERF_L1D_READ_MISS);
+#endif
+        if (l1d_fd < 0)
+            fprintf(stderr, "warning: cannot open L1d miss counter, "
+                    "reporting n/a\n");
+    }
+
+    int ridx = 0;
+    for (int t = 0; t < (int)NUM_TYPES; t++)
+    {
+        for (int s = 0; s < (int)NUM_SIZES; s++)
+        {
+            int size = test_sizes[s];
+            const InputType *itype = &input_types[t];
+
+            /* Generate input */
+            itype->generate(input, size);
+
+            /* Verify round-trip first */
+            if (!verify_roundtrip(input, size)) {
+                fprintf(stderr, "ERROR: Round-trip verification failed for %s/%s!\n",
+                        itype->name, fmt_size(size));
+                results[ridx].type_name = itype->name;
+                results[ridx].input_size = size;
+                results[ridx].compress_ok = false;
+                results[ridx].events = -1.0;
+                ridx++;
+                continue;
+            }
+
+            /* Check if compression succeeds */
+            int32 clen = bench_compress(input, size, output);
+
+            /* Run benchmark */
+            int64_t l1d_misses;
+            int iters = run_bench(input, size, output, output_len,
+                                  latencies, MAX_ITERS, l1d_fd, &l1d_misses);
+
+            BenchResult *r = &results[ridx];
+            fill_result(r, itype->name, size, clen, latencies, iters,
+                        l1d_misses);
+
+            /* Counters of one more call, if the variant counts them */
+            if (pglz_get_stats != NULL)
+            {
+                pglz_reset_stats();
+                bench_compress(input, size, output);
+                r->have_stats = pglz_get_stats(&r->stats);
+            }
+
+            if (!markdown && !tsv) {
+                fprintf(stderr, "  %-12s %8s: %.1f MiB/s, ratio=%.2f%%, median=%.2f µs (%d iters)\n",
+                        itype->name, fmt_size(size),
+                        r->throughput_mib,
+                        (clen >= 0) ? (double)clen / size * 100.0 : -1.0,
+                        r->median_us,
+                        iters);
+            }
+
+            ridx++;
+        }
+    }
+
+    /* Print results */
+    if (tsv)
+        print_results_tsv(results, ridx, "compress");
+    else if (markdown)
         print_results_md(results, ridx, variant);
     else
         print_results(results, ridx, variant);
+    PGLZ_Stats probe;
+    if (!tsv && pglz_get_stats != NULL && pglz_get_stats(&probe))
+        print_stats(results, ridx, variant, markdown);
 
+#ifdef __linux__
+    if (l1d_fd >= 0)
+        close(l1d_fd);
+#endif
     free(input);
     free(output);
     free(latencies);
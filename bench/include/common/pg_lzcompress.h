@@ -25,6 +25,57 @@
  */
 #define PGLZ_MAX_OUTPUT(_dlen)			((_dlen) + 4)
 
+/* ----------
+ * PGLZ_SLICE_BUFSIZE -
+ *
+ *		Macro to compute the buffer size required by pglz_decompress_slice()
+ *		to extract the first _rawsize bytes.  The PGLZ_SLICE_SLACK bytes
+ *		past _rawsize are scratch space for the match that crosses it.
+ * ----------
+ */
+#define PGLZ_SLICE_SLACK				512
+#define PGLZ_SLICE_BUFSIZE(_rawsize)	((_rawsize) + PGLZ_SLICE_SLACK)
+
+/* ----------
+ * PGLZ_FRAME_MAX_OUTPUT -
+ *
+ *		Macro to compute the buffer size required by pglz_compress_parallel()
+ *		(as an int64).  A frame holds a 16-byte header, a 4-byte index
+ *		entry per PGLZ_FRAME_CHUNK_SIZE chunk, and, while compressing, a
+ *		PGLZ_MAX_OUTPUT(PGLZ_FRAME_CHUNK_SIZE) slot per chunk.
+ * ----------
+ */
+#define PGLZ_FRAME_CHUNK_SIZE			65536
+#define PGLZ_FRAME_HEADER_SIZE			16
+#define PGLZ_FRAME_NCHUNKS(_slen) \
+	((int32) (((int64) (_slen) + PGLZ_FRAME_CHUNK_SIZE - 1) / \
+			  PGLZ_FRAME_CHUNK_SIZE))
+#define PGLZ_FRAME_MAX_OUTPUT_PER_CHUNK \
+	(4 + PGLZ_MAX_OUTPUT(PGLZ_FRAME_CHUNK_SIZE))
+#define PGLZ_FRAME_MAX_OUTPUT(_slen) \
+	(PGLZ_FRAME_HEADER_SIZE + \
+	 (int64) PGLZ_FRAME_NCHUNKS(_slen) * PGLZ_FRAME_MAX_OUTPUT_PER_CHUNK)
+
+/* ----------
+ * PGLZ_STREAM_MAX_OUTPUT -
+ *
+ *		Macro to compute the buffer size required by pglz_stream_update()
+ *		for _slen bytes of input, and with _slen = 0 by pglz_stream_end().
+ *		A call may also emit output for input buffered by earlier calls.
+ * ----------
+ */
+#define PGLZ_STREAM_MAX_OUTPUT(_slen)	((_slen) + (_slen) / 8 + 512)
+
+/* ----------
+ * PGLZ_DICT_MAX_SIZE -
+ *
+ *		The largest dictionary pglz_compress_ctx_dict() and
+ *		pglz_decompress_dict() take, one history's worth.  Tags reach
+ *		4095 bytes back, so a longer one could not be used anyway.
+ * ----------
+ */
+#define PGLZ_DICT_MAX_SIZE				4096
+
 
 /* ----------
  * PGLZ_Strategy -
@@ -84,14 +135,295 @@ extern PGDLLIMPORT const PGLZ_Strategy *const PGLZ_strategy_default;
 extern PGDLLIMPORT const PGLZ_Strategy *const PGLZ_strategy_always;
 
 
+/* ----------
+ * PGLZ_StrategyExt -
+ *
+ *		A strategy with skip-after-match, sampling, lazy matching, hash
+ *		table size and match finder settings, for pglz_compress_ext() and
+ *		pglz_compress_ctx_ext().  Plain strategies get
+ *		PGLZ_SKIP_THRESHOLD_DEFAULT and PGLZ_SKIP_RATE_DEFAULT, no
+ *		sampling, no lazy matching, the default table size and the
+ *		chained history.
+ *
+ *		skip_threshold		Matches at least this long add only their first
+ *							position to the history, which is much faster
+ *							on redundant data but can miss later matches
+ *							that start inside them.  0 never skips.
+ *
+ *		skip_rate			If nonzero, skip only while the recent output
+ *							(over 4-8 KiB of input) is at most this
+ *							percentage of the input; 0 skips regardless.
+ *
+ *		sample_size			Like first_success_by, a way to give up early on
+ *							incompressible input: if nonzero, about this
+ *							many bytes (64 to 1024) spread over inputs of
+ *							1 KiB or more are sampled first, and the call
+ *							fails at once if they look random.  Plain
+ *							strategies and streams do not sample.
+ *
+ *		lazy_steps			How many following positions (0 to 2) to search
+ *							before emitting a match shorter than
+ *							match_size_good; a strictly longer match there
+ *							is taken instead, after literals.  Slower, but
+ *							usually smaller output.  0 is greedy, as plain
+ *							strategies and streams are.
+ *
+ *		hash_size			Number of history hash buckets, for tuning:
+ *							rounded down to a power of two and clamped to
+ *							256-16384.  0 takes pglz_hash_size(), which
+ *							depends on the input length only.
+ *
+ *		bucket_ways			0 finds matches in chains of all earlier
+ *							positions with the same hash.  2, 4 or 8 keeps
+ *							only that many recent positions per bucket
+ *							instead (other values are rounded up, see
+ *							pglz_bucket_ways()): faster on long inputs,
+ *							usually at some cost in ratio.  The output
+ *							format is the same.
+ * ----------
+ */
+typedef struct PGLZ_StrategyExt
+{
+	PGLZ_Strategy base;
+	int32		skip_threshold;
+	int32		skip_rate;
+	int32		sample_size;
+	int32		lazy_steps;
+	int32		hash_size;
+	int32		bucket_ways;
+} PGLZ_StrategyExt;
+
+#define PGLZ_SKIP_THRESHOLD_DEFAULT		32
+#define PGLZ_SKIP_RATE_DEFAULT			25
+
+/* ----------
+ * The standard extended strategies
+ *
+ *		PGLZ_strategy_archive		The best compression pglz can do, for
+ *									data that is written once and read
+ *									often: PGLZ_strategy_default's limits,
+ *									with a full history search and lazy
+ *									matching.  Several times slower to
+ *									compress; decompression is unaffected.
+ * ----------
+ */
+extern PGDLLIMPORT const PGLZ_StrategyExt *const PGLZ_strategy_archive;
+
+
+/* ----------
+ * PGLZ_Context -
+ *
+ *		Opaque history state for pglz_compress_ctx().  Each thread that
+ *		compresses concurrently needs its own context.
+ * ----------
+ */
+typedef struct PGLZ_Context PGLZ_Context;
+
+/*
+ * Flags for pglz_context_create_extended().
+ *
+ *		PGLZ_CTX_GENERATIONS	Invalidate the hash table in O(1) on reuse
+ *								by stamping bucket heads with a generation
+ *								counter, instead of clearing it per call.
+ */
+#define PGLZ_CTX_GENERATIONS	0x0001
+
+/* ----------
+ * PGLZ_Allocator -
+ *
+ *		Allocation callbacks for pglz_context_create_allocator(), used for
+ *		the context and the buffers it keeps.  alloc returns size bytes,
+ *		or NULL if out of memory; free gets a pointer alloc returned and
+ *		the size asked for then.  Both get arg.  free may be NULL if the
+ *		memory is released in bulk, e.g. with an arena or memory context
+ *		reset.  With alloc NULL, both use the default allocation.
+ * ----------
+ */
+typedef struct PGLZ_Allocator
+{
+	void	   *(*alloc) (size_t size, void *arg);
+	void		(*free) (void *ptr, size_t size, void *arg);
+	void	   *arg;
+} PGLZ_Allocator;
+
+/* ----------
+ * PGLZ_HashKind -
+ *
+ *		The hash that maps a position's next 4 bytes to a history bucket,
+ *		selected per context with pglz_context_set_hash(), or with
+ *		pglz_set_hash() for the static contexts and as the one new
+ *		contexts and streams start with.  It changes only which matches
+ *		are found, never the format, so any output decompresses the same
+ *		way.
+ *
+ *		PGLZ_HASH_STOCK			The original shift-and-xor of the 4 bytes.
+ *
+ *		PGLZ_HASH_FIBONACCI		Multiply-shift by 2654435761 (the default).
+ *
+ *		PGLZ_HASH_CRC32C		One hardware CRC32C step; only available where
+ *								the build targets SSE4.2 or ARMv8 CRC.
+ * ----------
+ */
+typedef enum PGLZ_HashKind
+{
+	PGLZ_HASH_STOCK,
+	PGLZ_HASH_FIBONACCI,
+	PGLZ_HASH_CRC32C
+} PGLZ_HashKind;
+
+/* ----------
+ * PGLZ_Stream -
+ *
+ *		Opaque state of a streaming compression, from pglz_stream_begin()
+ *		to pglz_stream_end().
+ * ----------
+ */
+typedef struct PGLZ_Stream PGLZ_Stream;
+
+/* ----------
+ * PGLZ_DecodeStream -
+ *
+ *		Opaque state of an incremental decompression, from
+ *		pglz_decode_begin() to pglz_decode_end().
+ * ----------
+ */
+typedef struct PGLZ_DecodeStream PGLZ_DecodeStream;
+
+/* ----------
+ * PGLZ_Stats -
+ *
+ *		Hot-path event counts, kept per thread by builds with PGLZ_STATS
+ *		defined and read with pglz_get_stats().  Without PGLZ_STATS none
+ *		of them is counted, at no cost.  pglz_compress_parallel() adds
+ *		its workers' counts to the calling thread's.
+ *
+ *		calls, compressed	One-shot compressions started and succeeded
+ *							(streams count only their searches and output).
+ *		bytes_in, bytes_out	Input of all calls, output of those that
+ *							succeeded.
+ *		searches			History lookups (pglz_find_match calls).
+ *		chain_hops			History entries compared over all searches.
+ *		chain_limit_stops	Searches cut off after PGLZ_MAX_CHAIN entries.
+ *		good_match_stops	Searches ended by a match of good_match bytes.
+ *		offset_stops		Searches ended by an entry too far back for a
+ *							tag's 4095-byte offset.
+ *		dead_chain_stops	Searches ended by a recycled entry.  Entries are
+ *							recycled in place rather than unlinked, so this
+ *							is where the cost of recycling shows.
+ *		hist_adds			Positions added to the history.
+ *		hist_recycles		Adds that took over the oldest entry.
+ *		skipped_positions	Positions inside matches not added, from
+ *							skip-after-match.
+ *		lazy_wins			Matches replaced by a longer one a position on.
+ *		literals, matches	Output items; matches[i] counts tags of
+ *							2^(i+1) to 2^(i+2) - 1 bytes (3 in the first
+ *							bucket, 128-273 in the last).
+ *		bailout_*			Calls failed: by the strategy's input size
+ *							limits, by the incompressibility sample, for
+ *							no match within first_success_by bytes, or for
+ *							output over the min_comp_rate limit.
+ * ----------
+ */
+#define PGLZ_STATS_MATCH_BUCKETS		7
+
+typedef struct PGLZ_Stats
+{
+	uint64		calls;
+	uint64		compressed;
+	uint64		bytes_in;
+	uint64		bytes_out;
+	uint64		searches;
+	uint64		chain_hops;
+	uint64		chain_limit_stops;
+	uint64		good_match_stops;
+	uint64		offset_stops;
+	uint64		dead_chain_stops;
+	uint64		hist_adds;
+	uint64		hist_recycles;
+	uint64		skipped_positions;
+	uint64		lazy_wins;
+	uint64		literals;
+	uint64		matches[PGLZ_STATS_MATCH_BUCKETS];
+	uint64		bailout_strategy;
+	uint64		bailout_sample;
+	uint64		bailout_first_success;
+	uint64		bailout_ratio;
+} PGLZ_Stats;
+
+
 /* ----------
  * Global function declarations
  * ----------
  */
 extern int32 pglz_compress(const char *source, int32 slen, char *dest,
 						   const PGLZ_Strategy *strategy);
+extern PGLZ_Context *pglz_context_create(void);
+extern PGLZ_Context *pglz_context_create_extended(int flags);
+extern PGLZ_Context *pglz_context_create_allocator(int flags,
+													const PGLZ_Allocator *allocator);
+extern void pglz_context_free(PGLZ_Context *ctx);
+extern char *pglz_context_output_buffer(PGLZ_Context *ctx, int32 slen);
+extern char *pglz_context_raw_buffer(PGLZ_Context *ctx, int32 rawsize);
+extern void pglz_context_shrink(PGLZ_Context *ctx, int64 limit);
+extern int32 pglz_compress_ctx(PGLZ_Context *ctx, const char *source,
+							   int32 slen, char *dest,
+							   const PGLZ_Strategy *strategy);
+extern int32 pglz_compress_default(const char *source, int32 slen,
+								   char *dest);
+extern int32 pglz_compress_always(const char *source, int32 slen, char *dest);
+extern int32 pglz_compress_ext(const char *source, int32 slen, char *dest,
+							   const PGLZ_StrategyExt *strategy);
+extern int32 pglz_compress_ctx_ext(PGLZ_Context *ctx, const char *source,
+								   int32 slen, char *dest,
+								   const PGLZ_StrategyExt *strategy);
+extern int32 pglz_compress_ctx_dict(PGLZ_Context *ctx, const char *source,
+									int32 slen, char *dest,
+									const PGLZ_Strategy *strategy,
+									const char *dict, int32 dictlen);
+extern PGLZ_Stream *pglz_stream_begin(const PGLZ_Strategy *strategy);
+extern int32 pglz_stream_update(PGLZ_Stream *stream, const char *source,
+								int32 slen, char *dest);
+extern int32 pglz_stream_end(PGLZ_Stream *stream, char *dest);
 extern int32 pglz_decompress(const char *source, int32 slen, char *dest,
 							 int32 rawsize, bool check_complete);
+extern PGLZ_DecodeStream *pglz_decode_begin(char *dest, int32 rawsize);
+extern int32 pglz_decode_update(PGLZ_DecodeStream *stream,
+								const char *source, int32 slen);
+extern int32 pglz_decode_end(PGLZ_DecodeStream *stream, bool check_complete);
+extern int32 pglz_decompress_slice(const char *source, int32 slen,
+								   char *dest, int32 rawsize);
+extern int32 pglz_decompress_dict(const char *source, int32 slen, char *dest,
+								  int32 rawsize, bool check_complete,
+								  const char *dict, int32 dictlen);
+extern int	pglz_compress_batch(const char **srcs, const int32 *lens,
+								char **dests, int32 *out_lens, int n,
+								const PGLZ_Strategy *strategy);
+extern int	pglz_compress_batch_ctx(PGLZ_Context *ctx, const char **srcs,
+									const int32 *lens, char **dests,
+									int32 *out_lens, int n,
+									const PGLZ_Strategy *strategy);
+extern int32 pglz_compress_parallel(const char *source, int32 slen,
+									char *dest, const PGLZ_Strategy *strategy,
+									int nthreads);
+extern int32 pglz_decompress_frame(const char *source, int32 slen,
+								   char *dest, int32 rawsize);
+extern int32 pglz_decompress_parallel(const char *source, int32 slen,
+									  char *dest, int32 rawsize,
+									  int nthreads);
+extern int32 pglz_frame_rawsize(const char *source, int32 slen);
+extern int32 pglz_decompress_frame_range(PGLZ_Context *ctx,
+										 const char *source, int32 slen,
+										 char *dest, int32 offset,
+										 int32 length);
+extern bool pglz_context_set_hash(PGLZ_Context *ctx, PGLZ_HashKind hash);
+extern bool pglz_set_hash(PGLZ_HashKind hash);
+extern PGLZ_HashKind pglz_get_hash(void);
+extern int32 pglz_estimate_ratio(const char *source, int32 slen,
+								 int32 sample_bytes);
+extern int	pglz_hash_size(int32 slen);
+extern int	pglz_bucket_ways(int32 bucket_ways);
+extern bool pglz_get_stats(PGLZ_Stats *stats);
+extern void pglz_reset_stats(void);
 extern int32 pglz_maximum_compressed_size(int32 rawsize,
 										  int32 total_compressed_size);
 
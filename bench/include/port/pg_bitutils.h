@@ -0,0 +1,27 @@
+/*
+ * Minimal port/pg_bitutils.h stub for standalone pglz compilation.
+ * Provides the subset of the Postgres bit-manipulation helpers that the
+ * variants use, with the same names and semantics (input must be nonzero).
+ */
+#ifndef PG_BITUTILS_H
+#define PG_BITUTILS_H
+
+static inline int
+pg_rightmost_one_pos32(uint32 word)
+{
+	return __builtin_ctz(word);
+}
+
+static inline int
+pg_rightmost_one_pos64(uint64 word)
+{
+	return __builtin_ctzll(word);
+}
+
+static inline int
+pg_leftmost_one_pos64(uint64 word)
+{
+	return 63 - __builtin_clzll(word);
+}
+
+#endif /* PG_BITUTILS_H */
@@ -16,6 +16,8 @@
 #include <limits.h>
 
 /* Basic Postgres types */
+typedef int8_t int8;
+typedef uint8_t uint8;
 typedef int32_t int32;
 typedef uint32_t uint32;
 typedef int16_t int16;
@@ -24,6 +26,10 @@ typedef int64_t int64;
 typedef uint64_t uint64;
 
 /* Macros that pg_lzcompress.c needs */
+#ifndef UINT64CONST
+#define UINT64CONST(x)  (x##ULL)
+#endif
+
 #ifndef Min
 #define Min(x, y)       ((x) < (y) ? (x) : (y))
 #endif
@@ -36,6 +42,10 @@ typedef uint64_t uint64;
 #define unlikely(x)     __builtin_expect((x) != 0, 0)
 #endif
 
+#ifndef pg_attribute_always_inline
+#define pg_attribute_always_inline __attribute__((always_inline)) inline
+#endif
+
 #ifndef PGDLLIMPORT
 #define PGDLLIMPORT
 #endif
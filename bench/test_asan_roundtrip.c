@@ -23,6 +23,48 @@
 
 #include "common/pg_lzcompress.h"
 
+/*
+ * Entry points that only later variants provide.  Weak references keep
+ * this test linkable against the baseline and earlier steps; the tests
+ * that need them are skipped when they resolve to NULL.
+ */
+#pragma weak pglz_context_create
+#pragma weak pglz_context_create_extended
+#pragma weak pglz_context_free
+#pragma weak pglz_compress_ctx
+#pragma weak pglz_decompress_slice
+#pragma weak pglz_compress_parallel
+#pragma weak pglz_decompress_frame
+#pragma weak pglz_compress_batch
+#pragma weak pglz_compress_batch_ctx
+#pragma weak pglz_stream_begin
+#pragma weak pglz_stream_update
+#pragma weak pglz_stream_end
+#pragma weak pglz_decode_begin
+#pragma weak pglz_decode_update
+#pragma weak pglz_decode_end
+#pragma weak pglz_set_hash
+#pragma weak pglz_context_set_hash
+#pragma weak pglz_get_hash
+#pragma weak pglz_compress_ext
+#pragma weak pglz_compress_ctx_ext
+#pragma weak PGLZ_strategy_archive
+#pragma weak pglz_compress_default
+#pragma weak pglz_compress_always
+#pragma weak pglz_get_stats
+#pragma weak pglz_reset_stats
+#pragma weak pglz_bucket_ways
+#pragma weak pglz_context_create_allocator
+#pragma weak pglz_context_output_buffer
+#pragma weak pglz_context_raw_buffer
+#pragma weak pglz_context_shrink
+#pragma weak pglz_estimate_ratio
+#pragma weak pglz_compress_ctx_dict
+#pragma weak pglz_decompress_dict
+#pragma weak pglz_decompress_parallel
+#pragma weak pglz_frame_rawsize
+#pragma weak pglz_decompress_frame_range
+
 /* Simple xorshift64 PRNG */
 static uint64_t rng_state = 0x123456789ABCDEF0ULL;
 static uint64_t xorshift64(void)
@@ -124,6 +166,977 @@ static int test_roundtrip(const char *name, char *input, int len)
     return 0;
 }
 
+/*
+ * Compress with a caller-owned context and check that the output is
+ * byte-identical to pglz_compress().  Two contexts are used alternately
+ * and reused across sizes, so stale state from an earlier, larger call
+ * would show up as a mismatch.
+ */
+static int test_context(const char *name, char *input, int len,
+                        PGLZ_Context *ctx)
+{
+    int output_len = PGLZ_MAX_OUTPUT(len);
+    char *expected = malloc(output_len);
+    char *compressed = malloc(output_len);
+    char *decompressed = malloc(len + 1);
+    int failed = 0;
+
+    if (!expected || !compressed || !decompressed) {
+        fprintf(stderr, "  FAIL %s len=%d: malloc failed\n", name, len);
+        failed = 1;
+        goto done;
+    }
+
+    int32 elen = pglz_compress(input, len, expected, PGLZ_strategy_always);
+    int32 clen = pglz_compress_ctx(ctx, input, len, compressed,
+                                   PGLZ_strategy_always);
+
+    if (clen != elen || (clen >= 0 && memcmp(expected, compressed, clen) != 0)) {
+        fprintf(stderr, "  FAIL %s len=%d: context output differs (%d vs %d)\n",
+                name, len, clen, elen);
+        failed = 1;
+        goto done;
+    }
+
+    if (clen >= 0) {
+        int32 dlen = pglz_decompress(compressed, clen, decompressed, len, true);
+        if (dlen != len || memcmp(input, decompressed, len) != 0) {
+            fprintf(stderr, "  FAIL %s len=%d: context roundtrip mismatch\n",
+                    name, len);
+            failed = 1;
+            goto done;
+        }
+    }
+
+done:
+    free(expected);
+    free(compressed);
+    free(decompressed);
+    return failed;
+}
+
+/*
+ * Extract prefixes with pglz_decompress_slice() into buffers of exactly
+ * PGLZ_SLICE_BUFSIZE bytes (so ASan catches scratch overruns) and check
+ * them against pglz_decompress(..., check_complete = false), both with
+ * the full source and with slen cut down the way TOAST slicing does.
+ */
+static int test_slice(const char *name, char *input, int len)
+{
+    int prefixes[] = { 0, 1, 7, 8, 9, 100, 1023, 1024, 1025, len - 1, len };
+    int nprefixes = sizeof(prefixes) / sizeof(prefixes[0]);
+    char *compressed = malloc(PGLZ_MAX_OUTPUT(len));
+    int failed = 0;
+
+    if (!compressed) {
+        fprintf(stderr, "  FAIL %s len=%d: malloc failed\n", name, len);
+        return 1;
+    }
+
+    int32 clen = pglz_compress(input, len, compressed, PGLZ_strategy_always);
+    if (clen < 0) {
+        free(compressed);
+        return 0;
+    }
+
+    for (int i = 0; i < nprefixes && !failed; i++) {
+        int32 rawsize = prefixes[i];
+
+        if (rawsize < 0 || rawsize > len)
+            continue;
+
+        for (int cut = 0; cut < 2 && !failed; cut++) {
+            int32 slen = cut ? pglz_maximum_compressed_size(rawsize, clen) : clen;
+            char *expected = malloc(rawsize + 1);
+            char *slice = malloc(PGLZ_SLICE_BUFSIZE(rawsize));
+
+            if (!expected || !slice) {
+                fprintf(stderr, "  FAIL %s len=%d: malloc failed\n", name, len);
+                failed = 1;
+            } else {
+                int32 elen = pglz_decompress(compressed, slen, expected,
+                                             rawsize, false);
+                int32 dlen = pglz_decompress_slice(compressed, slen, slice,
+                                                   rawsize);
+
+                if (dlen != elen || dlen != rawsize ||
+                    memcmp(expected, slice, rawsize) != 0 ||
+                    memcmp(input, slice, rawsize) != 0) {
+                    fprintf(stderr, "  FAIL %s len=%d prefix=%d slen=%d: slice returned %d (expected %d)\n",
+                            name, len, rawsize, slen, dlen, elen);
+                    failed = 1;
+                }
+            }
+            free(expected);
+            free(slice);
+        }
+    }
+
+    free(compressed);
+    return failed;
+}
+
+/*
+ * Read a frame back with pglz_decompress_parallel() on 1 to 4 threads
+ * and in ranges with pglz_decompress_frame_range(), each range into an
+ * exact-size allocation: all of it, empty ones, single bytes at both
+ * ends, ones across chunk boundaries and random ones.  Ranges past the
+ * end and a frame whose last index entry was changed must be rejected.
+ */
+static int test_frame_read(const char *name, const char *input, int len,
+                           char *frame, int32 flen)
+{
+    PGLZ_Context *ctx = pglz_context_create();
+    char *decompressed = malloc(len);
+    int failed = 0;
+
+    for (int nthreads = 1; nthreads <= 4; nthreads++) {
+        if (pglz_decompress_parallel(frame, flen, decompressed, len, nthreads) != len ||
+            memcmp(input, decompressed, len) != 0) {
+            fprintf(stderr, "  FAIL %s len=%d: %d-thread decompression\n",
+                    name, len, nthreads);
+            failed = 1;
+        }
+    }
+    if (pglz_frame_rawsize(frame, flen) != len) {
+        fprintf(stderr, "  FAIL %s len=%d: pglz_frame_rawsize\n", name, len);
+        failed = 1;
+    }
+
+    rng_seed(len);
+    for (int k = 0; k < 24; k++) {
+        int32 off, n;
+
+        switch (k) {
+            case 0: off = 0; n = len; break;
+            case 1: off = 0; n = 0; break;
+            case 2: off = len; n = 0; break;
+            case 3: off = 0; n = 1; break;
+            case 4: off = len - 1; n = 1; break;
+            case 5: off = PGLZ_FRAME_CHUNK_SIZE - 1; n = 2; break;
+            case 6: off = PGLZ_FRAME_CHUNK_SIZE; n = PGLZ_FRAME_CHUNK_SIZE; break;
+            default:
+                off = xorshift64() % len;
+                n = xorshift64() % (len - off + 1);
+                break;
+        }
+        if ((int64) off + n > len)
+            continue;
+
+        char *out = malloc(n > 0 ? n : 1);
+
+        if (pglz_decompress_frame_range(ctx, frame, flen, out, off, n) != n ||
+            memcmp(input + off, out, n) != 0) {
+            fprintf(stderr, "  FAIL %s len=%d: range %d+%d\n", name, len, off, n);
+            failed = 1;
+        }
+        free(out);
+    }
+
+    if (pglz_decompress_frame_range(ctx, frame, flen, decompressed, len, 1) != -1 ||
+        pglz_decompress_frame_range(ctx, frame, flen, decompressed, -1, 1) != -1) {
+        fprintf(stderr, "  FAIL %s len=%d: range outside the frame accepted\n",
+                name, len);
+        failed = 1;
+    }
+
+    /* The last index entry must end the frame */
+    int nchunks = PGLZ_FRAME_NCHUNKS(len);
+    unsigned char *last = (unsigned char *) frame + PGLZ_FRAME_HEADER_SIZE +
+        4 * (nchunks - 1);
+
+    last[0] ^= 1;
+    if (pglz_decompress_parallel(frame, flen, decompressed, len, 2) != -1 ||
+        pglz_decompress_frame_range(ctx, frame, flen, decompressed, 0, 1) != -1 ||
+        pglz_frame_rawsize(frame, flen) != -1) {
+        fprintf(stderr, "  FAIL %s len=%d: corrupted index accepted\n", name, len);
+        failed = 1;
+    }
+    last[0] ^= 1;
+
+    free(decompressed);
+    pglz_context_free(ctx);
+    return failed;
+}
+
+/*
+ * Compress into a parallel frame with 1, 2 and 4 threads, check that the
+ * frames are identical, that chunks are byte-identical to pglz_compress()
+ * of the same chunk, and that pglz_decompress_frame() restores the input
+ * and rejects a wrong rawsize and a truncated frame.
+ */
+static int test_frame(const char *name, char *input, int len)
+{
+    int64 max_out = PGLZ_FRAME_MAX_OUTPUT(len);
+    char *frame[3];
+    int32 flen[3];
+    char *decompressed = malloc(len + 1);
+    char *chunk = malloc(PGLZ_MAX_OUTPUT(PGLZ_FRAME_CHUNK_SIZE));
+    int threads[3] = { 1, 2, 4 };
+    int failed = 0;
+
+    for (int i = 0; i < 3; i++)
+        frame[i] = malloc(max_out);
+    if (!decompressed || !chunk || !frame[0] || !frame[1] || !frame[2]) {
+        fprintf(stderr, "  FAIL %s len=%d: malloc failed\n", name, len);
+        failed = 1;
+        goto done;
+    }
+
+    for (int i = 0; i < 3; i++)
+        flen[i] = pglz_compress_parallel(input, len, frame[i],
+                                         PGLZ_strategy_always, threads[i]);
+
+    for (int i = 1; i < 3; i++) {
+        if (flen[i] != flen[0] ||
+            (flen[0] >= 0 && memcmp(frame[0], frame[i], flen[0]) != 0)) {
+            fprintf(stderr, "  FAIL %s len=%d: %d-thread frame differs (%d vs %d)\n",
+                    name, len, threads[i], flen[i], flen[0]);
+            failed = 1;
+            goto done;
+        }
+    }
+
+    if (flen[0] < 0)
+        goto done;              /* incompressible as a whole */
+
+    /* The first chunk's data must be what pglz_compress() makes of it */
+    int first = len < PGLZ_FRAME_CHUNK_SIZE ? len : PGLZ_FRAME_CHUNK_SIZE;
+    int32 clen = pglz_compress(input, first, chunk, PGLZ_strategy_always);
+    int nchunks = PGLZ_FRAME_NCHUNKS(len);
+    const char *data = frame[0] + PGLZ_FRAME_HEADER_SIZE + 4 * nchunks;
+
+    if (clen >= 0 && memcmp(data, chunk, clen) != 0) {
+        fprintf(stderr, "  FAIL %s len=%d: first chunk differs from pglz_compress\n",
+                name, len);
+        failed = 1;
+        goto done;
+    }
+
+    decompressed[len] = 0xAA;
+    int32 dlen = pglz_decompress_frame(frame[0], flen[0], decompressed, len);
+    if (dlen != len || memcmp(input, decompressed, len) != 0 ||
+        (unsigned char)decompressed[len] != 0xAA) {
+        fprintf(stderr, "  FAIL %s len=%d: frame roundtrip mismatch (%d)\n",
+                name, len, dlen);
+        failed = 1;
+        goto done;
+    }
+
+    if (pglz_decompress_frame(frame[0], flen[0], decompressed, len - 1) != -1 ||
+        pglz_decompress_frame(frame[0], flen[0] - 1, decompressed, len) != -1) {
+        fprintf(stderr, "  FAIL %s len=%d: bad frame not rejected\n", name, len);
+        failed = 1;
+    }
+
+    if (pglz_decompress_parallel != NULL)
+        failed |= test_frame_read(name, input, len, frame[0], flen[0]);
+
+done:
+    for (int i = 0; i < 3; i++)
+        free(frame[i]);
+    free(decompressed);
+    free(chunk);
+    return failed;
+}
+
+/*
+ * Compress one datum per boundary size, alternating input types, in a
+ * single pglz_compress_batch() call (largest first, so stale history
+ * would show), and check each result against pglz_compress().  With a
+ * ctx, pglz_compress_batch_ctx() is called on it instead.  Each datum
+ * gets its own exact-size allocations for ASan.
+ */
+static int test_batch(PGLZ_Context *ctx, const int *sizes, int nsizes,
+                      int rounds)
+{
+    const char **srcs = calloc(nsizes, sizeof(char *));
+    char **dests = calloc(nsizes, sizeof(char *));
+    int32 *lens = calloc(nsizes, sizeof(int32));
+    int32 *out_lens = calloc(nsizes, sizeof(int32));
+    char *expected = malloc(PGLZ_MAX_OUTPUT(65536));
+    int failed = 0;
+
+    if (!srcs || !dests || !lens || !out_lens || !expected) {
+        fprintf(stderr, "  FAIL batch: malloc failed\n");
+        failed = 1;
+        goto done;
+    }
+
+    for (int i = 0; i < nsizes; i++) {
+        char *src;
+
+        lens[i] = sizes[nsizes - 1 - i];
+        src = malloc(lens[i] ? lens[i] : 1);
+        dests[i] = malloc(PGLZ_MAX_OUTPUT(lens[i]));
+        srcs[i] = src;
+        if (!src || !dests[i]) {
+            fprintf(stderr, "  FAIL batch: malloc failed\n");
+            failed = 1;
+            goto done;
+        }
+        if (i % 3 == 0)
+            gen_compressible(src, lens[i]);
+        else if (i % 3 == 1)
+            gen_random(src, lens[i]);
+        else
+            gen_degenerate(src, lens[i]);
+    }
+
+    for (int r = 0; r < rounds && !failed; r++) {
+        int ncompressed = ctx
+            ? pglz_compress_batch_ctx(ctx, srcs, lens, dests, out_lens,
+                                      nsizes, PGLZ_strategy_always)
+            : pglz_compress_batch(srcs, lens, dests, out_lens, nsizes,
+                                  PGLZ_strategy_always);
+        int nexpected = 0;
+
+        for (int i = 0; i < nsizes; i++) {
+            int32 elen = pglz_compress(srcs[i], lens[i], expected,
+                                       PGLZ_strategy_always);
+
+            if (elen >= 0)
+                nexpected++;
+            if (out_lens[i] != elen ||
+                (elen >= 0 && memcmp(expected, dests[i], elen) != 0)) {
+                fprintf(stderr, "  FAIL batch len=%d: output differs (%d vs %d)\n",
+                        lens[i], out_lens[i], elen);
+                failed = 1;
+                break;
+            }
+        }
+        if (!failed && ncompressed != nexpected) {
+            fprintf(stderr, "  FAIL batch: returned %d, expected %d\n",
+                    ncompressed, nexpected);
+            failed = 1;
+        }
+    }
+
+done:
+    for (int i = 0; srcs && dests && i < nsizes; i++) {
+        free((char *) srcs[i]);
+        free(dests[i]);
+    }
+    free(srcs);
+    free(dests);
+    free(lens);
+    free(out_lens);
+    free(expected);
+    return failed;
+}
+
+/*
+ * Compress with an extended strategy, through pglz_compress_ext() and a
+ * reused generation-tagged context, and check that both agree and round
+ * trip.  With the default skip settings the output must also match
+ * pglz_compress().  Sampling may only turn an input that would compress
+ * into a failure for random data, and must not change any output.
+ */
+static int test_strategy_ext(const char *name, char *input, int len,
+                             const PGLZ_StrategyExt *strategy,
+                             PGLZ_Context *ctx)
+{
+    int output_len = PGLZ_MAX_OUTPUT(len);
+    char *compressed = malloc(output_len);
+    char *other = malloc(output_len);
+    char *decompressed = malloc(len + 1);
+    int failed = 0;
+
+    if (!compressed || !other || !decompressed) {
+        fprintf(stderr, "  FAIL %s len=%d: malloc failed\n", name, len);
+        failed = 1;
+        goto done;
+    }
+
+    int32 clen = pglz_compress_ext(input, len, compressed, strategy);
+    int32 olen = pglz_compress_ctx_ext(ctx, input, len, other, strategy);
+
+    if (olen != clen || (clen >= 0 && memcmp(compressed, other, clen) != 0)) {
+        fprintf(stderr, "  FAIL %s len=%d skip=%d/%d: context output differs (%d vs %d)\n",
+                name, len, strategy->skip_threshold, strategy->skip_rate,
+                olen, clen);
+        failed = 1;
+        goto done;
+    }
+
+    if (strategy->sample_size != 0) {
+        PGLZ_StrategyExt unsampled = *strategy;
+
+        unsampled.sample_size = 0;
+        olen = pglz_compress_ext(input, len, other, &unsampled);
+        if (clen < 0 && olen >= 0 && strcmp(name, "random") != 0) {
+            fprintf(stderr, "  FAIL %s len=%d sample=%d: sampling rejected compressible input\n",
+                    name, len, strategy->sample_size);
+            failed = 1;
+            goto done;
+        }
+        if (clen >= 0 && (olen != clen || memcmp(compressed, other, clen) != 0)) {
+            fprintf(stderr, "  FAIL %s len=%d sample=%d: sampling changed the output\n",
+                    name, len, strategy->sample_size);
+            failed = 1;
+            goto done;
+        }
+    }
+    else if (strategy->skip_threshold == PGLZ_SKIP_THRESHOLD_DEFAULT &&
+             strategy->skip_rate == PGLZ_SKIP_RATE_DEFAULT &&
+             strategy->lazy_steps == 0 && strategy->hash_size == 0 &&
+             strategy->bucket_ways == 0) {
+        olen = pglz_compress(input, len, other, &strategy->base);
+        if (olen != clen || (clen >= 0 && memcmp(compressed, other, clen) != 0)) {
+            fprintf(stderr, "  FAIL %s len=%d: default settings differ from pglz_compress\n",
+                    name, len);
+            failed = 1;
+            goto done;
+        }
+    }
+
+    if (clen >= 0) {
+        int32 dlen = pglz_decompress(compressed, clen, decompressed, len, true);
+        if (dlen != len || memcmp(input, decompressed, len) != 0) {
+            fprintf(stderr, "  FAIL %s len=%d skip=%d/%d: roundtrip mismatch\n",
+                    name, len, strategy->skip_threshold, strategy->skip_rate);
+            failed = 1;
+        }
+    }
+
+done:
+    free(compressed);
+    free(other);
+    free(decompressed);
+    return failed;
+}
+
+/*
+ * Compress with each standard strategy through its fixed-strategy entry
+ * point and through pglz_compress_ctx() on a generation-tagged context,
+ * and check that both produce exactly what a copy of the strategy (which
+ * takes the generic code) does with pglz_compress(), and round trip.
+ */
+static int test_fixed(const char *name, char *input, int len, PGLZ_Context *ctx)
+{
+    const PGLZ_Strategy *strategies[2] = {
+        PGLZ_strategy_default, PGLZ_strategy_always
+    };
+    int32 (*const fixed[2]) (const char *, int32, char *) = {
+        pglz_compress_default, pglz_compress_always
+    };
+    char *expected = malloc(PGLZ_MAX_OUTPUT(len));
+    char *compressed = malloc(PGLZ_MAX_OUTPUT(len));
+    char *decompressed = malloc(len + 1);
+    int failed = 0;
+
+    for (int k = 0; k < 2 && !failed; k++) {
+        PGLZ_Strategy copy = *strategies[k];
+        int32 elen = pglz_compress(input, len, expected, &copy);
+
+        for (int path = 0; path < 2 && !failed; path++) {
+            int32 clen = path == 0 ? fixed[k](input, len, compressed)
+                                   : pglz_compress_ctx(ctx, input, len, compressed,
+                                                       strategies[k]);
+
+            if (clen != elen || (clen >= 0 && memcmp(expected, compressed, clen) != 0)) {
+                fprintf(stderr, "  FAIL %s len=%d strategy=%d path=%d: differs from generic code (%d vs %d)\n",
+                        name, len, k, path, clen, elen);
+                failed = 1;
+            }
+        }
+        if (!failed && elen >= 0) {
+            int32 dlen = pglz_decompress(expected, elen, decompressed, len, true);
+            if (dlen != len || memcmp(input, decompressed, len) != 0) {
+                fprintf(stderr, "  FAIL %s len=%d strategy=%d: roundtrip mismatch\n",
+                        name, len, k);
+                failed = 1;
+            }
+        }
+    }
+
+    free(expected);
+    free(compressed);
+    free(decompressed);
+    return failed;
+}
+
+/*
+ * Compress once with the counters reset and check that they add up: one
+ * call, every input byte either added to the history or skipped, and the
+ * output made of exactly the literals and matches counted.  A build
+ * without PGLZ_STATS must report false and all zeros.
+ */
+static int test_stats(const char *name, char *input, int len,
+                      const PGLZ_Strategy *strategy)
+{
+    char *compressed = malloc(PGLZ_MAX_OUTPUT(len));
+    PGLZ_Stats st;
+    uint64 nmatches = 0;
+    int failed = 0;
+
+    pglz_reset_stats();
+    int32 clen = pglz_compress(input, len, compressed, strategy);
+    if (!pglz_get_stats(&st)) {
+        static const PGLZ_Stats zero;
+
+        if (memcmp(&st, &zero, sizeof(st)) != 0) {
+            fprintf(stderr, "  FAIL %s len=%d: counters without PGLZ_STATS\n",
+                    name, len);
+            failed = 1;
+        }
+        free(compressed);
+        return failed;
+    }
+
+    for (int b = 0; b < PGLZ_STATS_MATCH_BUCKETS; b++)
+        nmatches += st.matches[b];
+    uint64 bailouts = st.bailout_strategy + st.bailout_sample +
+                      st.bailout_first_success + st.bailout_ratio;
+
+    if (st.calls != 1 || st.bytes_in != (uint64) len ||
+        st.compressed != (clen >= 0) || bailouts != (clen < 0)) {
+        fprintf(stderr, "  FAIL %s len=%d: calls=%llu compressed=%llu bailouts=%llu for clen=%d\n",
+                name, len, (unsigned long long) st.calls,
+                (unsigned long long) st.compressed,
+                (unsigned long long) bailouts, clen);
+        failed = 1;
+    } else if (clen >= 0 &&
+               (st.bytes_out != (uint64) clen ||
+                st.hist_adds + st.skipped_positions != (uint64) len ||
+                st.literals + 2 * nmatches + (nmatches + st.literals + 7) / 8 > (uint64) clen ||
+                st.literals + 3 * nmatches + (nmatches + st.literals + 7) / 8 < (uint64) clen)) {
+        fprintf(stderr, "  FAIL %s len=%d: adds=%llu skipped=%llu literals=%llu matches=%llu for clen=%d\n",
+                name, len, (unsigned long long) st.hist_adds,
+                (unsigned long long) st.skipped_positions,
+                (unsigned long long) st.literals,
+                (unsigned long long) nmatches, clen);
+        failed = 1;
+    } else if (st.searches > 0 &&
+               st.chain_limit_stops + st.good_match_stops + st.offset_stops +
+               st.dead_chain_stops > st.searches) {
+        fprintf(stderr, "  FAIL %s len=%d: more search stops than searches\n",
+                name, len);
+        failed = 1;
+    }
+
+    free(compressed);
+    return failed;
+}
+
+/*
+ * PGLZ_Allocator callbacks that count what they hand out.
+ */
+typedef struct CountingAllocator {
+    int64 allocs;
+    int64 frees;
+    int64 live_bytes;
+} CountingAllocator;
+
+static void *counting_alloc(size_t size, void *arg)
+{
+    CountingAllocator *ca = arg;
+
+    ca->allocs++;
+    ca->live_bytes += size;
+    return malloc(size);
+}
+
+static void counting_free(void *ptr, size_t size, void *arg)
+{
+    CountingAllocator *ca = arg;
+
+    ca->frees++;
+    ca->live_bytes -= size;
+    free(ptr);
+}
+
+/*
+ * Roundtrip every size through a context's own buffers, rounds times over.
+ * Each buffer is filled to its documented size first, so ASan sees any
+ * shortfall.  Only the first round may allocate: the rest must reuse what
+ * it left.  Then a run of tiny requests must give the big buffers back,
+ * and pglz_context_shrink() and pglz_context_free() the rest.
+ */
+static int test_arena(char *input, const int *sizes, int nsizes, int rounds)
+{
+    CountingAllocator ca = {0};
+    PGLZ_Allocator allocator = { counting_alloc, counting_free, &ca };
+    PGLZ_Context *ctx = pglz_context_create_allocator(0, &allocator);
+    int64 ctx_bytes = ca.live_bytes;
+    int64 warm_allocs = 0;
+    int failed = 0;
+
+    if (ctx == NULL || ca.allocs != 1) {
+        fprintf(stderr, "  FAIL context not allocated through the callbacks\n");
+        return 1;
+    }
+
+    for (int r = 0; r < rounds && !failed; r++) {
+        for (int i = 0; i < nsizes; i++) {
+            int len = sizes[i];
+            char *out = pglz_context_output_buffer(ctx, len);
+            char *raw = pglz_context_raw_buffer(ctx, len);
+
+            if (out == NULL || raw == NULL) {
+                fprintf(stderr, "  FAIL len=%d: no buffer\n", len);
+                failed = 1;
+                break;
+            }
+            memset(out, 0, PGLZ_MAX_OUTPUT(len));
+            memset(raw, 0, PGLZ_SLICE_BUFSIZE(len));
+
+            gen_compressible(input, len);
+            int32 clen = pglz_compress_ctx(ctx, input, len, out,
+                                           PGLZ_strategy_always);
+            if (clen < 0)
+                continue;
+            int32 dlen = pglz_decompress(out, clen, raw, len, true);
+            if (dlen != len || memcmp(input, raw, len) != 0) {
+                fprintf(stderr, "  FAIL len=%d round=%d: roundtrip\n", len, r);
+                failed = 1;
+            }
+            if (pglz_decompress_slice != NULL && len >= 2) {
+                /* The slack past the slice is the raw buffer's too */
+                dlen = pglz_decompress_slice(out, clen, raw, len / 2);
+                if (dlen != len / 2 || memcmp(input, raw, len / 2) != 0) {
+                    fprintf(stderr, "  FAIL len=%d round=%d: slice\n", len, r);
+                    failed = 1;
+                }
+            }
+        }
+        if (r == 0)
+            warm_allocs = ca.allocs;
+    }
+    if (!failed && ca.allocs != warm_allocs) {
+        fprintf(stderr, "  FAIL %lld allocations after the first round\n",
+                (long long) (ca.allocs - warm_allocs));
+        failed = 1;
+    }
+
+    /* Two windows of tiny requests shrink both buffers to a few KiB */
+    int64 big = ca.live_bytes;
+    for (int i = 0; i < 2 * 64; i++) {
+        pglz_context_output_buffer(ctx, 16);
+        pglz_context_raw_buffer(ctx, 16);
+    }
+    if (ca.live_bytes >= big || ca.live_bytes - ctx_bytes > 16384) {
+        fprintf(stderr, "  FAIL buffers not shrunk: %lld live bytes, %lld before\n",
+                (long long) ca.live_bytes, (long long) big);
+        failed = 1;
+    }
+
+    int64 with_buffers = ca.live_bytes;
+    pglz_context_shrink(ctx, 0);
+    if (ca.frees != ca.allocs - 1 || ca.live_bytes >= with_buffers) {
+        fprintf(stderr, "  FAIL pglz_context_shrink left buffers\n");
+        failed = 1;
+    }
+    if (pglz_context_output_buffer(ctx, -1) != NULL ||
+        pglz_context_raw_buffer(ctx, -1) != NULL) {
+        fprintf(stderr, "  FAIL buffer for a negative size\n");
+        failed = 1;
+    }
+    pglz_context_output_buffer(ctx, 100000);
+    pglz_context_free(ctx);
+    if (ca.frees != ca.allocs || ca.live_bytes != 0) {
+        fprintf(stderr, "  FAIL pglz_context_free leaked %lld bytes\n",
+                (long long) ca.live_bytes);
+        failed = 1;
+    }
+    return failed;
+}
+
+/*
+ * Estimate the rate of every size with several samples, including ones
+ * larger than the input and nonsense ones: the estimate must be 0-100,
+ * and on the inputs that are clearly one thing or the other, on the right
+ * side of PGLZ_strategy_default's 25%.  ASan checks that no window reads
+ * past the input.
+ */
+static int test_estimate(char *input, const int *sizes, int nsizes)
+{
+    static const int32 samples[] = { 0, -1, 1, 100, 512, 4096, 1 << 30 };
+    int failed = 0;
+
+    for (int i = 0; i < nsizes; i++) {
+        int len = sizes[i];
+
+        for (int type = 0; type < 3; type++) {
+            if (type == 0)
+                gen_compressible(input, len);
+            else if (type == 1)
+                gen_random(input, len);
+            else
+                gen_degenerate(input, len);
+
+            for (int k = 0; k < (int) (sizeof(samples) / sizeof(samples[0])); k++) {
+                int32 est = pglz_estimate_ratio(input, len, samples[k]);
+                bool wrong_side = samples[k] == 0 && len >= 1024 &&
+                    (type == 1 ? est >= 25 : est < 25);
+
+                if (est < 0 || est > 100 || wrong_side) {
+                    fprintf(stderr, "  FAIL type=%d len=%d sample=%d: estimate %d\n",
+                            type, len, samples[k], est);
+                    failed = 1;
+                }
+            }
+        }
+    }
+    if (pglz_estimate_ratio(NULL, 0, 0) != 0) {
+        fprintf(stderr, "  FAIL estimate of nothing\n");
+        failed = 1;
+    }
+    return failed;
+}
+
+/*
+ * Compress input against dictionaries of several sizes, each in an
+ * exact-size allocation so that ASan sees any read past it: one that is
+ * the start of the input itself, and a random one.  What compresses must
+ * decompress with the same dictionary, and fail cleanly with a truncated
+ * one.  An input that is all dictionary must shrink to almost
+ * nothing, and plain pglz_decompress() must then reject it; tags do not
+ * reach back a full PGLZ_DICT_MAX_SIZE bytes, so that is not checked
+ * there.
+ */
+static int test_dict(char *input, int len, PGLZ_Context *ctx)
+{
+    static const int32 dictlens[] = { 1, 128, 2048, PGLZ_DICT_MAX_SIZE };
+    int failed = 0;
+
+    for (int k = 0; k < (int) (sizeof(dictlens) / sizeof(dictlens[0])); k++) {
+        for (int kind = 0; kind < 2; kind++) {
+            int32 dictlen = dictlens[k];
+            bool copy = kind == 0 && dictlen == len && dictlen >= 100 &&
+                dictlen < PGLZ_DICT_MAX_SIZE;
+            char *dict = malloc(dictlen);
+            char *comp = malloc(PGLZ_MAX_OUTPUT(len));
+            char *decomp = malloc(len > 0 ? len : 1);
+            int32 clen, dlen;
+
+            if (kind == 0 && dictlen <= len)
+                memcpy(dict, input, dictlen);
+            else
+                gen_random(dict, dictlen);
+
+            clen = pglz_compress_ctx_dict(ctx, input, len, comp,
+                                          PGLZ_strategy_always, dict, dictlen);
+            if (clen < 0) {
+                if (copy) {
+                    fprintf(stderr, "  FAIL len=%d dict=%d: compress failed\n",
+                            len, dictlen);
+                    failed = 1;
+                }
+            } else {
+                dlen = pglz_decompress_dict(comp, clen, decomp, len, true,
+                                            dict, dictlen);
+                if (dlen != len || memcmp(input, decomp, len) != 0) {
+                    fprintf(stderr, "  FAIL len=%d dict=%d/%d: roundtrip\n",
+                            len, dictlen, kind);
+                    failed = 1;
+                }
+                if (copy &&
+                    (clen > len / 16 ||
+                     pglz_decompress(comp, clen, decomp, len, true) >= 0)) {
+                    fprintf(stderr, "  FAIL len=%d dict=%d: %d bytes for a copy of the dictionary\n",
+                            len, dictlen, clen);
+                    failed = 1;
+                }
+
+                /* Only ASan can fail these: the results are not checked */
+                pglz_decompress_dict(comp, clen, decomp, len, false,
+                                     dict + dictlen / 2, dictlen - dictlen / 2);
+                pglz_decompress_dict(comp, clen / 2, decomp, len, false,
+                                     dict, dictlen);
+            }
+            free(dict);
+            free(comp);
+            free(decomp);
+        }
+    }
+    if (pglz_compress_ctx_dict(ctx, input, len, NULL, PGLZ_strategy_always,
+                               input, PGLZ_DICT_MAX_SIZE + 1) != -1 ||
+        pglz_decompress_dict(input, len, NULL, 0, true, input, -1) != -1) {
+        fprintf(stderr, "  FAIL len=%d: bad dictlen accepted\n", len);
+        failed = 1;
+    }
+    return failed;
+}
+
+/*
+ * Feed input to a stream in pieces of 0..max_piece bytes, each into its
+ * own exact-size output allocation, and check that the joined output
+ * decompresses with plain pglz_decompress().  From 64 KiB on, where
+ * pglz_compress() uses as many hash buckets as a stream does whatever its
+ * sizing tiers, it must also match pglz_compress() of the whole input
+ * where that succeeds.
+ */
+static int test_stream(const char *name, char *input, int len, int max_piece)
+{
+    int64 cap = PGLZ_STREAM_MAX_OUTPUT((int64) len) + PGLZ_STREAM_MAX_OUTPUT(0);
+    char *joined = malloc(cap);
+    char *expected = malloc(PGLZ_MAX_OUTPUT(len));
+    char *decompressed = malloc(len + 1);
+    PGLZ_Stream *stream = pglz_stream_begin(PGLZ_strategy_always);
+    int32 total = 0;
+    int pos = 0;
+    int failed = 0;
+
+    if (!joined || !expected || !decompressed || !stream) {
+        fprintf(stderr, "  FAIL %s len=%d: malloc failed\n", name, len);
+        failed = 1;
+        goto done;
+    }
+
+    for (;;) {
+        int piece = pos < len ? (int) (xorshift64() % (max_piece + 1)) : 0;
+        char *src, *out;
+        int32 n;
+
+        if (piece > len - pos)
+            piece = len - pos;
+        src = malloc(piece ? piece : 1);
+        out = malloc(PGLZ_STREAM_MAX_OUTPUT(piece));
+        if (!src || !out) {
+            fprintf(stderr, "  FAIL %s len=%d: malloc failed\n", name, len);
+            free(src);
+            free(out);
+            failed = 1;
+            goto done;
+        }
+        memcpy(src, input + pos, piece);
+        if (pos < len)
+            n = pglz_stream_update(stream, src, piece, out);
+        else
+            n = pglz_stream_end(stream, out);
+        if (n >= 0 && n <= PGLZ_STREAM_MAX_OUTPUT(piece))
+            memcpy(joined + total, out, n);
+        free(src);
+        free(out);
+        if (n < 0 || n > PGLZ_STREAM_MAX_OUTPUT(piece)) {
+            fprintf(stderr, "  FAIL %s len=%d: stream returned %d\n", name, len, n);
+            failed = 1;
+            if (pos < len)
+                pglz_stream_end(stream, NULL);
+            stream = NULL;
+            goto done;
+        }
+        total += n;
+        if (pos == len)
+            break;
+        pos += piece;
+    }
+    stream = NULL;
+
+    decompressed[len] = 0xAA;
+    int32 dlen = pglz_decompress(joined, total, decompressed, len, true);
+    if (dlen != len || memcmp(input, decompressed, len) != 0 ||
+        (unsigned char)decompressed[len] != 0xAA) {
+        fprintf(stderr, "  FAIL %s len=%d piece<=%d: stream roundtrip mismatch (%d)\n",
+                name, len, max_piece, dlen);
+        failed = 1;
+        goto done;
+    }
+
+    int32 elen = pglz_compress(input, len, expected, PGLZ_strategy_always);
+    if (len >= 65536 && elen >= 0 &&
+        (elen != total || memcmp(expected, joined, elen) != 0)) {
+        fprintf(stderr, "  FAIL %s len=%d piece<=%d: differs from pglz_compress (%d vs %d)\n",
+                name, len, max_piece, total, elen);
+        failed = 1;
+    }
+
+done:
+    if (stream)
+        pglz_stream_end(stream, NULL);
+    free(joined);
+    free(expected);
+    free(decompressed);
+    return failed;
+}
+
+/*
+ * Feed pglz_compress() output to an incremental decoder in pieces of
+ * 0..max_piece bytes, each in its own exact-size allocation, so pieces
+ * split tags at every possible point.  Progress must never go backwards
+ * and the result must match the input.  Then stop a second decoder
+ * halfway through the input, and check that a one-byte-short input is
+ * rejected with check_complete.
+ */
+static int test_decode_stream(const char *name, char *input, int len,
+                              int max_piece)
+{
+    char *compressed = malloc(PGLZ_MAX_OUTPUT(len));
+    char *decompressed = malloc(len + 1);
+    int failed = 0;
+
+    if (!compressed || !decompressed) {
+        fprintf(stderr, "  FAIL %s len=%d: malloc failed\n", name, len);
+        failed = 1;
+        goto done;
+    }
+
+    int32 clen = pglz_compress(input, len, compressed, PGLZ_strategy_always);
+    if (clen < 0)
+        goto done;              /* incompressible: nothing to decode */
+
+    for (int pass = 0; pass < 3 && !failed; pass++) {
+        /* pass 0: everything; 1: first half, then stop; 2: all but 1 byte */
+        int32 feed = pass == 0 ? clen : pass == 1 ? clen / 2 : clen - 1;
+        PGLZ_DecodeStream *stream;
+        int32 progress = 0;
+        int pos = 0;
+
+        decompressed[len] = 0xAA;
+        stream = pglz_decode_begin(decompressed, len);
+        if (!stream) {
+            fprintf(stderr, "  FAIL %s len=%d: malloc failed\n", name, len);
+            failed = 1;
+            break;
+        }
+
+        while (pos < feed) {
+            int piece = (int) (xorshift64() % (max_piece + 1));
+            char *src;
+            int32 n;
+
+            if (piece > feed - pos)
+                piece = feed - pos;
+            src = malloc(piece ? piece : 1);
+            if (!src) {
+                fprintf(stderr, "  FAIL %s len=%d: malloc failed\n", name, len);
+                failed = 1;
+                break;
+            }
+            memcpy(src, compressed + pos, piece);
+            n = pglz_decode_update(stream, src, piece);
+            free(src);
+            if (n < progress || n > len) {
+                fprintf(stderr, "  FAIL %s len=%d piece<=%d: progress %d after %d\n",
+                        name, len, max_piece, n, progress);
+                failed = 1;
+                break;
+            }
+            progress = n;
+            pos += piece;
+        }
+
+        int32 dlen = pglz_decode_end(stream, pass != 1);
+        if (failed)
+            break;
+        if ((pass == 0 && (dlen != len || memcmp(input, decompressed, len) != 0)) ||
+            (pass == 1 && (dlen != progress ||
+                           memcmp(input, decompressed, progress) != 0)) ||
+            (pass == 2 && dlen != -1) ||
+            (unsigned char)decompressed[len] != 0xAA) {
+            fprintf(stderr, "  FAIL %s len=%d piece<=%d pass=%d: decoded %d\n",
+                    name, len, max_piece, pass, dlen);
+            failed = 1;
+        }
+    }
+
+done:
+    free(compressed);
+    free(decompressed);
+    return failed;
+}
+
 int main(void)
 {
     /* Critical boundary sizes from SPEC.md */
@@ -186,6 +1199,549 @@ int main(void)
     printf("\n--- edge cases ---\n");
     failures += test_roundtrip("zero-len", buf, 0);
 
+    /* Test caller-owned contexts, if the variant has them */
+    printf("\n--- context ---\n");
+    if (pglz_context_create == NULL) {
+        printf("  SKIP (variant has no PGLZ_Context)\n");
+    } else {
+        PGLZ_Context *ctx[2] = { pglz_context_create(), pglz_context_create() };
+        int nctx_failures = 0;
+
+        if (!ctx[0] || !ctx[1]) {
+            fprintf(stderr, "  FAIL pglz_context_create returned NULL\n");
+            nctx_failures++;
+        } else {
+            for (int i = nsizes - 1; i >= 0; i--) {
+                if (sizes[i] == 0)
+                    continue;
+                gen_compressible(buf, sizes[i]);
+                nctx_failures += test_context("compressible", buf, sizes[i],
+                                              ctx[i & 1]);
+                gen_degenerate(buf, sizes[i]);
+                nctx_failures += test_context("degenerate", buf, sizes[i],
+                                              ctx[i & 1]);
+            }
+        }
+        printf("  %s  %d sizes x 2 types, largest first\n",
+               nctx_failures ? "FAIL" : "OK  ", nsizes - 1);
+        failures += nctx_failures;
+        pglz_context_free(ctx[0]);
+        pglz_context_free(ctx[1]);
+    }
+
+    /*
+     * Generation-tagged contexts: same checks, then enough reuses of one
+     * context to wrap the 16-bit generation counter.
+     */
+    printf("\n--- context (generations) ---\n");
+    if (pglz_context_create_extended == NULL) {
+        printf("  SKIP (variant has no pglz_context_create_extended)\n");
+    } else {
+        PGLZ_Context *gctx = pglz_context_create_extended(PGLZ_CTX_GENERATIONS);
+        int ngen_failures = 0;
+
+        if (!gctx) {
+            fprintf(stderr, "  FAIL pglz_context_create_extended returned NULL\n");
+            ngen_failures++;
+        } else {
+            for (int i = nsizes - 1; i >= 0; i--) {
+                if (sizes[i] == 0)
+                    continue;
+                gen_compressible(buf, sizes[i]);
+                ngen_failures += test_context("compressible", buf, sizes[i],
+                                              gctx);
+                gen_random(buf, sizes[i]);
+                ngen_failures += test_context("random", buf, sizes[i], gctx);
+            }
+            printf("  %s  %d sizes x 2 types, largest first\n",
+                   ngen_failures ? "FAIL" : "OK  ", nsizes - 1);
+
+            for (int i = 0; i < 70000 && ngen_failures == 0; i++) {
+                int len = 64 + (i & 255);
+                gen_compressible(buf, len);
+                ngen_failures += test_context("wrap", buf, len, gctx);
+            }
+            printf("  %s  70000 reuses (generation wraparound)\n",
+                   ngen_failures ? "FAIL" : "OK  ");
+
+            /*
+             * Inputs up to 4096 bytes may use another history layout in
+             * the same context; alternate them with ones that do not.
+             */
+            for (int i = 0; i < 64 && ngen_failures == 0; i++) {
+                int len = (i & 1) ? 4096 - (i & 7) : 4097 + 1000 * (i & 7);
+                gen_compressible(buf, len);
+                ngen_failures += test_context("alternate", buf, len, gctx);
+            }
+            printf("  %s  64 calls alternating inputs of up to and over 4 KiB\n",
+                   ngen_failures ? "FAIL" : "OK  ");
+        }
+        failures += ngen_failures;
+        pglz_context_free(gctx);
+    }
+
+    /* Prefix decompression into minimal slice buffers */
+    printf("\n--- slice ---\n");
+    if (pglz_decompress_slice == NULL) {
+        printf("  SKIP (variant has no pglz_decompress_slice)\n");
+    } else {
+        int nslice_failures = 0;
+
+        for (int i = 0; i < nsizes; i++) {
+            if (sizes[i] == 0)
+                continue;
+            gen_compressible(buf, sizes[i]);
+            nslice_failures += test_slice("compressible", buf, sizes[i]);
+            gen_degenerate(buf, sizes[i]);
+            nslice_failures += test_slice("degenerate", buf, sizes[i]);
+        }
+        printf("  %s  %d sizes x 2 types, 11 prefixes, full and cut slen\n",
+               nslice_failures ? "FAIL" : "OK  ", nsizes - 1);
+        failures += nslice_failures;
+    }
+
+    /* Batch compression, repeated to reuse the batch context */
+    printf("\n--- batch ---\n");
+    if (pglz_compress_batch == NULL) {
+        printf("  SKIP (variant has no pglz_compress_batch)\n");
+    } else {
+        int nbatch_failures = test_batch(NULL, sizes, nsizes, 3);
+
+        printf("  %s  %d datums x 3 batches, mixed types\n",
+               nbatch_failures ? "FAIL" : "OK  ", nsizes);
+        failures += nbatch_failures;
+    }
+    if (pglz_compress_batch_ctx != NULL) {
+        PGLZ_Context *bctx = pglz_context_create();
+        PGLZ_Context *bgctx = pglz_context_create_extended(PGLZ_CTX_GENERATIONS);
+        int nbatch_failures = test_batch(bctx, sizes, nsizes, 3) +
+            test_batch(bgctx, sizes, nsizes, 3);
+
+        printf("  %s  %d datums x 3 batches, caller's context, with and "
+               "without generations\n",
+               nbatch_failures ? "FAIL" : "OK  ", nsizes);
+        failures += nbatch_failures;
+        pglz_context_free(bctx);
+        pglz_context_free(bgctx);
+    }
+
+    /* Chunked parallel frames, including inputs of several chunks */
+    printf("\n--- parallel frame ---\n");
+    if (pglz_compress_parallel == NULL) {
+        printf("  SKIP (variant has no pglz_compress_parallel)\n");
+    } else {
+        int frame_sizes[] = { 1, 100, 4096, 65535, 65536, 65537,
+                              200000, 1048576 + 3 };
+        int nframe_sizes = sizeof(frame_sizes) / sizeof(frame_sizes[0]);
+        char *big = malloc(frame_sizes[nframe_sizes - 1]);
+        int nframe_failures = 0;
+
+        if (!big) {
+            fprintf(stderr, "  FAIL malloc failed\n");
+            nframe_failures++;
+        } else {
+            for (int i = 0; i < nframe_sizes; i++) {
+                gen_compressible(big, frame_sizes[i]);
+                nframe_failures += test_frame("compressible", big, frame_sizes[i]);
+                gen_degenerate(big, frame_sizes[i]);
+                nframe_failures += test_frame("degenerate", big, frame_sizes[i]);
+                gen_random(big, frame_sizes[i]);
+                nframe_failures += test_frame("random", big, frame_sizes[i]);
+            }
+            /* Compressible head, random tail: mixes raw and pglz chunks */
+            gen_compressible(big, 131072);
+            gen_random(big + 131072, 65536);
+            nframe_failures += test_frame("mixed", big, 196608);
+        }
+        printf("  %s  %d sizes x 3 types + mixed, 1/2/4 threads%s\n",
+               nframe_failures ? "FAIL" : "OK  ", nframe_sizes,
+               pglz_decompress_parallel != NULL ?
+               ", parallel and range reads" : "");
+        failures += nframe_failures;
+        free(big);
+    }
+
+    /* Streaming compression in random pieces, then one-shot decompression */
+    printf("\n--- stream ---\n");
+    if (pglz_stream_begin == NULL) {
+        printf("  SKIP (variant has no pglz_stream_begin)\n");
+    } else {
+        int stream_sizes[] = { 0, 1, 3, 4, 100, 1024, 4096, 4097, 32768,
+                               65537, 200000, 1048576 + 3 };
+        int pieces[] = { 1, 7, 300, 5000, 100000 };
+        int nstream_sizes = sizeof(stream_sizes) / sizeof(stream_sizes[0]);
+        char *big = malloc(stream_sizes[nstream_sizes - 1]);
+        int nstream_failures = 0;
+
+        if (!big) {
+            fprintf(stderr, "  FAIL malloc failed\n");
+            nstream_failures++;
+        } else {
+            for (int i = 0; i < nstream_sizes; i++) {
+                for (int j = 0; j < 5; j++) {
+                    /* One-byte pieces only where they stay quick */
+                    if (pieces[j] == 1 && stream_sizes[i] > 200000)
+                        continue;
+                    gen_compressible(big, stream_sizes[i]);
+                    nstream_failures += test_stream("compressible", big,
+                                                    stream_sizes[i], pieces[j]);
+                    gen_degenerate(big, stream_sizes[i]);
+                    nstream_failures += test_stream("degenerate", big,
+                                                    stream_sizes[i], pieces[j]);
+                    gen_random(big, stream_sizes[i]);
+                    nstream_failures += test_stream("random", big,
+                                                    stream_sizes[i], pieces[j]);
+                }
+            }
+
+            /* Abandoning a stream must release it (the leak check sees it) */
+            PGLZ_Stream *stream = pglz_stream_begin(NULL);
+            char *out = malloc(PGLZ_STREAM_MAX_OUTPUT(65536));
+
+            if (!stream || !out) {
+                fprintf(stderr, "  FAIL malloc failed\n");
+                nstream_failures++;
+            } else {
+                gen_compressible(big, 65536);
+                pglz_stream_update(stream, big, 65536, out);
+            }
+            if (stream && pglz_stream_end(stream, NULL) != 0) {
+                fprintf(stderr, "  FAIL abandoned stream returned output\n");
+                nstream_failures++;
+            }
+            free(out);
+        }
+        printf("  %s  %d sizes x 3 types, pieces of up to 1, 7, 300, 5000, 100000 bytes\n",
+               nstream_failures ? "FAIL" : "OK  ", nstream_sizes);
+        failures += nstream_failures;
+        free(big);
+    }
+
+    /* Incremental decompression of input split at arbitrary points */
+    printf("\n--- decode stream ---\n");
+    if (pglz_decode_begin == NULL) {
+        printf("  SKIP (variant has no pglz_decode_begin)\n");
+    } else {
+        int decode_pieces[] = { 1, 2, 3, 40, 2000 };
+        int ndecode_failures = 0;
+
+        for (int i = 0; i < nsizes; i++) {
+            if (sizes[i] == 0)
+                continue;
+            for (int j = 0; j < 5; j++) {
+                gen_compressible(buf, sizes[i]);
+                ndecode_failures += test_decode_stream("compressible", buf,
+                                                       sizes[i], decode_pieces[j]);
+                gen_degenerate(buf, sizes[i]);
+                ndecode_failures += test_decode_stream("degenerate", buf,
+                                                       sizes[i], decode_pieces[j]);
+            }
+        }
+        printf("  %s  %d sizes x 2 types, pieces of up to 1, 2, 3, 40, 2000 bytes\n",
+               ndecode_failures ? "FAIL" : "OK  ", nsizes - 1);
+        failures += ndecode_failures;
+    }
+
+    /*
+     * Every bucket hash the build offers, through the one-shot, context,
+     * batch and stream entry points.  Output differs between hashes, so
+     * each is checked for roundtrip and for agreement with pglz_compress()
+     * under the same hash.
+     */
+    printf("\n--- hash ---\n");
+    if (pglz_set_hash == NULL) {
+        printf("  SKIP (variant has no pglz_set_hash)\n");
+    } else {
+        static const PGLZ_HashKind kinds[] = {
+            PGLZ_HASH_STOCK, PGLZ_HASH_FIBONACCI, PGLZ_HASH_CRC32C
+        };
+        static const char *const kind_names[] = { "stock", "fibonacci", "crc32c" };
+        PGLZ_HashKind saved = pglz_get_hash();
+        PGLZ_Context *pctx = pglz_context_create();
+
+        for (int k = 0; k < 3; k++) {
+            int nhash_failures = 0;
+
+            if (!pglz_set_hash(kinds[k])) {
+                printf("  SKIP %s (not available in this build)\n", kind_names[k]);
+                continue;
+            }
+            if (pglz_get_hash() != kinds[k]) {
+                fprintf(stderr, "  FAIL pglz_get_hash after setting %s\n",
+                        kind_names[k]);
+                nhash_failures++;
+            }
+
+            /*
+             * hctx and hgctx start with the process-wide hash; pctx was
+             * created before it changed and gets it set on its own.
+             */
+            PGLZ_Context *hctx = pglz_context_create();
+            PGLZ_Context *hgctx = pglz_context_create_extended(PGLZ_CTX_GENERATIONS);
+
+            if (pglz_context_set_hash != NULL) {
+                if (!pglz_context_set_hash(pctx, kinds[k])) {
+                    fprintf(stderr, "  FAIL pglz_context_set_hash(%s)\n",
+                            kind_names[k]);
+                    nhash_failures++;
+                }
+                gen_compressible(buf, 65536);
+                nhash_failures += test_context("compressible", buf, 65536, pctx);
+            }
+
+            for (int i = nsizes - 1; i >= 0; i--) {
+                if (sizes[i] == 0)
+                    continue;
+                gen_compressible(buf, sizes[i]);
+                nhash_failures += test_context("compressible", buf, sizes[i], hctx);
+                nhash_failures += test_context("compressible", buf, sizes[i], hgctx);
+                gen_random(buf, sizes[i]);
+                nhash_failures += test_context("random", buf, sizes[i], hctx);
+                gen_degenerate(buf, sizes[i]);
+                nhash_failures += test_context("degenerate", buf, sizes[i], hgctx);
+            }
+            nhash_failures += test_batch(NULL, sizes, nsizes, 1);
+            gen_compressible(buf, 65536);
+            nhash_failures += test_stream("compressible", buf, 65536, 5000);
+
+            pglz_context_free(hctx);
+            pglz_context_free(hgctx);
+            printf("  %s  %s: %d sizes x 3 types, batch, stream\n",
+                   nhash_failures ? "FAIL" : "OK  ", kind_names[k], nsizes - 1);
+            failures += nhash_failures;
+        }
+        pglz_set_hash(saved);
+        if (pglz_context_set_hash != NULL &&
+            pglz_context_set_hash(pctx, (PGLZ_HashKind) 42)) {
+            fprintf(stderr, "  FAIL pglz_context_set_hash accepted an unknown hash\n");
+            failures++;
+        }
+        pglz_context_free(pctx);
+        if (pglz_set_hash((PGLZ_HashKind) 42)) {
+            fprintf(stderr, "  FAIL pglz_set_hash accepted an unknown hash\n");
+            failures++;
+        }
+        pglz_set_hash(saved);
+    }
+
+    /*
+     * Skip-after-match settings from never skipping to always skipping,
+     * including the adaptive defaults and out-of-range values that get
+     * clamped, and sampling sizes from one to more than the most windows.
+     */
+    printf("\n--- strategy ext ---\n");
+    if (pglz_compress_ext == NULL) {
+        printf("  SKIP (variant has no pglz_compress_ext)\n");
+    } else {
+        /*
+         * skip_threshold, skip_rate, sample_size, lazy_steps, hash_size,
+         * bucket_ways
+         */
+        static const int skip_settings[][6] = {
+            { 0, 0, 0, 0, 0, 0 }, { 3, 0, 0, 0, 0, 0 }, { 8, 0, 0, 0, 0, 0 },
+            { PGLZ_SKIP_THRESHOLD_DEFAULT, PGLZ_SKIP_RATE_DEFAULT, 0, 0, 0, 0 },
+            { 4, 1, 0, 0, 0, 0 }, { 16, 100, 0, 0, 0, 0 }, { -5, 250, 0, 0, 0, 0 },
+            { PGLZ_SKIP_THRESHOLD_DEFAULT, PGLZ_SKIP_RATE_DEFAULT, 256, 0, 0, 0 },
+            { 0, 0, 1, 0, 0, 0 }, { 3, 0, 100000, 0, 0, 0 },
+            { PGLZ_SKIP_THRESHOLD_DEFAULT, PGLZ_SKIP_RATE_DEFAULT, 0, 1, 0, 0 },
+            { PGLZ_SKIP_THRESHOLD_DEFAULT, PGLZ_SKIP_RATE_DEFAULT, 256, 2, 0, 0 },
+            { 0, 0, 0, 2, 0, 0 }, { 4, 0, 0, 1, 0, 0 }, { 3, 0, 0, -1, 0, 0 },
+            { 0, 0, 0, 9, 0, 0 },
+            { PGLZ_SKIP_THRESHOLD_DEFAULT, PGLZ_SKIP_RATE_DEFAULT, 0, 0, 256, 0 },
+            { PGLZ_SKIP_THRESHOLD_DEFAULT, PGLZ_SKIP_RATE_DEFAULT, 0, 0, 16384, 0 },
+            { 0, 0, 0, 1, 1000, 0 }, { 8, 0, 0, 0, 100000, 0 }, { 0, 0, 0, 0, -3, 0 },
+            { PGLZ_SKIP_THRESHOLD_DEFAULT, PGLZ_SKIP_RATE_DEFAULT, 0, 0, 0, 2 },
+            { 0, 0, 0, 0, 0, 4 }, { 3, 0, 0, 0, 0, 1 },
+            { PGLZ_SKIP_THRESHOLD_DEFAULT, PGLZ_SKIP_RATE_DEFAULT, 0, 1, 0, 8 },
+            { PGLZ_SKIP_THRESHOLD_DEFAULT, PGLZ_SKIP_RATE_DEFAULT, 256, 2, 256, 100 },
+            { 0, 0, 0, 2, 16384, 3 }, { 0, 0, 0, 0, 0, -1 },
+        };
+        int nsettings = sizeof(skip_settings) / sizeof(skip_settings[0]);
+        int big_len = 1048576 + 3;
+        char *big = malloc(big_len);
+        PGLZ_Context *ectx = pglz_context_create_extended(PGLZ_CTX_GENERATIONS);
+        int next_failures = 0;
+
+        if (!big || !ectx) {
+            fprintf(stderr, "  FAIL allocation failed\n");
+            next_failures++;
+        } else {
+            for (int k = 0; k < nsettings; k++) {
+                PGLZ_StrategyExt strategy = { *PGLZ_strategy_always,
+                                              skip_settings[k][0],
+                                              skip_settings[k][1],
+                                              skip_settings[k][2],
+                                              skip_settings[k][3],
+                                              skip_settings[k][4],
+                                              skip_settings[k][5] };
+
+                for (int i = 0; i < nsizes; i++) {
+                    if (sizes[i] == 0)
+                        continue;
+                    gen_compressible(buf, sizes[i]);
+                    next_failures += test_strategy_ext("compressible", buf, sizes[i],
+                                                       &strategy, ectx);
+                    gen_random(buf, sizes[i]);
+                    next_failures += test_strategy_ext("random", buf, sizes[i],
+                                                       &strategy, ectx);
+                    gen_degenerate(buf, sizes[i]);
+                    next_failures += test_strategy_ext("degenerate", buf, sizes[i],
+                                                       &strategy, ectx);
+                }
+
+                /* Long enough for the adaptive window to move many times */
+                gen_compressible(big, big_len);
+                next_failures += test_strategy_ext("compressible", big, big_len,
+                                                   &strategy, ectx);
+
+                /* All-ones prefixes look like the bucket rows' empty slots */
+                memset(buf, 0xff, 4096);
+                next_failures += test_strategy_ext("ones", buf, 4096,
+                                                   &strategy, ectx);
+            }
+
+            if (pglz_bucket_ways != NULL &&
+                (pglz_bucket_ways(-1) != 0 || pglz_bucket_ways(0) != 0 ||
+                 pglz_bucket_ways(1) != 2 || pglz_bucket_ways(3) != 4 ||
+                 pglz_bucket_ways(5) != 8 || pglz_bucket_ways(1000) != 8)) {
+                fprintf(stderr, "  FAIL pglz_bucket_ways rounding\n");
+                next_failures++;
+            }
+
+            /* The standard extended strategy, if the variant has one */
+            if (&PGLZ_strategy_archive != NULL) {
+                for (int i = 0; i < nsizes; i++) {
+                    gen_compressible(buf, sizes[i]);
+                    next_failures += test_strategy_ext("compressible", buf, sizes[i],
+                                                       PGLZ_strategy_archive, ectx);
+                    gen_degenerate(buf, sizes[i]);
+                    next_failures += test_strategy_ext("degenerate", buf, sizes[i],
+                                                       PGLZ_strategy_archive, ectx);
+                }
+                gen_compressible(big, big_len);
+                next_failures += test_strategy_ext("compressible", big, big_len,
+                                                   PGLZ_strategy_archive, ectx);
+            }
+        }
+        printf("  %s  %d settings x %d sizes x 3 types%s\n",
+               next_failures ? "FAIL" : "OK  ", nsettings, nsizes - 1,
+               &PGLZ_strategy_archive != NULL ? ", archive" : "");
+        failures += next_failures;
+        if (ectx)
+            pglz_context_free(ectx);
+        free(big);
+    }
+
+    /*
+     * The fixed-strategy specializations against the generic code, under
+     * every hash the build has.
+     */
+    printf("\n--- fixed strategies ---\n");
+    if (pglz_compress_default == NULL) {
+        printf("  SKIP (variant has no pglz_compress_default)\n");
+    } else {
+        static const PGLZ_HashKind kinds[] = {
+            PGLZ_HASH_STOCK, PGLZ_HASH_FIBONACCI, PGLZ_HASH_CRC32C
+        };
+        PGLZ_HashKind saved = pglz_get_hash();
+        PGLZ_Context *fctx = pglz_context_create_extended(PGLZ_CTX_GENERATIONS);
+        int fixed_failures = 0;
+        int nkinds = 0;
+
+        for (int k = 0; k < 3; k++) {
+            if (!pglz_set_hash(kinds[k]))
+                continue;
+            pglz_context_set_hash(fctx, kinds[k]);
+            nkinds++;
+            for (int i = 0; i < nsizes; i++) {
+                gen_compressible(buf, sizes[i]);
+                fixed_failures += test_fixed("compressible", buf, sizes[i], fctx);
+                gen_random(buf, sizes[i]);
+                fixed_failures += test_fixed("random", buf, sizes[i], fctx);
+                gen_degenerate(buf, sizes[i]);
+                fixed_failures += test_fixed("degenerate", buf, sizes[i], fctx);
+            }
+        }
+        pglz_set_hash(saved);
+        pglz_context_free(fctx);
+        printf("  %s  %d hashes x %d sizes x 3 types, default and always\n",
+               fixed_failures ? "FAIL" : "OK  ", nkinds, nsizes);
+        failures += fixed_failures;
+    }
+
+    /*
+     * Hot-path counters, when the variant is built with PGLZ_STATS
+     * (CFLAGS_ARCH=-DPGLZ_STATS); otherwise they must stay zero.
+     */
+    printf("\n--- stats ---\n");
+    if (pglz_get_stats == NULL) {
+        printf("  SKIP (variant has no pglz_get_stats)\n");
+    } else {
+        PGLZ_Stats probe;
+        int stats_failures = 0;
+
+        for (int i = 0; i < nsizes; i++) {
+            gen_compressible(buf, sizes[i]);
+            stats_failures += test_stats("compressible", buf, sizes[i],
+                                         PGLZ_strategy_always);
+            gen_random(buf, sizes[i]);
+            stats_failures += test_stats("random", buf, sizes[i],
+                                         PGLZ_strategy_default);
+            gen_degenerate(buf, sizes[i]);
+            stats_failures += test_stats("degenerate", buf, sizes[i],
+                                         PGLZ_strategy_always);
+        }
+        printf("  %s  %d sizes x 3 types%s\n",
+               stats_failures ? "FAIL" : "OK  ", nsizes,
+               pglz_get_stats(&probe) ? "" : " (not counted in this build)");
+        failures += stats_failures;
+    }
+
+    /* Buffers kept by a context, allocated through counting callbacks */
+    printf("\n--- context buffers ---\n");
+    if (pglz_context_create_allocator == NULL) {
+        printf("  SKIP (variant has no pglz_context_create_allocator)\n");
+    } else {
+        int arena_failures = test_arena(buf, sizes, nsizes, 3);
+
+        printf("  %s  %d sizes x 3 rounds, no allocation after the first\n",
+               arena_failures ? "FAIL" : "OK  ", nsizes);
+        failures += arena_failures;
+    }
+
+    printf("\n--- rate estimate ---\n");
+    if (pglz_estimate_ratio == NULL) {
+        printf("  SKIP (variant has no pglz_estimate_ratio)\n");
+    } else {
+        int estimate_failures = test_estimate(buf, sizes, nsizes);
+
+        printf("  %s  %d sizes x 3 types x 7 samples\n",
+               estimate_failures ? "FAIL" : "OK  ", nsizes);
+        failures += estimate_failures;
+    }
+
+    printf("\n--- dictionary ---\n");
+    if (pglz_compress_ctx_dict == NULL) {
+        printf("  SKIP (variant has no pglz_compress_ctx_dict)\n");
+    } else {
+        int dict_failures = 0;
+
+        for (int g = 0; g < 2; g++) {
+            PGLZ_Context *dctx = pglz_context_create_extended(g ? PGLZ_CTX_GENERATIONS : 0);
+
+            for (int i = 0; i < nsizes; i++) {
+                gen_compressible(buf, sizes[i]);
+                dict_failures += test_dict(buf, sizes[i], dctx);
+                gen_random(buf, sizes[i]);
+                dict_failures += test_dict(buf, sizes[i], dctx);
+            }
+            pglz_context_free(dctx);
+        }
+        printf("  %s  %d sizes x 2 types x 8 dictionaries, with and without generations\n",
+               dict_failures ? "FAIL" : "OK  ", nsizes);
+        failures += dict_failures;
+    }
+
     printf("\n=== %d failures ===\n", failures);
 
     free(buf);
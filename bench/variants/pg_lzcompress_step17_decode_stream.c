@@ -0,0 +1,2899 @@
+/* ----------
+ * pg_lzcompress_step17_decode_stream.c -
+ *
+ *		Step 17: Incremental decompression.
+ *
+ *		pglz_decompress() wants the whole compressed datum in one buffer,
+ *		so detoasting a value stored in many toast chunks first copies
+ *		every chunk into a temporary buffer and only then starts to
+ *		decode.  pglz_decode_begin(), pglz_decode_update() and
+ *		pglz_decode_end() accept the compressed bytes in pieces of any
+ *		size, split anywhere, including inside a 2- or 3-byte tag, and
+ *		decode each piece as it arrives, so I/O and decoding can overlap
+ *		and the caller can stop as soon as it has the output it needs.
+ *
+ *		The decoder state is the position in dest, the control byte with
+ *		its remaining bits, and up to two bytes of a tag that a piece
+ *		boundary cut off.  Each piece runs the table-driven fast loop of
+ *		pglz_decompress(), now factored out into pglz_decode_fast(), over
+ *		the whole control groups that lie in it, and a careful
+ *		item-at-a-time loop over its ends, which saves or completes a cut
+ *		tag.  Matches refer back into dest, which therefore must hold all
+ *		the output, as for pglz_decompress().
+ *
+ *		Builds on step 16 (streaming compression).
+ *
+ *		Original pg_lzcompress.c header:
+ *		This is an implementation of LZ compression for PostgreSQL.
+ *		It uses a simple history table and generates 2-3 byte tags
+ *		capable of backward copy information for 3-273 bytes with
+ *		a max offset of 4095.
+ *
+ *		Entry routines:
+ *
+ *			int32
+ *			pglz_compress(const char *source, int32 slen, char *dest,
+ *						  const PGLZ_Strategy *strategy);
+ *
+ *				source is the input data to be compressed.
+ *
+ *				slen is the length of the input data.
+ *
+ *				dest is the output area for the compressed result.
+ *					It must be at least as big as PGLZ_MAX_OUTPUT(slen).
+ *
+ *				strategy is a pointer to some information controlling
+ *					the compression algorithm. If NULL, the compiled
+ *					in default strategy is used.
+ *
+ *				The return value is the number of bytes written in the
+ *				buffer dest, or -1 if compression fails; in the latter
+ *				case the contents of dest are undefined.
+ *
+ *				pglz_compress() uses a single statically allocated history
+ *				context and is therefore not safe to call concurrently
+ *				from several threads.
+ *
+ *			PGLZ_Context *
+ *			pglz_context_create(void);
+ *
+ *			void
+ *			pglz_context_free(PGLZ_Context *ctx);
+ *
+ *				Allocate and release a history context (about 64 KiB).
+ *				pglz_context_create() returns NULL if out of memory.
+ *
+ *			PGLZ_Context *
+ *			pglz_context_create_extended(int flags);
+ *
+ *				Like pglz_context_create(), with behavior flags.
+ *				PGLZ_CTX_GENERATIONS makes every reuse of the context
+ *				skip the hash table reset (see pglz_begin_call).
+ *
+ *			int32
+ *			pglz_compress_ctx(PGLZ_Context *ctx, const char *source,
+ *							  int32 slen, char *dest,
+ *							  const PGLZ_Strategy *strategy);
+ *
+ *				Same as pglz_compress(), but all history state is kept
+ *				in ctx.  A context can be reused for any number of calls,
+ *				but must not be used by two calls at the same time.
+ *
+ *			int
+ *			pglz_compress_batch(const char **srcs, const int32 *lens,
+ *								char **dests, int32 *out_lens, int n,
+ *								const PGLZ_Strategy *strategy);
+ *
+ *				Compresses the n datums srcs[i] of lens[i] bytes into
+ *				dests[i], each at least PGLZ_MAX_OUTPUT(lens[i]) bytes.
+ *				out_lens[i] receives what pglz_compress() would have
+ *				returned for the datum.  Returns the number of datums
+ *				that compressed.  Like pglz_compress(), it uses static
+ *				history state and is not thread-safe.
+ *
+ *			int
+ *			pglz_compress_batch_ctx(PGLZ_Context *ctx, const char **srcs,
+ *									const int32 *lens, char **dests,
+ *									int32 *out_lens, int n,
+ *									const PGLZ_Strategy *strategy);
+ *
+ *				Same as pglz_compress_batch(), but all history state is
+ *				kept in ctx, as with pglz_compress_ctx().  A context
+ *				created with PGLZ_CTX_GENERATIONS gives the cheapest
+ *				per-datum setup.
+ *
+ *			PGLZ_Stream *
+ *			pglz_stream_begin(const PGLZ_Strategy *strategy);
+ *
+ *				Starts a streaming compression.  Only the match_size_good
+ *				and match_size_drop of strategy apply: the stream cannot
+ *				take back output it has handed out, so it never fails for
+ *				lack of compression, and the caller decides afterwards
+ *				whether the result is worth storing.  Returns NULL if out
+ *				of memory.
+ *
+ *			int32
+ *			pglz_stream_update(PGLZ_Stream *stream, const char *source,
+ *							   int32 slen, char *dest);
+ *
+ *				Appends slen bytes of input to the stream.  dest must be
+ *				at least PGLZ_STREAM_MAX_OUTPUT(slen) bytes.  Returns the
+ *				number of finished output bytes written to dest, which
+ *				may be 0; they follow those of the previous call.
+ *
+ *			int32
+ *			pglz_stream_end(PGLZ_Stream *stream, char *dest);
+ *
+ *				Encodes the rest of the input, writes the remaining
+ *				output to dest (at least PGLZ_STREAM_MAX_OUTPUT(0)
+ *				bytes) and frees the stream.  Returns the number of bytes
+ *				written.  With dest NULL, the stream is only freed and 0
+ *				is returned, which abandons it.  The concatenated output
+ *				decompresses with pglz_decompress() to the concatenated
+ *				input.
+ *
+ *			int32
+ *			pglz_decompress(const char *source, int32 slen, char *dest,
+ *							int32 rawsize, bool check_complete)
+ *
+ *				source is the compressed input.
+ *
+ *				slen is the length of the compressed input.
+ *
+ *				dest is the area where the uncompressed data will be
+ *					written to. It is the callers responsibility to
+ *					provide enough space.
+ *
+ *					The data is written to buff exactly as it was handed
+ *					to pglz_compress(). No terminating zero byte is added.
+ *
+ *				rawsize is the length of the uncompressed data.
+ *
+ *				check_complete is a flag to let us know if -1 should be
+ *					returned in cases where we don't reach the end of the
+ *					source or dest buffers, or not.  This should be false
+ *					if the caller is asking for only a partial result and
+ *					true otherwise.
+ *
+ *				The return value is the number of bytes written in the
+ *				buffer dest, or -1 if decompression fails.
+ *
+ *			int32
+ *			pglz_decompress_slice(const char *source, int32 slen,
+ *								  char *dest, int32 rawsize)
+ *
+ *				Same as pglz_decompress(source, slen, dest, rawsize,
+ *				false), but dest must have room for
+ *				PGLZ_SLICE_BUFSIZE(rawsize) bytes.  The bytes past rawsize
+ *				are used as scratch space and their contents are
+ *				undefined afterwards.  slen may be cut down with
+ *				pglz_maximum_compressed_size() as usual.
+ *
+ *			int32
+ *			pglz_compress_parallel(const char *source, int32 slen,
+ *								   char *dest,
+ *								   const PGLZ_Strategy *strategy,
+ *								   int nthreads);
+ *
+ *				Compresses source into a chunked frame (see "Parallel
+ *				frames" below) using up to nthreads threads.  dest must
+ *				be at least PGLZ_FRAME_MAX_OUTPUT(slen) bytes.  strategy
+ *				applies to each chunk, and its min_input_size,
+ *				max_input_size and min_comp_rate also to the whole
+ *				input.  Returns the frame size, or -1 if compression
+ *				fails or a worker cannot get memory.
+ *
+ *			int32
+ *			pglz_decompress_frame(const char *source, int32 slen,
+ *								  char *dest, int32 rawsize);
+ *
+ *				Decompresses a frame made by pglz_compress_parallel()
+ *				into dest.  Returns rawsize, or -1 if the frame is
+ *				corrupted or was not made from rawsize bytes.
+ *
+ *			PGLZ_DecodeStream *
+ *			pglz_decode_begin(char *dest, int32 rawsize);
+ *
+ *				Starts an incremental decompression of rawsize bytes into
+ *				dest (rawsize bytes, as for pglz_decompress()).  Returns
+ *				NULL if out of memory.
+ *
+ *			int32
+ *			pglz_decode_update(PGLZ_DecodeStream *stream,
+ *							   const char *source, int32 slen);
+ *
+ *				Decodes the next slen bytes of the compressed data, which
+ *				may be split anywhere.  Returns how many bytes at the start
+ *				of dest are decoded so far, or -1 if the data is corrupted.
+ *
+ *			int32
+ *			pglz_decode_end(PGLZ_DecodeStream *stream,
+ *							bool check_complete);
+ *
+ *				Frees the stream and returns the number of bytes decoded,
+ *				or -1 if the data is corrupted.  check_complete is as for
+ *				pglz_decompress(); with false, the caller can end the
+ *				stream early, as soon as it has enough output.
+ *
+ *		The decompression algorithm and internal data format:
+ *
+ *			It is made with the compressed data itself.
+ *
+ *			The data representation is easiest explained by describing
+ *			the process of decompression.
+ *
+ *			If compressed_size == rawsize, then the data
+ *			is stored uncompressed as plain bytes. Thus, the decompressor
+ *			simply copies rawsize bytes to the destination.
+ *
+ *			Otherwise the first byte tells what to do the next 8 times.
+ *			We call this the control byte.
+ *
+ *			An unset bit in the control byte means, that one uncompressed
+ *			byte follows, which is copied from input to output.
+ *
+ *			A set bit in the control byte means, that a tag of 2-3 bytes
+ *			follows. A tag contains information to copy some bytes, that
+ *			are already in the output buffer, to the current location in
+ *			the output. Let's call the three tag bytes T1, T2 and T3. The
+ *			position of the data to copy is coded as an offset from the
+ *			actual output position.
+ *
+ *			The offset is in the upper nibble of T1 and in T2.
+ *			The length is in the lower nibble of T1.
+ *
+ *			So the 16 bits of a 2 byte tag are coded as
+ *
+ *				7---T1--0  7---T2--0
+ *				OOOO LLLL  OOOO OOOO
+ *
+ *			This limits the offset to 1-4095 (12 bits) and the length
+ *			to 3-18 (4 bits) because 3 is always added to it. To emit
+ *			a tag of 2 bytes with a length of 2 only saves one control
+ *			bit. But we lose one byte in the possible length of a tag.
+ *
+ *			In the actual implementation, the 2 byte tag's length is
+ *			limited to 3-17, because the value 0xF in the length nibble
+ *			has special meaning. It means, that the next following
+ *			byte (T3) has to be added to the length value of 18. That
+ *			makes total limits of 1-4095 for offset and 3-273 for length.
+ *
+ *			Now that we have successfully decoded a tag. We simply copy
+ *			the output that occurred <offset> bytes back to the current
+ *			output location in the specified <length>. Thus, a
+ *			sequence of 200 spaces (think about bpchar fields) could be
+ *			coded in 4 bytes. One literal space and a three byte tag to
+ *			copy 199 bytes with a -1 offset. Whow - that's a compression
+ *			rate of 98%! Well, the implementation needs to save the
+ *			original data size too, so we need another 4 bytes for it
+ *			and end up with a total compression rate of 96%, what's still
+ *			worth a Whow.
+ *
+ *		The compression algorithm
+ *
+ *			The following uses numbers used in the default strategy.
+ *
+ *			The compressor works best for attributes of a size between
+ *			1K and 1M. For smaller items there's not that much chance of
+ *			redundancy in the character sequence (except for large areas
+ *			of identical bytes like trailing spaces) and for bigger ones
+ *			our 4K maximum look-back distance is too small.
+ *
+ *			The compressor creates a table for lists of positions.
+ *			For each input position (except the last 3), a hash key is
+ *			built from the 4 next input bytes and the position remembered
+ *			in the appropriate list. Thus, the table points to linked
+ *			lists of likely to be at least in the first 4 characters
+ *			matching strings. This is done on the fly while the input
+ *			is compressed into the output area.  Table entries are only
+ *			kept for the last 4096 input positions, since we cannot use
+ *			back-pointers larger than that anyway.  The size of the hash
+ *			table is chosen based on the size of the input - a larger table
+ *			has a larger startup cost, as it needs to be initialized to
+ *			zero, but reduces the number of hash collisions on long inputs.
+ *
+ *			For each byte in the input, its hash key (built from this
+ *			byte and the next 3) is used to find the appropriate list
+ *			in the table. The lists remember the positions of all bytes
+ *			that had the same hash key in the past in increasing backward
+ *			offset order. Now for all entries in the used lists, the
+ *			match length is computed by comparing the characters from the
+ *			entries position with the characters from the actual input
+ *			position.
+ *
+ *			The compressor starts with a so called "good_match" of 128.
+ *			It is a "prefer speed against compression ratio" optimizer.
+ *			So if the first entry looked at already has 128 or more
+ *			matching characters, the lookup stops and that position is
+ *			used for the next tag in the output.
+ *
+ *			For each subsequent entry in the history list, the "good_match"
+ *			is lowered by 10%. So the compressor will be more happy with
+ *			short matches the further it has to go back in the history.
+ *			Another "speed against ratio" preference characteristic of
+ *			the algorithm.
+ *
+ *			Thus there are 3 stop conditions for the lookup of matches:
+ *
+ *				- a match >= good_match is found
+ *				- there are no more history entries to look at
+ *				- the next history entry is already too far back
+ *				  to be coded into a tag.
+ *
+ *			Finally the match algorithm checks that at least a match
+ *			of 3 or more bytes has been found, because that is the smallest
+ *			amount of copy information to code into a tag. If so, a tag
+ *			is omitted and all the input bytes covered by that are just
+ *			scanned for the history add's, otherwise a literal character
+ *			is omitted and only his history entry added.
+ *
+ *		Acknowledgments:
+ *
+ *			Many thanks to Adisak Pochanayon, who's article about SLZ
+ *			inspired me to write the PostgreSQL compression this way.
+ *
+ *			Jan Wieck
+ *
+ * Copyright (c) 1999-2026, PostgreSQL Global Development Group
+ *
+ * src/common/pg_lzcompress.c
+ * ----------
+ */
+#ifndef FRONTEND
+#include "postgres.h"
+#else
+#include "postgres_fe.h"
+#endif
+
+#include <limits.h>
+#ifdef FRONTEND
+#include <pthread.h>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "common/pg_lzcompress.h"
+#include "port/pg_bitutils.h"
+
+
+/* ----------
+ * Local definitions
+ * ----------
+ */
+#define PGLZ_MAX_HISTORY_LISTS	8192	/* must be power of 2 */
+#define PGLZ_HISTORY_SIZE		4096
+#define PGLZ_MAX_MATCH			273
+
+
+/*
+ * Maximum chain traversal length in pglz_find_match.  Defense-in-depth
+ * against pathological hash collisions — bounds worst-case match-finding
+ * to O(PGLZ_MAX_CHAIN) per input byte.  LZ4 uses a similar technique.
+ */
+#define PGLZ_MAX_CHAIN			256
+
+/*
+ * Room that pglz_decompress's fast path needs left in its buffers: one
+ * control byte plus eight 3-byte tags of input, plus the 8-byte literal
+ * run copy reading past the items it consumes, and one maximal match
+ * plus a 16-byte copy overshoot of output.
+ */
+#define PGLZ_FAST_SRC_SLACK		(1 + 8 * 3 + 8)
+#define PGLZ_FAST_DEST_SLACK	(PGLZ_MAX_MATCH + 16)
+
+/* ----------
+ * PGLZ_HistEntry -
+ *
+ *		Singly-linked list for the backward history lookup
+ *
+ * Each entry lives in exactly one hash bucket chain at a time.  When an
+ * entry is recycled (ring buffer wraps), it is unlinked from its old
+ * chain via predecessor scan before being inserted into the new chain.
+ *
+ * Using int16 indexes instead of pointers, removing the prev pointer and
+ * storing pos as an offset from the source start keeps each entry at
+ * 8 bytes on all platforms (pos 4B + next 2B + hindex 2B, no padding).
+ * Input lengths are int32, so every offset fits in a uint32.
+ *
+ * The sentinel value -1 means "no entry" (end of chain or empty bucket).
+ * Indexes 0..PGLZ_HISTORY_SIZE map directly to hist_entries[0..N].
+ * ----------
+ */
+typedef struct PGLZ_HistEntry
+{
+	uint32		pos;			/* my input position, as source offset */
+	int16		next;			/* index of next entry in chain, -1 = end */
+	uint16		hindex;			/* hash bucket this entry belongs to */
+} PGLZ_HistEntry;
+
+/* Compile-time size checks */
+#define PGLZ_STATIC_ASSERT(cond, msg) \
+	typedef char pglz_static_assert_##msg[(cond) ? 1 : -1]
+
+PGLZ_STATIC_ASSERT(PGLZ_MAX_HISTORY_LISTS <= 65535,
+					max_history_lists_fits_uint16);
+PGLZ_STATIC_ASSERT(PGLZ_HISTORY_SIZE <= 32767,
+					history_size_fits_int16);
+PGLZ_STATIC_ASSERT(sizeof(PGLZ_HistEntry) == 8,
+					hist_entry_is_8_bytes);
+/* A slice's scratch area must hold a maximal match, overshoot, 8 literals */
+PGLZ_STATIC_ASSERT(PGLZ_SLICE_SLACK >= PGLZ_FAST_DEST_SLACK + 8,
+					slice_slack_fits_match);
+
+/*
+ * Streaming compression encodes a position only when this much input
+ * follows it: a maximal match, plus the 4 bytes the hash reads.  The
+ * PGLZ_STREAM_BUFSIZE window must hold the history, the lookahead and
+ * room for new input.
+ */
+#define PGLZ_STREAM_LOOKAHEAD	(PGLZ_MAX_MATCH + 4)
+#define PGLZ_STREAM_BUFSIZE		32768
+/* An unfinished control group: control byte and eight 3-byte tags */
+#define PGLZ_STREAM_PENDING		(1 + 8 * 3)
+
+PGLZ_STATIC_ASSERT(PGLZ_STREAM_BUFSIZE >=
+					2 * (PGLZ_HISTORY_SIZE + PGLZ_STREAM_LOOKAHEAD),
+					stream_window_fits_history);
+
+/* Sentinel value for empty chain entries */
+#define PGLZ_INVALID_ENTRY		(-1)
+
+/*
+ * Bucket heads are stored as (generation << 16) | (uint16) entry index.
+ * A head whose generation differs from the context's current one is
+ * stale and reads as PGLZ_INVALID_ENTRY.
+ */
+#define PGLZ_HEAD_INDEX(h)		((int16) ((h) & 0xffff))
+#define PGLZ_HEAD_GEN(h)		((uint16) ((h) >> 16))
+#define PGLZ_MAKE_HEAD(gen, idx) \
+	(((uint32) (gen) << 16) | (uint16) (idx))
+
+
+/* ----------
+ * The provided standard strategies
+ * ----------
+ */
+static const PGLZ_Strategy strategy_default_data = {
+	32,							/* Data chunks less than 32 bytes are not
+								 * compressed */
+	INT_MAX,					/* No upper limit on what we'll try to
+								 * compress */
+	25,							/* Require 25% compression rate, or not worth
+								 * it */
+	1024,						/* Give up if no compression in the first 1KB */
+	128,						/* Stop history lookup if a match of 128 bytes
+								 * is found */
+	10							/* Lower good match size by 10% at every loop
+								 * iteration */
+};
+const PGLZ_Strategy *const PGLZ_strategy_default = &strategy_default_data;
+
+
+static const PGLZ_Strategy strategy_always_data = {
+	0,							/* Chunks of any size are compressed */
+	INT_MAX,
+	0,							/* It's enough to save one single byte */
+	INT_MAX,					/* Never give up early */
+	128,						/* Stop history lookup if a match of 128 bytes
+								 * is found */
+	6							/* Look harder for a good match */
+};
+const PGLZ_Strategy *const PGLZ_strategy_always = &strategy_always_data;
+
+
+/* ----------
+ * PGLZ_Context -
+ *
+ *		Work arrays for history, owned by the caller of pglz_compress_ctx().
+ *
+ * hist_start: one entry per hash bucket, holding the index of the first
+ * history entry in that bucket's chain, or -1 if empty.  A context with
+ * generations uses the tagged view, where each head also carries the
+ * generation that wrote it (see PGLZ_MAKE_HEAD).  Every other context
+ * uses the plain int16 view, so its per-call reset touches no more bytes
+ * than before generations existed.
+ *
+ * hist_entries[]: ring buffer of history entries, indexed 0..PGLZ_HISTORY_SIZE.
+ * Entry 0 is now a valid entry (the old code wasted it as a sentinel).
+ *
+ * hist_start comes first: only its first hashsz slots are touched per call,
+ * so small inputs keep their working set at the front of the structure.
+ * ----------
+ */
+struct PGLZ_Context
+{
+	union
+	{
+		int16		plain[PGLZ_MAX_HISTORY_LISTS];	/* without generations */
+		uint32		tagged[PGLZ_MAX_HISTORY_LISTS]; /* with generations */
+	}			hist_start;
+	PGLZ_HistEntry hist_entries[PGLZ_HISTORY_SIZE + 1];
+	uint16		generation;		/* current generation, 0 if not in use */
+	bool		use_generations;	/* created with PGLZ_CTX_GENERATIONS? */
+};
+
+/*
+ * Context used by plain pglz_compress().  Statically allocated, like the
+ * old work arrays, so that the one-shot API never allocates memory.
+ */
+static PGLZ_Context pglz_static_context;
+
+/*
+ * History state for pglz_compress_batch(), which is
+ * pglz_compress_batch_ctx() on this context.  Zeroed heads all belong to
+ * generation 0, which pglz_begin_call() never hands out, so they start
+ * out empty as required.
+ */
+static PGLZ_Context pglz_batch_context = {.use_generations = true};
+
+/*
+ * pglz_compress_batch_ctx() prefetches this much of the next datum's input and
+ * output.
+ */
+#define PGLZ_CACHE_LINE			64
+#define PGLZ_BATCH_PREFETCH		(4 * PGLZ_CACHE_LINE)
+#if defined(__GNUC__) || defined(__clang__)
+#define pglz_prefetch(addr, rw)	__builtin_prefetch((addr), (rw))
+#else
+#define pglz_prefetch(addr, rw)	((void) 0)
+#endif
+
+/*
+ * Allocation for pglz_context_create().  In the backend, OOM must not
+ * throw here so that callers outside a transaction can handle it.
+ */
+#ifndef FRONTEND
+#define ALLOC(size) MemoryContextAllocExtended(TopMemoryContext, size, \
+											   MCXT_ALLOC_NO_OOM)
+#define FREE(ptr) pfree(ptr)
+#else
+#define ALLOC(size) malloc(size)
+#define FREE(ptr) free(ptr)
+#endif
+
+/* ----------
+ * pglz_hist_head -
+ *
+ *		Returns the index of the first entry in a bucket's chain, or -1 if
+ *		the bucket is empty.  With generations, a head written by an
+ *		earlier call counts as empty.  Callers pass use_generations as a
+ *		compile-time constant, so the check disappears from the other
+ *		specialization.
+ * ----------
+ */
+static pg_attribute_always_inline int16
+pglz_hist_head(const PGLZ_Context *ctx, int hindex, bool use_generations)
+{
+	uint32		head;
+
+	if (!use_generations)
+		return ctx->hist_start.plain[hindex];
+
+	head = ctx->hist_start.tagged[hindex];
+	if (PGLZ_HEAD_GEN(head) != ctx->generation)
+		return PGLZ_INVALID_ENTRY;
+	return PGLZ_HEAD_INDEX(head);
+}
+
+
+/* ----------
+ * pglz_hist_set_head -
+ *
+ *		Makes entry_idx the first entry in a bucket's chain, tagged with
+ *		the current generation if the context uses them.
+ * ----------
+ */
+static pg_attribute_always_inline void
+pglz_hist_set_head(PGLZ_Context *ctx, int hindex, int16 entry_idx,
+				   bool use_generations)
+{
+	if (use_generations)
+		ctx->hist_start.tagged[hindex] =
+			PGLZ_MAKE_HEAD(ctx->generation, entry_idx);
+	else
+		ctx->hist_start.plain[hindex] = entry_idx;
+}
+
+
+/* ----------
+ * pglz_hist_idx -
+ *
+ *		Computes the history table slot for the lookup by the next 4
+ *		characters in the input.
+ *
+ * NB: because we use the next 4 characters, we are not guaranteed to
+ * find 3-character matches; they very possibly will be in the wrong
+ * hash list.  This seems an acceptable tradeoff for spreading out the
+ * hash keys more.
+ *
+ * This uses a Fibonacci multiply-shift hash instead of the original
+ * polynomial hash.  The original ((s[0]<<6)^(s[1]<<4)^(s[2]<<2)^s[3])
+ * had poor avalanche properties for structured data (ASCII text, SQL,
+ * JSON): on typical English text, it produced only ~260 unique hashes
+ * for 8K of input across 8192 buckets (3% utilization), leading to
+ * average chain lengths of ~30.  The Fibonacci hash spreads entries
+ * uniformly across all buckets, reducing chain traversal time in
+ * pglz_find_match and improving cache behavior.
+ *
+ * The constant 2654435761 is the golden ratio × 2^32, commonly used
+ * in hash tables (Knuth TAOCP Vol 3).  LZ4 uses the same technique.
+ *
+ * The 4 bytes are read portably via byte-by-byte assembly (not a
+ * pointer cast) to avoid undefined behavior and endianness dependence.
+ * GCC/Clang optimize this to a single 4-byte load on x86-64.
+ * ----------
+ */
+static inline int
+pglz_hist_idx(const char *s, const char *end, int mask)
+{
+	uint32		h;
+
+	if ((end - s) < 4)
+		return ((int) (unsigned char) s[0]) & mask;
+
+	/*
+	 * Read 4 bytes portably and multiply by the Fibonacci constant.
+	 * We use little-endian assembly (low byte first) for consistency
+	 * across architectures.
+	 */
+	h = ((uint32) (unsigned char) s[0]) |
+		((uint32) (unsigned char) s[1] << 8) |
+		((uint32) (unsigned char) s[2] << 16) |
+		((uint32) (unsigned char) s[3] << 24);
+	h *= 2654435761u;
+
+	/*
+	 * Use the high bits (best-mixed after multiply).  Shift right by 19
+	 * to get 13 bits, then mask to the table size.  For smaller tables,
+	 * the mask further restricts the range.
+	 */
+	return (int) (h >> 19) & mask;
+}
+
+
+/* ----------
+ * pglz_hist_unlink -
+ *
+ *		Unlink an entry from its current bucket chain by scanning forward
+ *		from the chain head to find the predecessor, then splice out.
+ *
+ * CRITICAL: This function must NOT have a chain-length limit.  If we
+ * abandon an unlink before finding the predecessor, the entry's next
+ * field gets overwritten when recycled into a new chain — this corrupts
+ * the old chain (the predecessor now follows next into a completely
+ * different bucket's chain).
+ *
+ * The worst case (all 4096 entries in one bucket) requires the input
+ * to produce 4096 consecutive identical hash values — degenerate data
+ * that compresses trivially, so the amortized cost is acceptable.
+ * ----------
+ */
+static inline void
+pglz_hist_unlink(PGLZ_Context *ctx, int16 entry_idx, bool use_generations)
+{
+	PGLZ_HistEntry *entry = &ctx->hist_entries[entry_idx];
+	int16		head;
+	int16	   *pp;
+
+	/*
+	 * The entry was inserted during this call, so its bucket head carries
+	 * the current generation and needs no staleness check.  The head may be
+	 * a tagged uint32 rather than an int16, so it is handled separately
+	 * from the rest of the chain.
+	 */
+	head = pglz_hist_head(ctx, entry->hindex, use_generations);
+	if (head == entry_idx)
+	{
+		pglz_hist_set_head(ctx, entry->hindex, entry->next, use_generations);
+		return;
+	}
+
+	if (head != PGLZ_INVALID_ENTRY)
+	{
+		pp = &ctx->hist_entries[head].next;
+		while (*pp != PGLZ_INVALID_ENTRY)
+		{
+			if (*pp == entry_idx)
+			{
+				*pp = entry->next;	/* splice out */
+				return;
+			}
+			pp = &ctx->hist_entries[*pp].next;
+		}
+	}
+
+	/*
+	 * Entry not found in chain — bookkeeping is wrong.  In assert builds,
+	 * treat this as a bug.  In production, return silently as defense
+	 * against corruption — the entry will be overwritten anyway.
+	 */
+#ifdef USE_ASSERT_CHECKING
+	Assert(false);				/* should not happen */
+#endif
+}
+
+
+/* ----------
+ * pglz_hist_add -
+ *
+ *		Adds a new entry to the history table.
+ *
+ * If *recycle is true, then we are recycling a previously used entry,
+ * and must first unlink it from its old bucket chain via predecessor
+ * scan (singly-linked unlink).
+ *
+ * hist_next and recycle are modified by this function.
+ *
+ * Invariant: every bucket chain is valid at all times. Each entry
+ * belongs to exactly one bucket. -1 terminates every chain.
+ * ----------
+ */
+static pg_attribute_always_inline void
+pglz_hist_add(PGLZ_Context *ctx,
+			  int *hist_next, bool *recycle,
+			  const char *s, const char *end, int mask,
+			  const char *source, bool use_generations)
+{
+	int			hindex = pglz_hist_idx(s, end, mask);
+	int16		entry_idx = (int16) *hist_next;
+	PGLZ_HistEntry *myhe = &ctx->hist_entries[entry_idx];
+
+	if (*recycle)
+	{
+		/* Unlink from old bucket chain (predecessor scan) */
+		pglz_hist_unlink(ctx, entry_idx, use_generations);
+	}
+
+	/* Insert at head of the new bucket chain */
+	myhe->next = pglz_hist_head(ctx, hindex, use_generations);
+	myhe->hindex = (uint16) hindex;
+	myhe->pos = (uint32) (s - source);
+	pglz_hist_set_head(ctx, hindex, entry_idx, use_generations);
+
+	if (++(*hist_next) >= PGLZ_HISTORY_SIZE + 1)
+	{
+		*hist_next = 0;
+		*recycle = true;
+	}
+}
+
+
+/* ----------
+ * pglz_out_ctrl -
+ *
+ *		Outputs the last and allocates a new control byte if needed.
+ * ----------
+ */
+static inline void
+pglz_out_ctrl(unsigned char **ctrlp, unsigned char *ctrlb,
+			  unsigned char *ctrl, unsigned char **buf)
+{
+	if ((*ctrl & 0xff) == 0)
+	{
+		**ctrlp = *ctrlb;
+		*ctrlp = (*buf)++;
+		*ctrlb = 0;
+		*ctrl = 1;
+	}
+}
+
+
+/* ----------
+ * pglz_out_literal -
+ *
+ *		Outputs a literal byte to the destination buffer including the
+ *		appropriate control bit.
+ * ----------
+ */
+static inline void
+pglz_out_literal(unsigned char **ctrlp, unsigned char *ctrlb,
+				 unsigned char *ctrl, unsigned char **buf, unsigned char byte)
+{
+	pglz_out_ctrl(ctrlp, ctrlb, ctrl, buf);
+	*(*buf)++ = byte;
+	*ctrl <<= 1;
+}
+
+
+/* ----------
+ * pglz_out_tag -
+ *
+ *		Outputs a backward reference tag of 2-4 bytes (depending on
+ *		offset and length) to the destination buffer including the
+ *		appropriate control bit.
+ * ----------
+ */
+static inline void
+pglz_out_tag(unsigned char **ctrlp, unsigned char *ctrlb,
+			 unsigned char *ctrl, unsigned char **buf, int len, int off)
+{
+	pglz_out_ctrl(ctrlp, ctrlb, ctrl, buf);
+	*ctrlb |= *ctrl;
+	*ctrl <<= 1;
+	if (len > 17)
+	{
+		(*buf)[0] = (unsigned char)(((off & 0xf00) >> 4) | 0x0f);
+		(*buf)[1] = (unsigned char)(off & 0xff);
+		(*buf)[2] = (unsigned char)(len - 18);
+		(*buf) += 3;
+	}
+	else
+	{
+		(*buf)[0] = (unsigned char)(((off & 0xf00) >> 4) | (len - 3));
+		(*buf)[1] = (unsigned char)(off & 0xff);
+		(*buf) += 2;
+	}
+}
+
+
+/* ----------
+ * pglz_match_extend -
+ *
+ *		Returns the number of leading bytes that ip and hp have in common,
+ *		comparing at most maxlen bytes and never reading at or past end.
+ *
+ * hp < ip always (hp is an earlier input position), so bounding the reads
+ * at ip by end bounds the reads at hp too.  Each wide step is taken only
+ * while a whole vector fits below limit; the remainder goes through the
+ * next narrower step and finally byte by byte.  On a mismatch inside a
+ * vector, the position of the first differing byte comes from the
+ * lowest set bit of the compare mask (or of the XOR of two words).
+ * ----------
+ */
+static inline int
+pglz_match_extend(const char *ip, const char *hp, const char *end,
+				  int maxlen)
+{
+	int			n = 0;
+	int			limit = Min(maxlen, (int) (end - ip));
+
+#if defined(__AVX2__)
+	while (n + 32 <= limit)
+	{
+		__m256i		a = _mm256_loadu_si256((const __m256i *) (ip + n));
+		__m256i		b = _mm256_loadu_si256((const __m256i *) (hp + n));
+		uint32		eq = (uint32) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+
+		if (eq != 0xffffffff)
+			return n + pg_rightmost_one_pos32(~eq);
+		n += 32;
+	}
+#endif
+
+#if defined(__SSE2__)
+	while (n + 16 <= limit)
+	{
+		__m128i		a = _mm_loadu_si128((const __m128i *) (ip + n));
+		__m128i		b = _mm_loadu_si128((const __m128i *) (hp + n));
+		uint32		eq = (uint32) _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+
+		if (eq != 0xffff)
+			return n + pg_rightmost_one_pos32(~eq & 0xffff);
+		n += 16;
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	while (n + 16 <= limit)
+	{
+		uint8x16_t	eq = vceqq_u8(vld1q_u8((const uint8_t *) (ip + n)),
+								  vld1q_u8((const uint8_t *) (hp + n)));
+		/* Narrow to 4 bits per byte: bit 4i..4i+3 set iff byte i matched */
+		uint64		mask = vget_lane_u64(vreinterpret_u64_u8(
+							   vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+
+		if (mask != ~UINT64CONST(0))
+			return n + pg_rightmost_one_pos64(~mask) / 4;
+		n += 16;
+	}
+#endif
+
+	while (n + 8 <= limit)
+	{
+		uint64		a;
+		uint64		b;
+
+		memcpy(&a, ip + n, 8);
+		memcpy(&b, hp + n, 8);
+		if (a != b)
+		{
+#ifdef WORDS_BIGENDIAN
+			return n + (63 - pg_leftmost_one_pos64(a ^ b)) / 8;
+#else
+			return n + pg_rightmost_one_pos64(a ^ b) / 8;
+#endif
+		}
+		n += 8;
+	}
+
+	while (n < limit && ip[n] == hp[n])
+		n++;
+
+	return n;
+}
+
+
+/* ----------
+ * pglz_find_match -
+ *
+ *		Lookup the history table if the actual input stream matches
+ *		another sequence of characters, starting somewhere earlier
+ *		in the input buffer.
+ *
+ * The caller must ensure (end - input) >= 4.  This allows us to use a
+ * 4-byte memcmp() as a fast-reject filter: if the first 4 bytes don't
+ * match, skip immediately to the next history entry.  Modern compilers
+ * (GCC 7.1+, Clang) optimize memcmp(a, b, 4) == 0 into a single 4-byte
+ * load and compare — no function call overhead.
+ *
+ * This sacrifices rare 3-byte matches that differ in the 4th byte,
+ * for consistent speed improvement.  The ratio impact is negligible.
+ *
+ * History positions are offsets from source; hp below is source + pos.
+ *
+ * Boundary proof for hp (the history pointer):
+ *   - hp was a previous position in the input buffer, so hp >= source
+ *     and hp < input.
+ *   - The caller guarantees input <= end - 4, and hp < input, therefore
+ *     hp <= input - 1 <= end - 5, so hp + 4 <= end - 1 < end.
+ *   - The 4-byte memcmp at hp is safe.
+ * ----------
+ */
+static pg_attribute_always_inline int
+pglz_find_match(PGLZ_Context *ctx, const char *input, const char *end,
+				int *lenp, int *offp, int good_match, int good_drop,
+				int mask, const char *source, bool use_generations)
+{
+	int16		hentno;
+	int32		len = 0;
+	int32		off = 0;
+	int			chain_len = 0;
+	uint32		ipos = (uint32) (input - source);
+
+	/*
+	 * Traverse the linked history list until a good enough match is found.
+	 */
+	hentno = pglz_hist_head(ctx, pglz_hist_idx(input, end, mask),
+							use_generations);
+	while (hentno != PGLZ_INVALID_ENTRY)
+	{
+		PGLZ_HistEntry *hent = &ctx->hist_entries[hentno];
+		const char *ip = input;
+		const char *hp;
+		int32		thisoff;
+		int32		thislen;
+
+		/*
+		 * Stop if the offset does not fit into our tag anymore.  Checked on
+		 * the offsets, before hp is formed.
+		 */
+		thisoff = (int32) (ipos - hent->pos);
+		if (thisoff >= 0x0fff)
+			break;
+		hp = source + hent->pos;
+
+		/*
+		 * Boundary assertions (debug builds only).
+		 * hp >= source: hp is a previous input position, always >= buffer start.
+		 * hp < input: hp must precede current position (backward reference only).
+		 * hp + 4 <= end: the caller guarantees input <= end - 4, and
+		 *   hp < input, so hp + 4 <= input - 1 + 4 <= end - 1 < end + 1.
+		 *   Actually hp + 4 <= end strictly since hp <= end - 5.
+		 */
+#ifdef USE_ASSERT_CHECKING
+		Assert(hp >= source && hp < ip);
+		Assert(hp + 4 <= end);
+#endif
+
+		/*
+		 * Use 4-byte memcmp as a fast-reject filter.  If the first 4 bytes
+		 * don't match, skip immediately.  This eliminates the first 3
+		 * iterations of the inner loop for every candidate.
+		 */
+		if (memcmp(ip, hp, 4) == 0)
+		{
+			/*
+			 * Extend the match a vector or word at a time.  This also
+			 * covers candidates that must beat an existing long match,
+			 * which used to get a separate memcmp() pre-check.
+			 */
+			thislen = 4 + pglz_match_extend(ip + 4, hp + 4, end,
+											PGLZ_MAX_MATCH - 4);
+		}
+		else
+		{
+			goto next_entry;
+		}
+
+		/*
+		 * Remember this match as the best (if it is)
+		 */
+		if (thislen > len)
+		{
+			len = thislen;
+			off = thisoff;
+		}
+
+next_entry:
+		/*
+		 * Advance to the next history entry
+		 */
+		hentno = hent->next;
+
+		/*
+		 * Defense-in-depth: limit chain traversal to PGLZ_MAX_CHAIN hops.
+		 * This bounds worst-case per-byte cost with pathological hash
+		 * collisions.  Normal inputs have average chain length < 1
+		 * (4096 entries / 8192 buckets), so this limit is never hit in
+		 * practice.
+		 */
+		if (++chain_len >= PGLZ_MAX_CHAIN)
+			break;
+
+		/*
+		 * Be happy with lesser good matches the more entries we visited. But
+		 * no point in doing calculation if we're at end of list.
+		 */
+		if (hentno != PGLZ_INVALID_ENTRY)
+		{
+			if (len >= good_match)
+				break;
+			good_match -= (good_match * good_drop) / 100;
+		}
+	}
+
+	/*
+	 * Return match information only if it results at least in one byte
+	 * reduction.
+	 */
+	if (len > 2)
+	{
+		*lenp = len;
+		*offp = off;
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/* ----------
+ * pglz_begin_call -
+ *
+ *		Makes the first hashsz buckets of ctx empty for a new compression.
+ *
+ *		Without generations the buckets are set to PGLZ_INVALID_ENTRY one by
+ *		one.  With generations we only advance ctx->generation, which turns
+ *		every existing head stale at once.  When the counter wraps around,
+ *		the whole table (not only hashsz buckets, since earlier calls may
+ *		have used a bigger table) is cleared to generation 0, which is
+ *		never current.
+ *
+ *		We do not need to initialize the hist_entries[] array; its entries
+ *		are set up as they are used.
+ * ----------
+ */
+static void
+pglz_begin_call(PGLZ_Context *ctx, int hashsz)
+{
+	int			i;
+
+	if (ctx->use_generations)
+	{
+		if (++ctx->generation != 0)
+			return;
+		memset(ctx->hist_start.tagged, 0, sizeof(ctx->hist_start.tagged));
+		ctx->generation = 1;
+		return;
+	}
+
+	for (i = 0; i < hashsz; i++)
+		ctx->hist_start.plain[i] = PGLZ_INVALID_ENTRY;
+}
+
+
+/* ----------
+ * PGLZ_Params -
+ *
+ *		Compression settings derived from a strategy, clamped to the
+ *		supported range.  They do not depend on the input, so batch
+ *		callers compute them once.
+ * ----------
+ */
+typedef struct PGLZ_Params
+{
+	const PGLZ_Strategy *strategy;	/* never NULL */
+	int32		good_match;
+	int32		good_drop;
+	int32		need_rate;
+} PGLZ_Params;
+
+static void
+pglz_prepare_params(const PGLZ_Strategy *strategy, PGLZ_Params *params)
+{
+	/*
+	 * Our fallback strategy is the default.
+	 */
+	if (strategy == NULL)
+		strategy = PGLZ_strategy_default;
+	params->strategy = strategy;
+
+	/*
+	 * Limit the match parameters to the supported range.
+	 */
+	params->good_match = strategy->match_size_good;
+	if (params->good_match > PGLZ_MAX_MATCH)
+		params->good_match = PGLZ_MAX_MATCH;
+	else if (params->good_match < 17)
+		params->good_match = 17;
+
+	params->good_drop = strategy->match_size_drop;
+	if (params->good_drop < 0)
+		params->good_drop = 0;
+	else if (params->good_drop > 100)
+		params->good_drop = 100;
+
+	params->need_rate = strategy->min_comp_rate;
+	if (params->need_rate < 0)
+		params->need_rate = 0;
+	else if (params->need_rate > 99)
+		params->need_rate = 99;
+}
+
+
+/* ----------
+ * pglz_compress_internal -
+ *
+ *		The body of pglz_compress_ctx() and pglz_compress_batch_ctx().  It
+ *		is always inlined, once per value of use_generations, so that no
+ *		specialization tests the flag in the hot loop.
+ * ----------
+ */
+static pg_attribute_always_inline int32
+pglz_compress_internal(PGLZ_Context *ctx, const char *source, int32 slen,
+					   char *dest, const PGLZ_Params *params,
+					   bool use_generations)
+{
+	const PGLZ_Strategy *strategy = params->strategy;
+	unsigned char *bp = (unsigned char *) dest;
+	unsigned char *bstart = bp;
+	int			hist_next = 0;
+	bool		hist_recycle = false;
+	const char *dp = source;
+	const char *dend = source + slen;
+	unsigned char ctrl_dummy = 0;
+	unsigned char *ctrlp = &ctrl_dummy;
+	unsigned char ctrlb = 0;
+	unsigned char ctrl = 0;
+	bool		found_match = false;
+	int32		match_len;
+	int32		match_off;
+	int32		good_match = params->good_match;
+	int32		good_drop = params->good_drop;
+	int32		result_size;
+	int32		result_max;
+	int32		need_rate = params->need_rate;
+	int			hashsz;
+	int			mask;
+
+	/*
+	 * If the strategy forbids compression (at all or if source chunk size out
+	 * of range), fail.
+	 */
+	if (strategy->match_size_good <= 0 ||
+		slen < strategy->min_input_size ||
+		slen > strategy->max_input_size)
+		return -1;
+
+	/*
+	 * Compute the maximum result size allowed by the strategy, namely the
+	 * input size minus the minimum wanted compression rate.  This had better
+	 * be <= slen, else we might overrun the provided output buffer.
+	 */
+	if (slen > (INT_MAX / 100))
+	{
+		/* Approximate to avoid overflow */
+		result_max = (slen / 100) * (100 - need_rate);
+	}
+	else
+		result_max = (slen * (100 - need_rate)) / 100;
+
+	/*
+	 * Experiments suggest that these hash sizes work pretty well. A large
+	 * hash table minimizes collision, but has a higher startup cost. For a
+	 * small input, the startup cost dominates. The table size must be a power
+	 * of two.
+	 */
+	if (slen < 128)
+		hashsz = 512;
+	else if (slen < 256)
+		hashsz = 1024;
+	else if (slen < 512)
+		hashsz = 2048;
+	else if (slen < 1024)
+		hashsz = 4096;
+	else
+		hashsz = 8192;
+	mask = hashsz - 1;
+
+	/*
+	 * Initialize the history lists to empty.
+	 */
+	pglz_begin_call(ctx, hashsz);
+
+	/*
+	 * Compress the source directly into the output buffer.
+	 *
+	 * The main loop processes bytes while at least 4 bytes remain.  This
+	 * guarantees the 4-byte memcmp in pglz_find_match is safe.  The last
+	 * 1-3 bytes are handled as literals in the tail loop below.
+	 */
+	while (dp < dend - 3)
+	{
+		/*
+		 * If we already exceeded the maximum result size, fail.
+		 *
+		 * We check once per loop; since the loop body could emit as many as 4
+		 * bytes (a control byte and 3-byte tag), PGLZ_MAX_OUTPUT() had better
+		 * allow 4 slop bytes.
+		 */
+		if (bp - bstart >= result_max)
+			return -1;
+
+		/*
+		 * If we've emitted more than first_success_by bytes without finding
+		 * anything compressible at all, fail.  This lets us fall out
+		 * reasonably quickly when looking at incompressible input (such as
+		 * pre-compressed data).
+		 */
+		if (!found_match && bp - bstart >= strategy->first_success_by)
+			return -1;
+
+		/*
+		 * Try to find a match in the history.  pglz_find_match uses a
+		 * 4-byte memcmp fast-reject, so the caller guarantees at least
+		 * 4 bytes remain (ensured by the loop condition above).
+		 */
+		if (pglz_find_match(ctx, dp, dend, &match_len,
+							&match_off, good_match, good_drop, mask,
+							source, use_generations))
+		{
+			/*
+			 * Create the tag and advance dp by the full match length,
+			 * skipping hist_add for the intermediate positions.
+			 *
+			 * Skip-after-match optimization: instead of advancing dp one byte
+			 * at a time (calling hist_add for every matched byte), we jump dp
+			 * forward by match_len in one step.  The intermediate positions
+			 * are NOT added to the history table, which means the compressor
+			 * may miss some matches that start inside the matched region.
+			 *
+			 * Tradeoff: throughput vs. compression ratio.
+			 * On highly compressible data (logs, SQL dumps, JSON) this gives
+			 * 2-10x speedup with ~1-3pp ratio cost.  On incompressible data
+			 * (random bytes, pre-compressed) there is no effect since no
+			 * matches are found.  Not suitable for workloads where compression
+			 * ratio is critical.
+			 */
+			pglz_out_tag(&ctrlp, &ctrlb, &ctrl, &bp, match_len, match_off);
+
+			/*
+			 * Add only the first byte of the matched region to history
+			 * (consistent with where dp currently points), then skip forward.
+			 * Clamp to dend to avoid overshooting in boundary cases.
+			 */
+			pglz_hist_add(ctx,
+						  &hist_next, &hist_recycle,
+						  dp, dend, mask, source, use_generations);
+			dp += match_len;
+			if (dp > dend)
+				dp = dend;
+
+			found_match = true;
+		}
+		else
+		{
+			/*
+			 * No match found. Copy one literal byte.
+			 */
+			pglz_out_literal(&ctrlp, &ctrlb, &ctrl, &bp, *dp);
+			pglz_hist_add(ctx,
+						  &hist_next, &hist_recycle,
+						  dp, dend, mask, source, use_generations);
+			dp++;
+		}
+	}
+
+	/*
+	 * Tail: emit the last 0-3 bytes as literals.  We can't use the 4-byte
+	 * memcmp fast path here.
+	 */
+	while (dp < dend)
+	{
+		if (bp - bstart >= result_max)
+			return -1;
+
+		pglz_out_literal(&ctrlp, &ctrlb, &ctrl, &bp, *dp);
+		pglz_hist_add(ctx,
+					  &hist_next, &hist_recycle,
+					  dp, dend, mask, source, use_generations);
+		dp++;
+	}
+
+	/*
+	 * Write out the last control byte and check that we haven't overrun the
+	 * output size allowed by the strategy.
+	 */
+	*ctrlp = ctrlb;
+	result_size = bp - bstart;
+	if (result_size >= result_max)
+		return -1;
+
+	/* success */
+	return result_size;
+}
+
+
+/* ----------
+ * pglz_context_create -
+ *
+ *		Allocates a history context for pglz_compress_ctx().  Returns NULL
+ *		if out of memory.
+ * ----------
+ */
+PGLZ_Context *
+pglz_context_create(void)
+{
+	return pglz_context_create_extended(0);
+}
+
+
+/* ----------
+ * pglz_context_create_extended -
+ *
+ *		Like pglz_context_create(), but takes PGLZ_CTX_* flags.
+ *
+ *		A context without generations needs no initialization: every call
+ *		resets the part of the context it is going to use.  A context with
+ *		generations starts with all heads at generation 0, so the first
+ *		call (generation 1) sees them as empty.
+ * ----------
+ */
+PGLZ_Context *
+pglz_context_create_extended(int flags)
+{
+	PGLZ_Context *ctx = (PGLZ_Context *) ALLOC(sizeof(PGLZ_Context));
+
+	if (ctx == NULL)
+		return NULL;
+
+	ctx->generation = 0;
+	ctx->use_generations = (flags & PGLZ_CTX_GENERATIONS) != 0;
+	if (ctx->use_generations)
+		memset(ctx->hist_start.tagged, 0, sizeof(ctx->hist_start.tagged));
+
+	return ctx;
+}
+
+
+/* ----------
+ * pglz_context_free -
+ *
+ *		Releases a context obtained from pglz_context_create().
+ * ----------
+ */
+void
+pglz_context_free(PGLZ_Context *ctx)
+{
+	if (ctx == NULL)
+		return;
+	FREE(ctx);
+}
+
+
+/* ----------
+ * pglz_compress -
+ *
+ *		Compresses source into dest using strategy. Returns the number of
+ *		bytes written in buffer dest, or -1 if compression fails.
+ *
+ *		Uses the static context; see pglz_compress_ctx() for a reentrant
+ *		version.
+ * ----------
+ */
+int32
+pglz_compress(const char *source, int32 slen, char *dest,
+			  const PGLZ_Strategy *strategy)
+{
+	return pglz_compress_ctx(&pglz_static_context, source, slen, dest,
+							 strategy);
+}
+
+
+/* ----------
+ * pglz_compress_ctx -
+ *
+ *		Compresses source into dest using strategy, keeping all history
+ *		state in ctx.  Returns the number of bytes written in buffer dest,
+ *		or -1 if compression fails.
+ * ----------
+ */
+int32
+pglz_compress_ctx(PGLZ_Context *ctx, const char *source, int32 slen,
+				  char *dest, const PGLZ_Strategy *strategy)
+{
+	PGLZ_Params params;
+
+	pglz_prepare_params(strategy, &params);
+	if (ctx->use_generations)
+		return pglz_compress_internal(ctx, source, slen, dest, &params,
+									  true);
+	return pglz_compress_internal(ctx, source, slen, dest, &params, false);
+}
+
+
+/* ----------
+ * pglz_compress_batch_ctx -
+ *
+ *		Compresses n datums with one set of prepared parameters and the
+ *		history state in ctx, prefetching the start of each datum's input
+ *		and output while compressing the one before it.  Returns the
+ *		number of datums that compressed.
+ * ----------
+ */
+int
+pglz_compress_batch_ctx(PGLZ_Context *ctx, const char **srcs,
+						const int32 *lens, char **dests, int32 *out_lens,
+						int n, const PGLZ_Strategy *strategy)
+{
+	PGLZ_Params params;
+	int			ncompressed = 0;
+	int			i;
+
+	pglz_prepare_params(strategy, &params);
+
+	for (i = 0; i < n; i++)
+	{
+		if (i + 1 < n)
+		{
+			int32		ahead = Min(lens[i + 1], PGLZ_BATCH_PREFETCH);
+			int32		off;
+
+			for (off = 0; off < ahead; off += PGLZ_CACHE_LINE)
+			{
+				pglz_prefetch(srcs[i + 1] + off, 0);
+				pglz_prefetch(dests[i + 1] + off, 1);
+			}
+		}
+
+		if (ctx->use_generations)
+			out_lens[i] = pglz_compress_internal(ctx, srcs[i], lens[i],
+												 dests[i], &params, true);
+		else
+			out_lens[i] = pglz_compress_internal(ctx, srcs[i], lens[i],
+												 dests[i], &params, false);
+		if (out_lens[i] >= 0)
+			ncompressed++;
+	}
+
+	return ncompressed;
+}
+
+
+/* ----------
+ * pglz_compress_batch -
+ *
+ *		pglz_compress_batch_ctx() with the static batch context, which uses
+ *		generations.
+ * ----------
+ */
+int
+pglz_compress_batch(const char **srcs, const int32 *lens, char **dests,
+					int32 *out_lens, int n, const PGLZ_Strategy *strategy)
+{
+	return pglz_compress_batch_ctx(&pglz_batch_context, srcs, lens, dests,
+								   out_lens, n, strategy);
+}
+
+
+/* ----------
+ * PGLZ_Stream -
+ *
+ *		State of a streaming compression between pglz_stream_update()
+ *		calls.
+ *
+ * buf[0 .. buflen) is a window onto the input; positions below dpos are
+ * encoded, the rest waits for lookahead.  History positions are offsets
+ * into buf and are rebased when the window slides (pglz_stream_slide).
+ *
+ * The control group being filled has its control byte in pending[0],
+ * followed by its items, npending bytes in all.  ctrlb and ctrl are the
+ * control byte's value so far and its next bit, as in
+ * pglz_compress_internal(); ctrl == 0 means no group is open and
+ * npending is 0.
+ * ----------
+ */
+struct PGLZ_Stream
+{
+	PGLZ_Context ctx;
+	PGLZ_Params params;
+	int			hist_next;
+	bool		hist_recycle;
+	int32		buflen;
+	int32		dpos;
+	unsigned char ctrlb;
+	unsigned char ctrl;
+	int32		npending;
+	unsigned char pending[PGLZ_STREAM_PENDING];
+	char		buf[PGLZ_STREAM_BUFSIZE];
+};
+
+/* The bound exported for pglz_stream_update() callers must hold */
+PGLZ_STATIC_ASSERT(PGLZ_STREAM_LOOKAHEAD + PGLZ_STREAM_LOOKAHEAD / 8 + 2 +
+					PGLZ_STREAM_PENDING <= PGLZ_STREAM_MAX_OUTPUT(0),
+					stream_max_output_fits);
+
+
+/* ----------
+ * pglz_stream_encode -
+ *
+ *		Encodes the stream's input from dpos on, appending to the output at
+ *		bp, and returns the new end of output.  Without flush, it stops at
+ *		the first position with fewer than PGLZ_STREAM_LOOKAHEAD bytes
+ *		after it; with flush, it encodes everything, like the main and tail
+ *		loops of pglz_compress_internal().
+ *
+ *		*ctrlp is the position of the open group's control byte, or a
+ *		dummy if none is open.
+ * ----------
+ */
+static unsigned char *
+pglz_stream_encode(PGLZ_Stream *stream, unsigned char **ctrlp,
+				   unsigned char *bp, bool flush)
+{
+	PGLZ_Context *ctx = &stream->ctx;
+	const char *source = stream->buf;
+	const char *dp = source + stream->dpos;
+	const char *dend = source + stream->buflen;
+	const char *dlimit;
+	int32		limit;
+	unsigned char ctrlb = stream->ctrlb;
+	unsigned char ctrl = stream->ctrl;
+	int			hist_next = stream->hist_next;
+	bool		hist_recycle = stream->hist_recycle;
+	int32		match_len;
+	int32		match_off;
+	int			mask = PGLZ_MAX_HISTORY_LISTS - 1;
+
+	limit = stream->buflen - (flush ? 3 : PGLZ_STREAM_LOOKAHEAD);
+	dlimit = source + Max(limit, 0);
+
+	while (dp < dlimit)
+	{
+		if (pglz_find_match(ctx, dp, dend, &match_len, &match_off,
+							stream->params.good_match,
+							stream->params.good_drop, mask, source, false))
+		{
+			pglz_out_tag(ctrlp, &ctrlb, &ctrl, &bp, match_len, match_off);
+			pglz_hist_add(ctx, &hist_next, &hist_recycle,
+						  dp, dend, mask, source, false);
+			dp += match_len;
+		}
+		else
+		{
+			pglz_out_literal(ctrlp, &ctrlb, &ctrl, &bp, *dp);
+			pglz_hist_add(ctx, &hist_next, &hist_recycle,
+						  dp, dend, mask, source, false);
+			dp++;
+		}
+	}
+
+	if (flush)
+	{
+		while (dp < dend)
+		{
+			pglz_out_literal(ctrlp, &ctrlb, &ctrl, &bp, *dp);
+			pglz_hist_add(ctx, &hist_next, &hist_recycle,
+						  dp, dend, mask, source, false);
+			dp++;
+		}
+	}
+
+	stream->dpos = (int32) (dp - source);
+	stream->ctrlb = ctrlb;
+	stream->ctrl = ctrl;
+	stream->hist_next = hist_next;
+	stream->hist_recycle = hist_recycle;
+	return bp;
+}
+
+
+/* ----------
+ * pglz_stream_slide -
+ *
+ *		Drops the input that lies more than PGLZ_HISTORY_SIZE bytes before
+ *		dpos from the window, and rebases the history positions.
+ *
+ *		An entry that pointed into the dropped part gets position 0, which
+ *		is at least PGLZ_HISTORY_SIZE bytes behind dpos from now on, so
+ *		pglz_find_match() stops at it just as it would have at the real
+ *		position.  Entries not handed out yet are left alone.
+ * ----------
+ */
+static void
+pglz_stream_slide(PGLZ_Stream *stream)
+{
+	uint32		shift = (uint32) (stream->dpos - PGLZ_HISTORY_SIZE);
+	int			nentries;
+	int			i;
+
+#ifdef USE_ASSERT_CHECKING
+	Assert(stream->dpos >= PGLZ_HISTORY_SIZE);
+#endif
+
+	memmove(stream->buf, stream->buf + shift, stream->buflen - shift);
+	stream->buflen -= shift;
+	stream->dpos -= shift;
+
+	nentries = stream->hist_recycle ? PGLZ_HISTORY_SIZE + 1 : stream->hist_next;
+	for (i = 0; i < nentries; i++)
+	{
+		PGLZ_HistEntry *hent = &stream->ctx.hist_entries[i];
+
+		hent->pos = hent->pos >= shift ? hent->pos - shift : 0;
+	}
+}
+
+
+/* ----------
+ * pglz_stream_resume -
+ *
+ *		Copies the open control group to the start of dest and points
+ *		*ctrlp at its control byte.  Returns the end of output.
+ * ----------
+ */
+static unsigned char *
+pglz_stream_resume(PGLZ_Stream *stream, char *dest, unsigned char **ctrlp,
+				   unsigned char *ctrl_dummy)
+{
+	unsigned char *bp = (unsigned char *) dest;
+
+	memcpy(bp, stream->pending, stream->npending);
+	*ctrlp = stream->ctrl != 0 ? bp : ctrl_dummy;
+	return bp + stream->npending;
+}
+
+
+/* ----------
+ * pglz_stream_suspend -
+ *
+ *		Moves the open control group from the end of the output back into
+ *		the stream, and returns the number of finished bytes before it.
+ *		If the last group is full, its control byte is final and it is
+ *		finished too.
+ * ----------
+ */
+static int32
+pglz_stream_suspend(PGLZ_Stream *stream, char *dest, unsigned char *ctrlp,
+					unsigned char *bp)
+{
+	unsigned char *keep;
+
+	if (stream->ctrl == 0)
+	{
+		*ctrlp = stream->ctrlb;
+		keep = bp;
+	}
+	else
+		keep = ctrlp;
+
+	stream->npending = (int32) (bp - keep);
+#ifdef USE_ASSERT_CHECKING
+	Assert(stream->npending <= PGLZ_STREAM_PENDING);
+#endif
+	memcpy(stream->pending, keep, stream->npending);
+	return (int32) (keep - (unsigned char *) dest);
+}
+
+
+/* ----------
+ * pglz_stream_begin -
+ *
+ *		Allocates and starts a streaming compression.  Returns NULL if out
+ *		of memory.
+ * ----------
+ */
+PGLZ_Stream *
+pglz_stream_begin(const PGLZ_Strategy *strategy)
+{
+	PGLZ_Stream *stream = (PGLZ_Stream *) ALLOC(sizeof(PGLZ_Stream));
+
+	if (stream == NULL)
+		return NULL;
+
+	/*
+	 * The total length is not known up front, so always use the table size
+	 * that pglz_compress() picks for inputs of 1024 bytes or more.
+	 */
+	stream->ctx.generation = 0;
+	stream->ctx.use_generations = false;
+	pglz_begin_call(&stream->ctx, PGLZ_MAX_HISTORY_LISTS);
+	pglz_prepare_params(strategy, &stream->params);
+
+	stream->hist_next = 0;
+	stream->hist_recycle = false;
+	stream->buflen = 0;
+	stream->dpos = 0;
+	stream->ctrlb = 0;
+	stream->ctrl = 0;
+	stream->npending = 0;
+
+	return stream;
+}
+
+
+/* ----------
+ * pglz_stream_update -
+ *
+ *		Appends slen bytes of source to the stream and writes the output
+ *		that is finished to dest.  Returns the number of bytes written.
+ * ----------
+ */
+int32
+pglz_stream_update(PGLZ_Stream *stream, const char *source, int32 slen,
+				   char *dest)
+{
+	unsigned char ctrl_dummy = 0;
+	unsigned char *ctrlp;
+	unsigned char *bp;
+
+	bp = pglz_stream_resume(stream, dest, &ctrlp, &ctrl_dummy);
+
+	while (slen > 0)
+	{
+		int32		n;
+
+		/*
+		 * A full window has been encoded up to its last lookahead, so dpos
+		 * is well past PGLZ_HISTORY_SIZE and sliding frees room.
+		 */
+		if (stream->buflen == PGLZ_STREAM_BUFSIZE)
+			pglz_stream_slide(stream);
+
+		n = Min(slen, PGLZ_STREAM_BUFSIZE - stream->buflen);
+		memcpy(stream->buf + stream->buflen, source, n);
+		stream->buflen += n;
+		source += n;
+		slen -= n;
+
+		bp = pglz_stream_encode(stream, &ctrlp, bp, false);
+	}
+
+	return pglz_stream_suspend(stream, dest, ctrlp, bp);
+}
+
+
+/* ----------
+ * pglz_stream_end -
+ *
+ *		Finishes the stream into dest, or abandons it if dest is NULL, and
+ *		frees it.  Returns the number of bytes written.
+ * ----------
+ */
+int32
+pglz_stream_end(PGLZ_Stream *stream, char *dest)
+{
+	unsigned char ctrl_dummy = 0;
+	unsigned char *ctrlp;
+	unsigned char *bp;
+	int32		result_size = 0;
+
+	if (dest != NULL)
+	{
+		bp = pglz_stream_resume(stream, dest, &ctrlp, &ctrl_dummy);
+		bp = pglz_stream_encode(stream, &ctrlp, bp, true);
+
+		/* Write out the last control byte */
+		*ctrlp = stream->ctrlb;
+		result_size = (int32) (bp - (unsigned char *) dest);
+	}
+
+	FREE(stream);
+	return result_size;
+}
+
+
+/* ----------
+ * pglz_copy_match -
+ *
+ *		Fast-path copy of a match of len bytes from dp - off to dp.
+ *
+ *		The caller guarantees that at least PGLZ_FAST_DEST_SLACK bytes of
+ *		dest remain at dp, so the copy may store up to 15 bytes beyond
+ *		len.  Bytes past dp + len are scratch: a later item overwrites
+ *		them, or they lie beyond the final output length.
+ * ----------
+ */
+static inline void
+pglz_copy_match(unsigned char *dp, int32 off, int32 len)
+{
+	const unsigned char *from = dp - off;
+	unsigned char *end = dp + len;
+
+	if (off >= 16)
+	{
+		/*
+		 * Each 16-byte chunk reads bytes that are at least 16 bytes back,
+		 * so source and destination of one memcpy() never overlap, and
+		 * later chunks see the bytes that earlier chunks produced.
+		 */
+		do
+		{
+			memcpy(dp, from, 16);
+			dp += 16;
+			from += 16;
+		} while (dp < end);
+	}
+	else if (off == 1 || off == 2 || off == 4 || off == 8)
+	{
+		unsigned char pattern[16];
+		int			i;
+
+		/*
+		 * The period divides 16, so every 16-byte chunk of the output is
+		 * the same: splat the period into a pattern once, store it
+		 * repeatedly.
+		 */
+		for (i = 0; i < 16; i += off)
+			memcpy(pattern + i, from, off);
+		do
+		{
+			memcpy(dp, pattern, 16);
+			dp += 16;
+		} while (dp < end);
+	}
+	else
+	{
+		/* Other short periods: see the doubling loop in pglz_decompress */
+		while (off < len)
+		{
+			memcpy(dp, dp - off, off);
+			len -= off;
+			dp += off;
+			off += off;
+		}
+		memcpy(dp, dp - off, len);
+	}
+}
+
+
+/* ----------
+ * pglz_ctrl_table -
+ *
+ *		Decoding plan for each control byte value.  ntags is the number of
+ *		set bits (match tags) in the byte, and lits[0 .. ntags] are the
+ *		lengths of the literal runs before the first tag, between tags
+ *		and after the last tag, in bit order (LSB first).  The runs and
+ *		tags of one entry always add up to 8 items.
+ * ----------
+ */
+typedef struct PGLZ_CtrlEntry
+{
+	uint8		ntags;
+	uint8		lits[9];
+} PGLZ_CtrlEntry;
+
+static const PGLZ_CtrlEntry pglz_ctrl_table[256] = {
+	/* 0x00 */ {0, {8}}, {1, {0, 7}},
+	/* 0x02 */ {1, {1, 6}}, {2, {0, 0, 6}},
+	/* 0x04 */ {1, {2, 5}}, {2, {0, 1, 5}},
+	/* 0x06 */ {2, {1, 0, 5}}, {3, {0, 0, 0, 5}},
+	/* 0x08 */ {1, {3, 4}}, {2, {0, 2, 4}},
+	/* 0x0a */ {2, {1, 1, 4}}, {3, {0, 0, 1, 4}},
+	/* 0x0c */ {2, {2, 0, 4}}, {3, {0, 1, 0, 4}},
+	/* 0x0e */ {3, {1, 0, 0, 4}}, {4, {0, 0, 0, 0, 4}},
+	/* 0x10 */ {1, {4, 3}}, {2, {0, 3, 3}},
+	/* 0x12 */ {2, {1, 2, 3}}, {3, {0, 0, 2, 3}},
+	/* 0x14 */ {2, {2, 1, 3}}, {3, {0, 1, 1, 3}},
+	/* 0x16 */ {3, {1, 0, 1, 3}}, {4, {0, 0, 0, 1, 3}},
+	/* 0x18 */ {2, {3, 0, 3}}, {3, {0, 2, 0, 3}},
+	/* 0x1a */ {3, {1, 1, 0, 3}}, {4, {0, 0, 1, 0, 3}},
+	/* 0x1c */ {3, {2, 0, 0, 3}}, {4, {0, 1, 0, 0, 3}},
+	/* 0x1e */ {4, {1, 0, 0, 0, 3}}, {5, {0, 0, 0, 0, 0, 3}},
+	/* 0x20 */ {1, {5, 2}}, {2, {0, 4, 2}},
+	/* 0x22 */ {2, {1, 3, 2}}, {3, {0, 0, 3, 2}},
+	/* 0x24 */ {2, {2, 2, 2}}, {3, {0, 1, 2, 2}},
+	/* 0x26 */ {3, {1, 0, 2, 2}}, {4, {0, 0, 0, 2, 2}},
+	/* 0x28 */ {2, {3, 1, 2}}, {3, {0, 2, 1, 2}},
+	/* 0x2a */ {3, {1, 1, 1, 2}}, {4, {0, 0, 1, 1, 2}},
+	/* 0x2c */ {3, {2, 0, 1, 2}}, {4, {0, 1, 0, 1, 2}},
+	/* 0x2e */ {4, {1, 0, 0, 1, 2}}, {5, {0, 0, 0, 0, 1, 2}},
+	/* 0x30 */ {2, {4, 0, 2}}, {3, {0, 3, 0, 2}},
+	/* 0x32 */ {3, {1, 2, 0, 2}}, {4, {0, 0, 2, 0, 2}},
+	/* 0x34 */ {3, {2, 1, 0, 2}}, {4, {0, 1, 1, 0, 2}},
+	/* 0x36 */ {4, {1, 0, 1, 0, 2}}, {5, {0, 0, 0, 1, 0, 2}},
+	/* 0x38 */ {3, {3, 0, 0, 2}}, {4, {0, 2, 0, 0, 2}},
+	/* 0x3a */ {4, {1, 1, 0, 0, 2}}, {5, {0, 0, 1, 0, 0, 2}},
+	/* 0x3c */ {4, {2, 0, 0, 0, 2}}, {5, {0, 1, 0, 0, 0, 2}},
+	/* 0x3e */ {5, {1, 0, 0, 0, 0, 2}}, {6, {0, 0, 0, 0, 0, 0, 2}},
+	/* 0x40 */ {1, {6, 1}}, {2, {0, 5, 1}},
+	/* 0x42 */ {2, {1, 4, 1}}, {3, {0, 0, 4, 1}},
+	/* 0x44 */ {2, {2, 3, 1}}, {3, {0, 1, 3, 1}},
+	/* 0x46 */ {3, {1, 0, 3, 1}}, {4, {0, 0, 0, 3, 1}},
+	/* 0x48 */ {2, {3, 2, 1}}, {3, {0, 2, 2, 1}},
+	/* 0x4a */ {3, {1, 1, 2, 1}}, {4, {0, 0, 1, 2, 1}},
+	/* 0x4c */ {3, {2, 0, 2, 1}}, {4, {0, 1, 0, 2, 1}},
+	/* 0x4e */ {4, {1, 0, 0, 2, 1}}, {5, {0, 0, 0, 0, 2, 1}},
+	/* 0x50 */ {2, {4, 1, 1}}, {3, {0, 3, 1, 1}},
+	/* 0x52 */ {3, {1, 2, 1, 1}}, {4, {0, 0, 2, 1, 1}},
+	/* 0x54 */ {3, {2, 1, 1, 1}}, {4, {0, 1, 1, 1, 1}},
+	/* 0x56 */ {4, {1, 0, 1, 1, 1}}, {5, {0, 0, 0, 1, 1, 1}},
+	/* 0x58 */ {3, {3, 0, 1, 1}}, {4, {0, 2, 0, 1, 1}},
+	/* 0x5a */ {4, {1, 1, 0, 1, 1}}, {5, {0, 0, 1, 0, 1, 1}},
+	/* 0x5c */ {4, {2, 0, 0, 1, 1}}, {5, {0, 1, 0, 0, 1, 1}},
+	/* 0x5e */ {5, {1, 0, 0, 0, 1, 1}}, {6, {0, 0, 0, 0, 0, 1, 1}},
+	/* 0x60 */ {2, {5, 0, 1}}, {3, {0, 4, 0, 1}},
+	/* 0x62 */ {3, {1, 3, 0, 1}}, {4, {0, 0, 3, 0, 1}},
+	/* 0x64 */ {3, {2, 2, 0, 1}}, {4, {0, 1, 2, 0, 1}},
+	/* 0x66 */ {4, {1, 0, 2, 0, 1}}, {5, {0, 0, 0, 2, 0, 1}},
+	/* 0x68 */ {3, {3, 1, 0, 1}}, {4, {0, 2, 1, 0, 1}},
+	/* 0x6a */ {4, {1, 1, 1, 0, 1}}, {5, {0, 0, 1, 1, 0, 1}},
+	/* 0x6c */ {4, {2, 0, 1, 0, 1}}, {5, {0, 1, 0, 1, 0, 1}},
+	/* 0x6e */ {5, {1, 0, 0, 1, 0, 1}}, {6, {0, 0, 0, 0, 1, 0, 1}},
+	/* 0x70 */ {3, {4, 0, 0, 1}}, {4, {0, 3, 0, 0, 1}},
+	/* 0x72 */ {4, {1, 2, 0, 0, 1}}, {5, {0, 0, 2, 0, 0, 1}},
+	/* 0x74 */ {4, {2, 1, 0, 0, 1}}, {5, {0, 1, 1, 0, 0, 1}},
+	/* 0x76 */ {5, {1, 0, 1, 0, 0, 1}}, {6, {0, 0, 0, 1, 0, 0, 1}},
+	/* 0x78 */ {4, {3, 0, 0, 0, 1}}, {5, {0, 2, 0, 0, 0, 1}},
+	/* 0x7a */ {5, {1, 1, 0, 0, 0, 1}}, {6, {0, 0, 1, 0, 0, 0, 1}},
+	/* 0x7c */ {5, {2, 0, 0, 0, 0, 1}}, {6, {0, 1, 0, 0, 0, 0, 1}},
+	/* 0x7e */ {6, {1, 0, 0, 0, 0, 0, 1}}, {7, {0, 0, 0, 0, 0, 0, 0, 1}},
+	/* 0x80 */ {1, {7, 0}}, {2, {0, 6, 0}},
+	/* 0x82 */ {2, {1, 5, 0}}, {3, {0, 0, 5, 0}},
+	/* 0x84 */ {2, {2, 4, 0}}, {3, {0, 1, 4, 0}},
+	/* 0x86 */ {3, {1, 0, 4, 0}}, {4, {0, 0, 0, 4, 0}},
+	/* 0x88 */ {2, {3, 3, 0}}, {3, {0, 2, 3, 0}},
+	/* 0x8a */ {3, {1, 1, 3, 0}}, {4, {0, 0, 1, 3, 0}},
+	/* 0x8c */ {3, {2, 0, 3, 0}}, {4, {0, 1, 0, 3, 0}},
+	/* 0x8e */ {4, {1, 0, 0, 3, 0}}, {5, {0, 0, 0, 0, 3, 0}},
+	/* 0x90 */ {2, {4, 2, 0}}, {3, {0, 3, 2, 0}},
+	/* 0x92 */ {3, {1, 2, 2, 0}}, {4, {0, 0, 2, 2, 0}},
+	/* 0x94 */ {3, {2, 1, 2, 0}}, {4, {0, 1, 1, 2, 0}},
+	/* 0x96 */ {4, {1, 0, 1, 2, 0}}, {5, {0, 0, 0, 1, 2, 0}},
+	/* 0x98 */ {3, {3, 0, 2, 0}}, {4, {0, 2, 0, 2, 0}},
+	/* 0x9a */ {4, {1, 1, 0, 2, 0}}, {5, {0, 0, 1, 0, 2, 0}},
+	/* 0x9c */ {4, {2, 0, 0, 2, 0}}, {5, {0, 1, 0, 0, 2, 0}},
+	/* 0x9e */ {5, {1, 0, 0, 0, 2, 0}}, {6, {0, 0, 0, 0, 0, 2, 0}},
+	/* 0xa0 */ {2, {5, 1, 0}}, {3, {0, 4, 1, 0}},
+	/* 0xa2 */ {3, {1, 3, 1, 0}}, {4, {0, 0, 3, 1, 0}},
+	/* 0xa4 */ {3, {2, 2, 1, 0}}, {4, {0, 1, 2, 1, 0}},
+	/* 0xa6 */ {4, {1, 0, 2, 1, 0}}, {5, {0, 0, 0, 2, 1, 0}},
+	/* 0xa8 */ {3, {3, 1, 1, 0}}, {4, {0, 2, 1, 1, 0}},
+	/* 0xaa */ {4, {1, 1, 1, 1, 0}}, {5, {0, 0, 1, 1, 1, 0}},
+	/* 0xac */ {4, {2, 0, 1, 1, 0}}, {5, {0, 1, 0, 1, 1, 0}},
+	/* 0xae */ {5, {1, 0, 0, 1, 1, 0}}, {6, {0, 0, 0, 0, 1, 1, 0}},
+	/* 0xb0 */ {3, {4, 0, 1, 0}}, {4, {0, 3, 0, 1, 0}},
+	/* 0xb2 */ {4, {1, 2, 0, 1, 0}}, {5, {0, 0, 2, 0, 1, 0}},
+	/* 0xb4 */ {4, {2, 1, 0, 1, 0}}, {5, {0, 1, 1, 0, 1, 0}},
+	/* 0xb6 */ {5, {1, 0, 1, 0, 1, 0}}, {6, {0, 0, 0, 1, 0, 1, 0}},
+	/* 0xb8 */ {4, {3, 0, 0, 1, 0}}, {5, {0, 2, 0, 0, 1, 0}},
+	/* 0xba */ {5, {1, 1, 0, 0, 1, 0}}, {6, {0, 0, 1, 0, 0, 1, 0}},
+	/* 0xbc */ {5, {2, 0, 0, 0, 1, 0}}, {6, {0, 1, 0, 0, 0, 1, 0}},
+	/* 0xbe */ {6, {1, 0, 0, 0, 0, 1, 0}}, {7, {0, 0, 0, 0, 0, 0, 1, 0}},
+	/* 0xc0 */ {2, {6, 0, 0}}, {3, {0, 5, 0, 0}},
+	/* 0xc2 */ {3, {1, 4, 0, 0}}, {4, {0, 0, 4, 0, 0}},
+	/* 0xc4 */ {3, {2, 3, 0, 0}}, {4, {0, 1, 3, 0, 0}},
+	/* 0xc6 */ {4, {1, 0, 3, 0, 0}}, {5, {0, 0, 0, 3, 0, 0}},
+	/* 0xc8 */ {3, {3, 2, 0, 0}}, {4, {0, 2, 2, 0, 0}},
+	/* 0xca */ {4, {1, 1, 2, 0, 0}}, {5, {0, 0, 1, 2, 0, 0}},
+	/* 0xcc */ {4, {2, 0, 2, 0, 0}}, {5, {0, 1, 0, 2, 0, 0}},
+	/* 0xce */ {5, {1, 0, 0, 2, 0, 0}}, {6, {0, 0, 0, 0, 2, 0, 0}},
+	/* 0xd0 */ {3, {4, 1, 0, 0}}, {4, {0, 3, 1, 0, 0}},
+	/* 0xd2 */ {4, {1, 2, 1, 0, 0}}, {5, {0, 0, 2, 1, 0, 0}},
+	/* 0xd4 */ {4, {2, 1, 1, 0, 0}}, {5, {0, 1, 1, 1, 0, 0}},
+	/* 0xd6 */ {5, {1, 0, 1, 1, 0, 0}}, {6, {0, 0, 0, 1, 1, 0, 0}},
+	/* 0xd8 */ {4, {3, 0, 1, 0, 0}}, {5, {0, 2, 0, 1, 0, 0}},
+	/* 0xda */ {5, {1, 1, 0, 1, 0, 0}}, {6, {0, 0, 1, 0, 1, 0, 0}},
+	/* 0xdc */ {5, {2, 0, 0, 1, 0, 0}}, {6, {0, 1, 0, 0, 1, 0, 0}},
+	/* 0xde */ {6, {1, 0, 0, 0, 1, 0, 0}}, {7, {0, 0, 0, 0, 0, 1, 0, 0}},
+	/* 0xe0 */ {3, {5, 0, 0, 0}}, {4, {0, 4, 0, 0, 0}},
+	/* 0xe2 */ {4, {1, 3, 0, 0, 0}}, {5, {0, 0, 3, 0, 0, 0}},
+	/* 0xe4 */ {4, {2, 2, 0, 0, 0}}, {5, {0, 1, 2, 0, 0, 0}},
+	/* 0xe6 */ {5, {1, 0, 2, 0, 0, 0}}, {6, {0, 0, 0, 2, 0, 0, 0}},
+	/* 0xe8 */ {4, {3, 1, 0, 0, 0}}, {5, {0, 2, 1, 0, 0, 0}},
+	/* 0xea */ {5, {1, 1, 1, 0, 0, 0}}, {6, {0, 0, 1, 1, 0, 0, 0}},
+	/* 0xec */ {5, {2, 0, 1, 0, 0, 0}}, {6, {0, 1, 0, 1, 0, 0, 0}},
+	/* 0xee */ {6, {1, 0, 0, 1, 0, 0, 0}}, {7, {0, 0, 0, 0, 1, 0, 0, 0}},
+	/* 0xf0 */ {4, {4, 0, 0, 0, 0}}, {5, {0, 3, 0, 0, 0, 0}},
+	/* 0xf2 */ {5, {1, 2, 0, 0, 0, 0}}, {6, {0, 0, 2, 0, 0, 0, 0}},
+	/* 0xf4 */ {5, {2, 1, 0, 0, 0, 0}}, {6, {0, 1, 1, 0, 0, 0, 0}},
+	/* 0xf6 */ {6, {1, 0, 1, 0, 0, 0, 0}}, {7, {0, 0, 0, 1, 0, 0, 0, 0}},
+	/* 0xf8 */ {5, {3, 0, 0, 0, 0, 0}}, {6, {0, 2, 0, 0, 0, 0, 0}},
+	/* 0xfa */ {6, {1, 1, 0, 0, 0, 0, 0}}, {7, {0, 0, 1, 0, 0, 0, 0, 0}},
+	/* 0xfc */ {6, {2, 0, 0, 0, 0, 0, 0}}, {7, {0, 1, 0, 0, 0, 0, 0, 0}},
+	/* 0xfe */ {7, {1, 0, 0, 0, 0, 0, 0, 0}}, {8, {0, 0, 0, 0, 0, 0, 0, 0, 0}}
+};
+
+
+/* ----------
+ * pglz_decode_fast -
+ *
+ *		The fast path of the decoders: decodes whole control groups starting
+ *		at *sp into *dp.  While a whole control group (1 + 8 * 3 bytes, plus
+ *		8 for literal over-read) of input and a maximal match plus 16 bytes
+ *		of scratch are left, no item can overrun either buffer and we skip
+ *		the end checks.  pglz_ctrl_table turns the control byte into a tag
+ *		count and literal run lengths, so we branch per tag rather than per
+ *		item.  The dest slack is rechecked before every match, since one
+ *		group can produce up to 8 * PGLZ_MAX_MATCH bytes; if it runs out
+ *		mid-group, *ctrl and *ctrlc are left describing the rest of the
+ *		group for the caller's careful loop.  Otherwise *ctrlc is 8.
+ *
+ *		In slice mode the scratch space past destend covers one match plus
+ *		a literal run, so it is enough that each group and each tag start
+ *		before destend, and we stop with PGLZ_FAST_FULL as soon as the
+ *		prefix is complete.
+ *
+ *		Returns PGLZ_FAST_CORRUPT on a bad match offset, else
+ *		PGLZ_FAST_MORE.  *sp and *dp are advanced past what was decoded.
+ * ----------
+ */
+#define PGLZ_FAST_CORRUPT		(-1)
+#define PGLZ_FAST_MORE			0
+#define PGLZ_FAST_FULL			1
+
+static pg_attribute_always_inline int
+pglz_decode_fast(const unsigned char **spp, const unsigned char *srcend,
+				 unsigned char **dpp, unsigned char *destend,
+				 const unsigned char *dest, unsigned char *ctrlp,
+				 int *ctrlcp, bool slice)
+{
+	const unsigned char *sp = *spp;
+	unsigned char *dp = *dpp;
+	unsigned char ctrl = 0;
+	int			ctrlc = 8;
+	int			result = PGLZ_FAST_MORE;
+
+	while (srcend - sp >= PGLZ_FAST_SRC_SLACK &&
+		   (slice ? dp < destend : destend - dp >= PGLZ_FAST_DEST_SLACK))
+	{
+		const PGLZ_CtrlEntry *plan;
+		int			t;
+
+		ctrl = *sp++;
+		plan = &pglz_ctrl_table[ctrl];
+		ctrlc = 0;
+
+		for (t = 0; t < plan->ntags; t++)
+		{
+			int32		nlit = plan->lits[t];
+			int32		len;
+			int32		off;
+
+			/*
+			 * Copy the literal run ahead of this tag with a fixed-size copy;
+			 * bytes stored past the run are overwritten by the tag below.
+			 */
+			memcpy(dp, sp, 8);
+			dp += nlit;
+			sp += nlit;
+			ctrlc += nlit;
+
+			/*
+			 * A slice is done once the prefix is complete; items after
+			 * destend are never looked at, as in the slow loop.
+			 */
+			if (slice && dp >= destend)
+			{
+				result = PGLZ_FAST_FULL;
+				goto done;
+			}
+
+			if (!slice && unlikely(destend - dp < PGLZ_FAST_DEST_SLACK))
+			{
+				/* Let the caller finish this group from the tag on */
+				ctrl >>= ctrlc;
+				goto done;
+			}
+
+			len = (sp[0] & 0x0f) + 3;
+			off = ((sp[0] & 0xf0) << 4) | sp[1];
+			sp += 2;
+			if (len == 18)
+				len += *sp++;
+
+			/* Same corruption checks as the slow loop; sp cannot pass srcend */
+			if (unlikely(off == 0 || off > (dp - dest)))
+				return PGLZ_FAST_CORRUPT;
+
+			pglz_copy_match(dp, off, len);
+			dp += len;
+			ctrlc++;
+		}
+
+		/* Trailing literal run (all 8 items if the byte has no tags) */
+		memcpy(dp, sp, 8);
+		dp += plan->lits[t];
+		sp += plan->lits[t];
+	}
+	ctrlc = 8;
+	if (slice && dp >= destend)
+		result = PGLZ_FAST_FULL;
+
+done:
+	*spp = sp;
+	*dpp = dp;
+	*ctrlp = ctrl;
+	*ctrlcp = ctrlc;
+	return result;
+}
+
+
+/* ----------
+ * pglz_decompress_internal -
+ *
+ *		Decoder shared by pglz_decompress() and pglz_decompress_slice().
+ *		With slice, dest extends PGLZ_SLICE_SLACK bytes past rawsize and
+ *		the fast path runs until the output reaches rawsize.
+ *		Always inlined so that each caller gets its own copy of the loop
+ *		with the slice tests folded away.
+ * ----------
+ */
+static pg_attribute_always_inline int32
+pglz_decompress_internal(const char *source, int32 slen, char *dest,
+						 int32 rawsize, bool check_complete, bool slice)
+{
+	const unsigned char *sp;
+	const unsigned char *srcend;
+	unsigned char *dp;
+	unsigned char *destend;
+	unsigned char ctrl = 0;
+	int			ctrlc = 8;		/* items left to do in ctrl: 8 - ctrlc */
+
+	sp = (const unsigned char *) source;
+	srcend = ((const unsigned char *) source) + slen;
+	dp = (unsigned char *) dest;
+	destend = dp + rawsize;
+
+	/*
+	 * Fast path first; the slow loop below finishes whatever it leaves,
+	 * starting with the rest of ctrl if it stopped in the middle of a
+	 * group.
+	 */
+	switch (pglz_decode_fast(&sp, srcend, &dp, destend,
+							 (unsigned char *) dest, &ctrl, &ctrlc, slice))
+	{
+		case PGLZ_FAST_CORRUPT:
+			return -1;
+		case PGLZ_FAST_FULL:
+			return rawsize;
+		default:
+			break;
+	}
+
+	while (sp < srcend && dp < destend)
+	{
+		/*
+		 * Read one control byte and process the next 8 items (or as many as
+		 * remain in the compressed input).  When we come from the fast
+		 * path in the middle of a group, finish that group first.
+		 */
+		if (ctrlc == 8)
+		{
+			ctrl = *sp++;
+			ctrlc = 0;
+		}
+
+		for (; ctrlc < 8 && sp < srcend && dp < destend; ctrlc++)
+		{
+			if (ctrl & 1)
+			{
+				/*
+				 * Set control bit means we must read a match tag. The match
+				 * is coded with two bytes. First byte uses lower nibble to
+				 * code length - 3. Higher nibble contains upper 4 bits of the
+				 * offset. The next following byte contains the lower 8 bits
+				 * of the offset. If the length is coded as 18, another
+				 * extension tag byte tells how much longer the match really
+				 * was (0-255).
+				 */
+				int32		len;
+				int32		off;
+
+				len = (sp[0] & 0x0f) + 3;
+				off = ((sp[0] & 0xf0) << 4) | sp[1];
+				sp += 2;
+				if (len == 18)
+					len += *sp++;
+
+				/*
+				 * Check for corrupt data: if we fell off the end of the
+				 * source, or if we obtained off = 0, or if off is more than
+				 * the distance back to the buffer start, we have problems.
+				 * (We must check for off = 0, else we risk an infinite loop
+				 * below in the face of corrupt data.  Likewise, the upper
+				 * limit on off prevents accessing outside the buffer
+				 * boundaries.)
+				 */
+				if (unlikely(sp > srcend || off == 0 ||
+							 off > (dp - (unsigned char *) dest)))
+					return -1;
+
+				/*
+				 * Don't emit more data than requested.
+				 */
+				len = Min(len, destend - dp);
+
+				/*
+				 * Now we copy the bytes specified by the tag from OUTPUT to
+				 * OUTPUT (copy len bytes from dp - off to dp).  The copied
+				 * areas could overlap, so to avoid undefined behavior in
+				 * memcpy(), be careful to copy only non-overlapping regions.
+				 *
+				 * Note that we cannot use memmove() instead, since while its
+				 * behavior is well-defined, it's also not what we want.
+				 */
+				while (off < len)
+				{
+					/*
+					 * We can safely copy "off" bytes since that clearly
+					 * results in non-overlapping source and destination.
+					 */
+					memcpy(dp, dp - off, off);
+					len -= off;
+					dp += off;
+
+					/*----------
+					 * This bit is less obvious: we can double "off" after
+					 * each such step.  Consider this raw input:
+					 *		112341234123412341234
+					 * This will be encoded as 5 literal bytes "11234" and
+					 * then a match tag with length 16 and offset 4.  After
+					 * memcpy'ing the first 4 bytes, we will have emitted
+					 *		112341234
+					 * so we can double "off" to 8, then after the next step
+					 * we have emitted
+					 *		11234123412341234
+					 * Then we can double "off" again, after which it is more
+					 * than the remaining "len" so we fall out of this loop
+					 * and finish with a non-overlapping copy of the
+					 * remainder.  In general, a match tag with off < len
+					 * implies that the decoded data has a repeat length of
+					 * "off".  We can handle 1, 2, 4, etc repetitions of the
+					 * repeated string per memcpy until we get to a situation
+					 * where the final copy step is non-overlapping.
+					 *
+					 * (Another way to understand this is that we are keeping
+					 * the copy source point dp - off the same throughout.)
+					 *----------
+					 */
+					off += off;
+				}
+				memcpy(dp, dp - off, len);
+				dp += len;
+			}
+			else
+			{
+				/*
+				 * An unset control bit means LITERAL BYTE. So we just copy
+				 * one from INPUT to OUTPUT.
+				 */
+				*dp++ = *sp++;
+			}
+
+			/*
+			 * Advance the control bit
+			 */
+			ctrl >>= 1;
+		}
+	}
+
+	/*
+	 * If requested, check we decompressed the right amount.
+	 */
+	if (check_complete && (dp != destend || sp != srcend))
+		return -1;
+
+	/*
+	 * That's it.
+	 */
+	return (char *) dp - dest;
+}
+
+
+/* ----------
+ * pglz_decompress -
+ *
+ *		Decompresses source into dest. Returns the number of bytes
+ *		decompressed into the destination buffer, or -1 if the
+ *		compressed data is corrupted.
+ *
+ *		If check_complete is true, the data is considered corrupted
+ *		if we don't exactly fill the destination buffer.  Callers that
+ *		are extracting a slice typically can't apply this check.
+ * ----------
+ */
+int32
+pglz_decompress(const char *source, int32 slen, char *dest,
+				int32 rawsize, bool check_complete)
+{
+	return pglz_decompress_internal(source, slen, dest, rawsize,
+									check_complete, false);
+}
+
+
+/* ----------
+ * pglz_decompress_slice -
+ *
+ *		Decompresses the first rawsize bytes of source into dest, which
+ *		must hold PGLZ_SLICE_BUFSIZE(rawsize) bytes.  Returns the number
+ *		of bytes decompressed (less than rawsize only if source ends
+ *		first), or -1 if the compressed data is corrupted.
+ * ----------
+ */
+int32
+pglz_decompress_slice(const char *source, int32 slen, char *dest,
+					  int32 rawsize)
+{
+	return pglz_decompress_internal(source, slen, dest, rawsize,
+									false, true);
+}
+
+
+/* ----------
+ * PGLZ_DecodeStream -
+ *
+ *		State of an incremental decompression between pglz_decode_update()
+ *		calls.
+ *
+ * ctrl and ctrlc are as in pglz_decompress_internal(): the control byte
+ * shifted past its used bits, and the number of its items done (8 when
+ * the next input byte is a control byte).  If a piece ended inside a tag,
+ * its first ntag bytes are in tag[], and ctrl & 1 is still set for it.
+ * ----------
+ */
+struct PGLZ_DecodeStream
+{
+	unsigned char *dest;
+	unsigned char *dp;
+	unsigned char *destend;
+	unsigned char ctrl;
+	int			ctrlc;
+	int			ntag;
+	unsigned char tag[2];
+	bool		corrupt;		/* found bad data; all calls now fail */
+	bool		overrun;		/* got input after dest was full */
+};
+
+
+/* ----------
+ * pglz_decode_begin -
+ *
+ *		Allocates and starts an incremental decompression into dest.
+ *		Returns NULL if out of memory.
+ * ----------
+ */
+PGLZ_DecodeStream *
+pglz_decode_begin(char *dest, int32 rawsize)
+{
+	PGLZ_DecodeStream *stream;
+
+	stream = (PGLZ_DecodeStream *) ALLOC(sizeof(PGLZ_DecodeStream));
+	if (stream == NULL)
+		return NULL;
+
+	stream->dest = (unsigned char *) dest;
+	stream->dp = stream->dest;
+	stream->destend = stream->dest + rawsize;
+	stream->ctrl = 0;
+	stream->ctrlc = 8;
+	stream->ntag = 0;
+	stream->corrupt = false;
+	stream->overrun = false;
+
+	return stream;
+}
+
+
+/* ----------
+ * pglz_decode_update -
+ *
+ *		Decodes the next slen bytes of compressed input.  Returns the
+ *		number of bytes of dest decoded so far, or -1 if the data is
+ *		corrupted.  Once dest is full, further input is not looked at.
+ * ----------
+ */
+int32
+pglz_decode_update(PGLZ_DecodeStream *stream, const char *source,
+				   int32 slen)
+{
+	const unsigned char *sp = (const unsigned char *) source;
+	const unsigned char *srcend = sp + slen;
+	unsigned char *dest = stream->dest;
+	unsigned char *dp = stream->dp;
+	unsigned char *destend = stream->destend;
+	unsigned char ctrl = stream->ctrl;
+	int			ctrlc = stream->ctrlc;
+
+	if (stream->corrupt)
+		return -1;
+
+	for (;;)
+	{
+		/* Between groups, hand the whole groups of this piece to the fast path */
+		if (ctrlc == 8 &&
+			pglz_decode_fast(&sp, srcend, &dp, destend, dest, &ctrl, &ctrlc,
+							 false) == PGLZ_FAST_CORRUPT)
+			goto corrupt;
+
+		/* The rest goes item by item, as in the slow loop */
+		if (dp >= destend)
+		{
+			if (sp < srcend)
+				stream->overrun = true;
+			break;
+		}
+		if (sp >= srcend)
+			break;
+
+		if (ctrlc == 8)
+		{
+			ctrl = *sp++;
+			ctrlc = 0;
+			continue;
+		}
+
+		if (ctrl & 1)
+		{
+			unsigned char t[3];
+			int			need;
+			int32		len;
+			int32		off;
+
+			/*
+			 * Assemble the tag from the bytes saved by the previous call and
+			 * this piece.  If the piece ends before it is complete, save
+			 * what we have and wait for the next one.
+			 */
+			memcpy(t, stream->tag, stream->ntag);
+			if (stream->ntag == 0)
+				t[stream->ntag++] = *sp++;
+			need = (t[0] & 0x0f) == 0x0f ? 3 : 2;
+			while (stream->ntag < need && sp < srcend)
+				t[stream->ntag++] = *sp++;
+			if (stream->ntag < need)
+			{
+				memcpy(stream->tag, t, stream->ntag);
+				break;
+			}
+			stream->ntag = 0;
+
+			len = (t[0] & 0x0f) + 3;
+			off = ((t[0] & 0xf0) << 4) | t[1];
+			if (len == 18)
+				len += t[2];
+
+			if (unlikely(off == 0 || off > (dp - dest)))
+				goto corrupt;
+
+			/* Don't emit more data than requested; see pglz_copy_match */
+			len = Min(len, destend - dp);
+			while (off < len)
+			{
+				memcpy(dp, dp - off, off);
+				len -= off;
+				dp += off;
+				off += off;
+			}
+			memcpy(dp, dp - off, len);
+			dp += len;
+		}
+		else
+			*dp++ = *sp++;
+
+		ctrl >>= 1;
+		ctrlc++;
+	}
+
+	stream->dp = dp;
+	stream->ctrl = ctrl;
+	stream->ctrlc = ctrlc;
+	return (int32) (dp - dest);
+
+corrupt:
+	stream->corrupt = true;
+	return -1;
+}
+
+
+/* ----------
+ * pglz_decode_end -
+ *
+ *		Finishes an incremental decompression and frees it.  Returns the
+ *		number of bytes decompressed into dest, or -1 if the data is
+ *		corrupted.
+ *
+ *		If check_complete is true, the data is also considered corrupted
+ *		unless dest is exactly full and all input was used, with no tag
+ *		cut off at its end, as for pglz_decompress().  Without it, the
+ *		caller may stop feeding input at any point, and gets what has
+ *		been decoded by then.
+ * ----------
+ */
+int32
+pglz_decode_end(PGLZ_DecodeStream *stream, bool check_complete)
+{
+	int32		result = (int32) (stream->dp - stream->dest);
+
+	if (stream->corrupt ||
+		(check_complete && (stream->dp != stream->destend ||
+							stream->overrun || stream->ntag != 0)))
+		result = -1;
+
+	FREE(stream);
+	return result;
+}
+
+
+/* ----------
+ * pglz_maximum_compressed_size -
+ *
+ *		Calculate the maximum compressed size for a given amount of raw data.
+ *		Return the maximum size, or total compressed size if maximum size is
+ *		larger than total compressed size.
+ *
+ * We can't use PGLZ_MAX_OUTPUT for this purpose, because that's used to size
+ * the compression buffer (and abort the compression). It does not really say
+ * what's the maximum compressed size for an input of a given length, and it
+ * may happen that while the whole value is compressible (and thus fits into
+ * PGLZ_MAX_OUTPUT nicely), the prefix is not compressible at all.
+ * ----------
+ */
+int32
+pglz_maximum_compressed_size(int32 rawsize, int32 total_compressed_size)
+{
+	int64		compressed_size;
+
+	/*
+	 * pglz uses one control bit per byte, so if the entire desired prefix is
+	 * represented as literal bytes, we'll need (rawsize * 9) bits.  We care
+	 * about bytes though, so be sure to round up not down.
+	 *
+	 * Use int64 here to prevent overflow during calculation.
+	 */
+	compressed_size = ((int64) rawsize * 9 + 7) / 8;
+
+	/*
+	 * The above fails to account for a corner case: we could have compressed
+	 * data that starts with N-1 or N-2 literal bytes and then has a match tag
+	 * of 2 or 3 bytes.  It's therefore possible that we need to fetch 1 or 2
+	 * more bytes in order to have the whole match tag.  (Match tags earlier
+	 * in the compressed data don't cause a problem, since they should
+	 * represent more decompressed bytes than they occupy themselves.)
+	 */
+	compressed_size += 2;
+
+	/*
+	 * Maximum compressed size can't be larger than total compressed size.
+	 * (This also ensures that our result fits in int32.)
+	 */
+	compressed_size = Min(compressed_size, total_compressed_size);
+
+	return (int32) compressed_size;
+}
+
+
+/* ----------
+ * Parallel frames
+ *
+ *		A frame is a sequence of independently compressed chunks, so that
+ *		both compression and decompression can be spread over threads.
+ *		All header and index fields are 4-byte little-endian integers:
+ *
+ *			magic			PGLZ_FRAME_MAGIC
+ *			rawsize			total uncompressed length
+ *			chunk_size		uncompressed length of every chunk but the
+ *							last (PGLZ_FRAME_CHUNK_SIZE)
+ *			nchunks			number of chunks
+ *			index[nchunks]	end offset of each chunk's data, counted from
+ *							the first data byte, with PGLZ_FRAME_RAW set if
+ *							the chunk is stored uncompressed
+ *			data			the chunks, in order
+ *
+ *		While compressing, chunk i is written to slot i of the data area,
+ *		PGLZ_FRAME_SLOT_SIZE bytes apart, and the index temporarily holds
+ *		chunk lengths.  pglz_frame_pack() then closes the gaps.
+ * ----------
+ */
+#define PGLZ_FRAME_MAGIC		0x465A4C50	/* "PLZF" */
+#define PGLZ_FRAME_RAW			0x80000000
+#define PGLZ_FRAME_SLOT_SIZE	PGLZ_MAX_OUTPUT(PGLZ_FRAME_CHUNK_SIZE)
+#define PGLZ_FRAME_MAX_THREADS	64
+
+PGLZ_STATIC_ASSERT(PGLZ_FRAME_MAX_OUTPUT_PER_CHUNK ==
+				   sizeof(uint32) + PGLZ_FRAME_SLOT_SIZE,
+				   frame_max_output_matches_slot_size);
+
+typedef struct PGLZ_FrameJob
+{
+	const char *source;
+	int32		slen;
+	char	   *index;			/* frame index, one entry per chunk */
+	char	   *slots;			/* data area, one slot per chunk */
+	const PGLZ_Strategy *strategy;
+	int			first;			/* this job does chunks first, */
+	int			stride;			/* first + stride, ... */
+	int			nchunks;
+	bool		failed;			/* out of memory */
+} PGLZ_FrameJob;
+
+static inline void
+pglz_put_u32(char *p, uint32 v)
+{
+	unsigned char *up = (unsigned char *) p;
+
+	up[0] = v & 0xff;
+	up[1] = (v >> 8) & 0xff;
+	up[2] = (v >> 16) & 0xff;
+	up[3] = (v >> 24) & 0xff;
+}
+
+static inline uint32
+pglz_get_u32(const char *p)
+{
+	const unsigned char *up = (const unsigned char *) p;
+
+	return (uint32) up[0] | ((uint32) up[1] << 8) |
+		((uint32) up[2] << 16) | ((uint32) up[3] << 24);
+}
+
+/* ----------
+ * pglz_frame_compress_chunks -
+ *
+ *		Compresses this job's share of the chunks into their slots with a
+ *		private context, recording each length in the index.
+ * ----------
+ */
+static void
+pglz_frame_compress_chunks(PGLZ_FrameJob *job)
+{
+	PGLZ_Context *ctx;
+	int			i;
+
+	ctx = pglz_context_create_extended(PGLZ_CTX_GENERATIONS);
+	if (ctx == NULL)
+	{
+		job->failed = true;
+		return;
+	}
+
+	for (i = job->first; i < job->nchunks; i += job->stride)
+	{
+		const char *src = job->source + (int64) i * PGLZ_FRAME_CHUNK_SIZE;
+		char	   *slot = job->slots + (int64) i * PGLZ_FRAME_SLOT_SIZE;
+		int32		len = Min(PGLZ_FRAME_CHUNK_SIZE,
+							  job->slen - (int64) i * PGLZ_FRAME_CHUNK_SIZE);
+		int32		clen;
+
+		clen = pglz_compress_ctx(ctx, src, len, slot, job->strategy);
+		if (clen < 0)
+		{
+			memcpy(slot, src, len);
+			pglz_put_u32(job->index + i * sizeof(uint32),
+						 (uint32) len | PGLZ_FRAME_RAW);
+		}
+		else
+			pglz_put_u32(job->index + i * sizeof(uint32), (uint32) clen);
+	}
+
+	pglz_context_free(ctx);
+}
+
+#ifdef FRONTEND
+static void *
+pglz_frame_worker(void *arg)
+{
+	pglz_frame_compress_chunks((PGLZ_FrameJob *) arg);
+	return NULL;
+}
+#endif
+
+/* ----------
+ * pglz_frame_pack -
+ *
+ *		Moves the chunk slots together and turns the index lengths into
+ *		end offsets.  Returns the size of the data area.
+ * ----------
+ */
+static int64
+pglz_frame_pack(char *index, char *data, int nchunks)
+{
+	int64		end = 0;
+	int			i;
+
+	for (i = 0; i < nchunks; i++)
+	{
+		uint32		entry = pglz_get_u32(index + i * sizeof(uint32));
+		uint32		len = entry & ~PGLZ_FRAME_RAW;
+
+		/* Slots only move down, and earlier ones have already moved */
+		memmove(data + end, data + (int64) i * PGLZ_FRAME_SLOT_SIZE, len);
+		end += len;
+		pglz_put_u32(index + i * sizeof(uint32),
+					 (uint32) end | (entry & PGLZ_FRAME_RAW));
+	}
+
+	return end;
+}
+
+
+/* ----------
+ * pglz_compress_parallel -
+ *
+ *		Compresses source into a frame of independently compressed
+ *		chunks, using up to nthreads threads.  Returns the number of
+ *		bytes written in buffer dest, or -1 if compression fails.
+ * ----------
+ */
+int32
+pglz_compress_parallel(const char *source, int32 slen, char *dest,
+					   const PGLZ_Strategy *strategy, int nthreads)
+{
+	PGLZ_FrameJob jobs[PGLZ_FRAME_MAX_THREADS];
+#ifdef FRONTEND
+	pthread_t	threads[PGLZ_FRAME_MAX_THREADS];
+	bool		started[PGLZ_FRAME_MAX_THREADS];
+#endif
+	int			nchunks;
+	int			need_rate;
+	int64		result_max;
+	int64		result_size;
+	char	   *index;
+	char	   *data;
+	bool		failed = false;
+	int			w;
+
+	if (strategy == NULL)
+		strategy = PGLZ_strategy_default;
+
+	/*
+	 * Same input size limits as pglz_compress(); the frame bound must also
+	 * fit in an int32 result.
+	 */
+	if (slen <= 0 ||
+		slen < strategy->min_input_size ||
+		slen > strategy->max_input_size ||
+		PGLZ_FRAME_MAX_OUTPUT(slen) > INT_MAX)
+		return -1;
+
+	nchunks = PGLZ_FRAME_NCHUNKS(slen);
+	nthreads = Max(1, Min(nthreads, Min(nchunks, PGLZ_FRAME_MAX_THREADS)));
+	index = dest + PGLZ_FRAME_HEADER_SIZE;
+	data = index + (int64) nchunks * sizeof(uint32);
+
+	for (w = 0; w < nthreads; w++)
+	{
+		jobs[w].source = source;
+		jobs[w].slen = slen;
+		jobs[w].index = index;
+		jobs[w].slots = data;
+		jobs[w].strategy = strategy;
+		jobs[w].first = w;
+		jobs[w].stride = nthreads;
+		jobs[w].nchunks = nchunks;
+		jobs[w].failed = false;
+	}
+
+#ifdef FRONTEND
+
+	/*
+	 * Job 0 runs in this thread.  A job whose thread cannot be started is
+	 * run here too, after the others have been joined.
+	 */
+	for (w = 1; w < nthreads; w++)
+		started[w] = pthread_create(&threads[w], NULL, pglz_frame_worker,
+									&jobs[w]) == 0;
+	pglz_frame_compress_chunks(&jobs[0]);
+	for (w = 1; w < nthreads; w++)
+	{
+		if (started[w])
+			pthread_join(threads[w], NULL);
+		else
+			pglz_frame_compress_chunks(&jobs[w]);
+	}
+#else
+	for (w = 0; w < nthreads; w++)
+		pglz_frame_compress_chunks(&jobs[w]);
+#endif
+
+	for (w = 0; w < nthreads; w++)
+		failed |= jobs[w].failed;
+	if (failed)
+		return -1;
+
+	result_size = (data - dest) + pglz_frame_pack(index, data, nchunks);
+
+	/* As in pglz_compress(), require the strategy's compression rate */
+	need_rate = strategy->min_comp_rate;
+	if (need_rate < 0)
+		need_rate = 0;
+	else if (need_rate > 99)
+		need_rate = 99;
+	result_max = ((int64) slen * (100 - need_rate)) / 100;
+	if (result_size >= result_max)
+		return -1;
+
+	pglz_put_u32(dest, PGLZ_FRAME_MAGIC);
+	pglz_put_u32(dest + 4, (uint32) slen);
+	pglz_put_u32(dest + 8, PGLZ_FRAME_CHUNK_SIZE);
+	pglz_put_u32(dest + 12, (uint32) nchunks);
+
+	return (int32) result_size;
+}
+
+
+/* ----------
+ * pglz_decompress_frame -
+ *
+ *		Decompresses a frame made by pglz_compress_parallel().  Returns
+ *		rawsize, or -1 if the frame is corrupted or does not hold exactly
+ *		rawsize bytes.
+ * ----------
+ */
+int32
+pglz_decompress_frame(const char *source, int32 slen, char *dest,
+					  int32 rawsize)
+{
+	const char *data;
+	int64		datalen;
+	int64		prev = 0;
+	uint32		chunk_size;
+	uint32		nchunks;
+	uint32		i;
+
+	if (slen < PGLZ_FRAME_HEADER_SIZE ||
+		pglz_get_u32(source) != PGLZ_FRAME_MAGIC ||
+		pglz_get_u32(source + 4) != (uint32) rawsize)
+		return -1;
+
+	chunk_size = pglz_get_u32(source + 8);
+	nchunks = pglz_get_u32(source + 12);
+	if (rawsize <= 0 || chunk_size == 0 || chunk_size > INT_MAX ||
+		nchunks != ((int64) rawsize + chunk_size - 1) / chunk_size ||
+		PGLZ_FRAME_HEADER_SIZE + (int64) nchunks * (int64) sizeof(uint32) > slen)
+		return -1;
+
+	data = source + PGLZ_FRAME_HEADER_SIZE + nchunks * sizeof(uint32);
+	datalen = slen - (data - source);
+
+	for (i = 0; i < nchunks; i++)
+	{
+		uint32		entry = pglz_get_u32(source + PGLZ_FRAME_HEADER_SIZE +
+										 i * sizeof(uint32));
+		int64		end = entry & ~PGLZ_FRAME_RAW;
+		char	   *dp = dest + (int64) i * chunk_size;
+		int32		rlen = Min(chunk_size, rawsize - (int64) i * chunk_size);
+
+		if (end < prev || end > datalen)
+			return -1;
+
+		if (entry & PGLZ_FRAME_RAW)
+		{
+			if (end - prev != rlen)
+				return -1;
+			memcpy(dp, data + prev, rlen);
+		}
+		else if (pglz_decompress(data + prev, (int32) (end - prev), dp,
+								 rlen, true) != rlen)
+			return -1;
+
+		prev = end;
+	}
+
+	if (prev != datalen)
+		return -1;
+
+	return rawsize;
+}
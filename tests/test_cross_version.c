@@ -37,6 +37,13 @@ extern int32 pglz_decompress_variant(const char *source, int32 slen, char *dest,
                                      int32 rawsize, bool check_complete);
 extern const PGLZ_Strategy *const PGLZ_strategy_always_variant;
 
+/*
+ * Lazy matching, in variants that have it (these names are not renamed:
+ * stock has no such symbols).
+ */
+#pragma weak pglz_compress_ext
+#pragma weak PGLZ_strategy_archive
+
 /* Simple PRNG */
 static uint64_t rng_state;
 static void rng_seed(uint64_t seed) { rng_state = seed ? seed : 1; }
@@ -127,6 +134,37 @@ test_cross(const char *name, char *input, int size)
         }
     }
 
+    /* Test 4: Variant lazy-matching output → stock decompressor */
+    if (pglz_compress_ext != NULL && &PGLZ_strategy_archive != NULL) {
+        PGLZ_StrategyExt lazy = *PGLZ_strategy_archive;
+        char *lazy_comp = malloc(out_size);
+
+        if (!lazy_comp) {
+            fprintf(stderr, "OOM\n");
+            exit(1);
+        }
+
+        /* Archive matching, but any input size and compression rate */
+        lazy.base.min_input_size = PGLZ_strategy_always_variant->min_input_size;
+        lazy.base.min_comp_rate = PGLZ_strategy_always_variant->min_comp_rate;
+        lazy.base.first_success_by =
+            PGLZ_strategy_always_variant->first_success_by;
+        int32 lazy_clen = pglz_compress_ext(input, size, lazy_comp, &lazy);
+        bool lazy_ok = true;
+
+        if (lazy_clen >= 0) {
+            int32 dlen = pglz_decompress(lazy_comp, lazy_clen,
+                                         decompressed, size, true);
+            lazy_ok = (dlen == size && memcmp(input, decompressed, size) == 0);
+        }
+        free(lazy_comp);
+        if (!lazy_ok) {
+            printf("  FAIL: variant lazy→stock decompress\n");
+            tests_failed++;
+            goto cleanup;
+        }
+    }
+
     int ratio_diff = 0;
     if (stock_clen > 0 && variant_clen > 0)
         ratio_diff = variant_clen - stock_clen;
@@ -0,0 +1,248 @@
+/*
+ * test_unlink_diff.c — Differential test of recycling without unlinking.
+ *
+ * Step 19 unlinks a recycled history entry from its old bucket chain;
+ * step 19b leaves it linked and relies on pglz_find_match() stopping at
+ * the first offset that does not grow.  Both must find the same matches,
+ * so this program is built against each and the outputs compared.
+ *
+ * It compresses every pattern and size with skip_threshold 0, which adds
+ * every position to the history (bench_pglz --skip=0) and so recycles an
+ * entry per position once the history is full, and with the default
+ * skip_threshold; once through the static context, which resets per
+ * call, and once through a reused generation-tagged context, whose
+ * entries survive from earlier calls.  Each with every available hash.
+ * Every result is round-tripped, and written to stdout as a 4-byte
+ * length and the compressed bytes.
+ *
+ * Compile and run (or make run-unlink-diff):
+ *   clang -g -O2 -DFRONTEND -fsanitize=address,undefined \
+ *     -I../bench/include -o test_unlink_diff_ref test_unlink_diff.c \
+ *     ../bench/variants/pg_lzcompress_step19_adaptive_skip.c
+ *   clang -g -O2 -DFRONTEND -fsanitize=address,undefined \
+ *     -I../bench/include -o test_unlink_diff test_unlink_diff.c \
+ *     ../bench/variants/pg_lzcompress_step19b_no_unlink.c
+ *   ./test_unlink_diff_ref > ref.bin && ./test_unlink_diff > var.bin
+ *   cmp ref.bin var.bin
+ *
+ * Exit status is 1 if a round trip fails.
+ */
+
+#define FRONTEND 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common/pg_lzcompress.h"
+
+/*
+ * Up to 64 KiB: step 19 unlinks with a scan of up to the whole history
+ * per position on degenerate input, which is slow enough under ASan.
+ */
+static const int test_sizes[] = {
+    5, 64, 512, 2048, 4095, 4096, 4097, 8192, 16384, 65536
+};
+#define NUM_SIZES (sizeof(test_sizes) / sizeof(test_sizes[0]))
+#define MAX_SIZE 65536
+
+/* ----------
+ * Pattern generators
+ * ----------
+ */
+static uint64_t rng_state;
+
+static void rng_seed(uint64_t seed)
+{
+    rng_state = seed ? seed : 1;
+}
+
+static uint8_t rng_byte(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint8_t)(rng_state & 0xFF);
+}
+
+typedef void (*gen_fn)(char *buf, int len);
+
+static void gen_english(char *buf, int len)
+{
+    static const char *words[] = {
+        "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ",
+        "dog ", "PostgreSQL ", "compression ", "history ", "table ",
+        "entry ", "chain ", "bucket ", "a ", "of ", "and ", "to ", "in "
+    };
+    int pos = 0;
+
+    rng_seed(7);
+    while (pos < len)
+    {
+        const char *w = words[rng_byte() % 20];
+        int wlen = strlen(w);
+
+        if (pos + wlen > len)
+            wlen = len - pos;
+        memcpy(buf + pos, w, wlen);
+        pos += wlen;
+    }
+}
+
+/* All positions hash alike: one chain holding the whole history */
+static void gen_degenerate(char *buf, int len)
+{
+    memset(buf, 'A', len);
+}
+
+/* Short periods: few chains, each of many positions */
+static void gen_period3(char *buf, int len)
+{
+    for (int i = 0; i < len; i++)
+        buf[i] = "abc"[i % 3];
+}
+
+static void gen_period7(char *buf, int len)
+{
+    for (int i = 0; i < len; i++)
+        buf[i] = "pglz_19"[i % 7];
+}
+
+/* pgbench_accounts-like rows: numbered, mostly padding */
+static void gen_rows(char *buf, int len)
+{
+    int pos = 0;
+
+    for (int aid = 1; pos < len; aid++)
+    {
+        char row[128];
+        int n = snprintf(row, sizeof(row), "%d|%d|0|%84s\n", aid,
+                         (aid - 1) / 100000 + 1, "");
+
+        if (pos + n > len)
+            n = len - pos;
+        memcpy(buf + pos, row, n);
+        pos += n;
+    }
+}
+
+static void gen_random(char *buf, int len)
+{
+    rng_seed(42);
+    for (int i = 0; i < len; i++)
+        buf[i] = (char) rng_byte();
+}
+
+/* Random bytes with short runs copied back from a few hundred bytes on */
+static void gen_mixed(char *buf, int len)
+{
+    rng_seed(19);
+    for (int i = 0; i < len; i++)
+    {
+        if (i >= 512 && rng_byte() < 64)
+        {
+            int off = 3 + rng_byte() % 500;
+            int run = 3 + rng_byte() % 40;
+
+            for (; run > 0 && i < len; run--, i++)
+                buf[i] = buf[i - off];
+            i--;
+        }
+        else
+            buf[i] = (char) rng_byte();
+    }
+}
+
+static const struct
+{
+    const char *name;
+    gen_fn      generate;
+} patterns[] = {
+    { "english", gen_english },
+    { "degenerate", gen_degenerate },
+    { "period3", gen_period3 },
+    { "period7", gen_period7 },
+    { "rows", gen_rows },
+    { "random", gen_random },
+    { "mixed", gen_mixed },
+};
+#define NUM_PATTERNS (sizeof(patterns) / sizeof(patterns[0]))
+
+static const PGLZ_HashKind hashes[] = {
+    PGLZ_HASH_STOCK, PGLZ_HASH_FIBONACCI, PGLZ_HASH_CRC32C
+};
+#define NUM_HASHES (sizeof(hashes) / sizeof(hashes[0]))
+
+static const int skip_thresholds[] = { 0, PGLZ_SKIP_THRESHOLD_DEFAULT };
+#define NUM_SKIPS (sizeof(skip_thresholds) / sizeof(skip_thresholds[0]))
+
+static char input[MAX_SIZE];
+static char output[PGLZ_MAX_OUTPUT(MAX_SIZE)];
+static char decoded[MAX_SIZE];
+static int failures;
+
+/* Write one result and check that it decompresses to the input */
+static void
+emit(const char *what, const char *pattern, int len, int32 clen)
+{
+    fwrite(&clen, sizeof(int32), 1, stdout);
+    if (clen < 0)
+        return;
+    fwrite(output, 1, clen, stdout);
+
+    if (pglz_decompress(output, clen, decoded, len, true) != len ||
+        memcmp(decoded, input, len) != 0)
+    {
+        fprintf(stderr, "FAIL: %s %s %d: round trip\n", what, pattern, len);
+        failures++;
+    }
+}
+
+int
+main(void)
+{
+    PGLZ_StrategyExt strategy;
+    PGLZ_Context *ctx = pglz_context_create_extended(PGLZ_CTX_GENERATIONS);
+    int runs = 0;
+
+    if (ctx == NULL)
+    {
+        fprintf(stderr, "cannot create a context\n");
+        return 1;
+    }
+
+    for (int h = 0; h < (int) NUM_HASHES; h++)
+    {
+        /* Unavailable hashes are skipped alike by both builds */
+        if (!pglz_set_hash(hashes[h]) ||
+            !pglz_context_set_hash(ctx, hashes[h]))
+            continue;
+
+        for (int k = 0; k < (int) NUM_SKIPS; k++)
+        {
+            memset(&strategy, 0, sizeof(strategy));
+            strategy.base = *PGLZ_strategy_always;
+            strategy.skip_threshold = skip_thresholds[k];
+
+            for (int p = 0; p < (int) NUM_PATTERNS; p++)
+                for (int s = 0; s < (int) NUM_SIZES; s++)
+                {
+                    int len = test_sizes[s];
+
+                    patterns[p].generate(input, len);
+                    emit("static", patterns[p].name, len,
+                         pglz_compress_ext(input, len, output, &strategy));
+                    emit("generations", patterns[p].name, len,
+                         pglz_compress_ctx_ext(ctx, input, len, output,
+                                               &strategy));
+                    runs += 2;
+                }
+        }
+    }
+    pglz_context_free(ctx);
+
+    fprintf(stderr, "%d compressions, %d failures\n", runs, failures);
+    return failures ? 1 : 0;
+}